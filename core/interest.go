@@ -0,0 +1,416 @@
+package core
+
+import (
+	"context"
+	"encoding/base64"
+	"fmt"
+	"strings"
+	"sync"
+	"sync/atomic"
+
+	pb "github.com/immesys/wavemq/mqpb"
+	"github.com/prometheus/client_golang/prometheus"
+)
+
+//Interest propagation lets an edge router avoid forwarding publishes that
+//nobody is subscribed to. The designated router tracks the URI patterns
+//that its subscriptions use and streams changes to them to every edge
+//router connected over PeerInterest. The edge router only enqueues a
+//message on the upstream queue if it matches a reported pattern. Until the
+//full set of patterns has been received (or if the stream fails) the edge
+//router forwards everything, as it did before
+
+//The maximum number of patterns sent in a single InterestUpdate
+const InterestUpdateMaxPatterns = 1000
+
+//Some instrumentation
+var pmUpstreamSkippedMessages = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "route",
+	Name:      "upstream_skipped_messages",
+	Help:      "Number of messages not sent to the designated router because nothing there is subscribed to them",
+})
+var pmInterestWatchers = prometheus.NewGauge(prometheus.GaugeOpts{
+	Subsystem: "route",
+	Name:      "interest_watchers",
+	Help:      "Number of edge routers following our subscription interest",
+})
+
+func init() {
+	prometheus.MustRegister(pmUpstreamSkippedMessages)
+	prometheus.MustRegister(pmInterestWatchers)
+}
+
+//The subscription patterns in namespaces we are the designated router for
+type interestRegistry struct {
+	mu         sync.Mutex
+	namespaces map[string]*nsInterest
+}
+
+type nsInterest struct {
+	//The number of subscriptions using each pattern
+	total map[string]int
+	//The number of subscriptions using each pattern, by the router they
+	//deliver to
+	byRecipient map[string]map[string]int
+	watchers    map[*interestWatcher]struct{}
+}
+
+//An edge router following the interest in a namespace
+type interestWatcher struct {
+	routerID string
+	mu       sync.Mutex
+	//The patterns that changed since the last update was sent, true if
+	//they gained interest and false if they lost it
+	pending map[string]bool
+	notify  chan struct{}
+}
+
+func newInterestRegistry() *interestRegistry {
+	return &interestRegistry{
+		namespaces: make(map[string]*nsInterest),
+	}
+}
+
+//Return the interest for a namespace, the mutex must be held
+func (ir *interestRegistry) ns(namespace string) *nsInterest {
+	nsi, ok := ir.namespaces[namespace]
+	if !ok {
+		nsi = &nsInterest{
+			total:       make(map[string]int),
+			byRecipient: make(map[string]map[string]int),
+			watchers:    make(map[*interestWatcher]struct{}),
+		}
+		ir.namespaces[namespace] = nsi
+	}
+	return nsi
+}
+
+//Is there a subscription to the pattern that does not deliver to the
+//given router
+func (nsi *nsInterest) interesting(pattern string, routerID string) bool {
+	return nsi.total[pattern]-nsi.byRecipient[pattern][routerID] > 0
+}
+
+//Record that a subscription to the pattern delivering to the given
+//recipient was added (delta=1) or removed (delta=-1)
+func (ir *interestRegistry) update(namespace string, pattern string, recipient string, delta int) {
+	ir.mu.Lock()
+	defer ir.mu.Unlock()
+	nsi := ir.ns(namespace)
+	before := make(map[*interestWatcher]bool, len(nsi.watchers))
+	for w := range nsi.watchers {
+		before[w] = nsi.interesting(pattern, w.routerID)
+	}
+	nsi.total[pattern] += delta
+	if nsi.total[pattern] <= 0 {
+		delete(nsi.total, pattern)
+	}
+	byr, ok := nsi.byRecipient[pattern]
+	if !ok {
+		byr = make(map[string]int)
+		nsi.byRecipient[pattern] = byr
+	}
+	byr[recipient] += delta
+	if byr[recipient] <= 0 {
+		delete(byr, recipient)
+	}
+	if len(byr) == 0 {
+		delete(nsi.byRecipient, pattern)
+	}
+	for w, was := range before {
+		is := nsi.interesting(pattern, w.routerID)
+		if is != was {
+			w.change(pattern, is)
+		}
+	}
+}
+
+//Begin following a namespace. Returns the patterns currently of interest
+//to the router. Later changes are queued on the watcher
+func (ir *interestRegistry) watch(namespace string, routerID string) (*interestWatcher, []string) {
+	w := &interestWatcher{
+		routerID: routerID,
+		pending:  make(map[string]bool),
+		notify:   make(chan struct{}, 1),
+	}
+	ir.mu.Lock()
+	defer ir.mu.Unlock()
+	nsi := ir.ns(namespace)
+	nsi.watchers[w] = struct{}{}
+	rv := []string{}
+	for pattern := range nsi.total {
+		if nsi.interesting(pattern, routerID) {
+			rv = append(rv, pattern)
+		}
+	}
+	return w, rv
+}
+
+func (ir *interestRegistry) unwatch(namespace string, w *interestWatcher) {
+	ir.mu.Lock()
+	delete(ir.ns(namespace).watchers, w)
+	ir.mu.Unlock()
+}
+
+func (w *interestWatcher) change(pattern string, interesting bool) {
+	w.mu.Lock()
+	w.pending[pattern] = interesting
+	w.mu.Unlock()
+	select {
+	case w.notify <- struct{}{}:
+	default:
+	}
+}
+
+//Take the changes queued since the last call
+func (w *interestWatcher) take() (added []string, removed []string) {
+	w.mu.Lock()
+	pending := w.pending
+	w.pending = make(map[string]bool)
+	w.mu.Unlock()
+	for pattern, interesting := range pending {
+		if interesting {
+			added = append(added, pattern)
+		} else {
+			removed = append(removed, pattern)
+		}
+	}
+	return added, removed
+}
+
+//Add or remove a subscription from the interest we report to edge routers
+func (t *Terminus) trackInterest(s *subscription, delta int) {
+	if s.q.GetIsPeerUpstream() {
+		return
+	}
+	parts := strings.SplitN(s.uri, "/", 2)
+	if len(parts) != 2 || !t.drnamespaces[parts[0]] {
+		return
+	}
+	t.interest.update(parts[0], parts[1], s.q.GetRecipientID(), delta)
+}
+
+//IsDesignatedRouterFor returns true if we are the designated router for the
+//namespace
+func (t *Terminus) IsDesignatedRouterFor(namespace []byte) bool {
+	return t.drnamespaces[base64.URLEncoding.EncodeToString(namespace)]
+}
+
+//WatchInterest streams the subscription patterns in a namespace we are the
+//designated router for to an edge router, until ctx is cancelled or send
+//fails. Subscriptions that deliver to the given router are not reported
+func (t *Terminus) WatchInterest(ctx context.Context, namespace []byte, routerID string, send func(u *pb.InterestUpdate) error) error {
+	ns := base64.URLEncoding.EncodeToString(namespace)
+	if !t.drnamespaces[ns] {
+		return fmt.Errorf("we are not the designated router for this namespace")
+	}
+	w, patterns := t.interest.watch(ns, routerID)
+	defer t.interest.unwatch(ns, w)
+	pmInterestWatchers.Inc()
+	defer pmInterestWatchers.Dec()
+
+	//Send the initial set of patterns, split up to stay under the message
+	//size limit
+	first := true
+	for first || len(patterns) > 0 {
+		n := len(patterns)
+		if n > InterestUpdateMaxPatterns {
+			n = InterestUpdateMaxPatterns
+		}
+		err := send(&pb.InterestUpdate{
+			Reset_: first,
+			Added:  patterns[:n],
+			More:   n < len(patterns),
+		})
+		if err != nil {
+			return err
+		}
+		patterns = patterns[n:]
+		first = false
+	}
+
+	for {
+		select {
+		case <-ctx.Done():
+			return nil
+		case <-w.notify:
+		}
+		added, removed := w.take()
+		for len(added) > 0 || len(removed) > 0 {
+			u := &pb.InterestUpdate{}
+			n := len(added)
+			if n > InterestUpdateMaxPatterns {
+				n = InterestUpdateMaxPatterns
+			}
+			u.Added, added = added[:n], added[n:]
+			n = len(removed)
+			if n > InterestUpdateMaxPatterns {
+				n = InterestUpdateMaxPatterns
+			}
+			u.Removed, removed = removed[:n], removed[n:]
+			if err := send(u); err != nil {
+				return err
+			}
+		}
+	}
+}
+
+//The interest the designated router has reported for a namespace
+type remoteInterest struct {
+	namespace string
+	mu        sync.Mutex
+	//Incremented for every interest stream. Updates from older streams are
+	//ignored, as is the end of an older stream
+	stream uint64
+	//The matcher the current stream is building and the node holding each
+	//pattern in its tree. Both are nil until the stream sends its initial
+	//set of patterns
+	building *interestMatcher
+	patterns map[string]*subTreeNode
+	//True once the initial set of patterns has been received
+	synced bool
+	//The current *interestMatcher. It is nil while we have no complete
+	//view of the interest, in which case everything is forwarded
+	matcher atomic.Value
+}
+
+type interestMatcher struct {
+	tokens *tokenTable
+	tree   *subTreeNode
+	cache  *matchCache
+}
+
+func newRemoteInterest(namespace string) *remoteInterest {
+	rv := &remoteInterest{
+		namespace: namespace,
+	}
+	rv.matcher.Store((*interestMatcher)(nil))
+	return rv
+}
+
+//Start a new interest stream, forgetting what older streams reported.
+//Returns the stream to pass to apply and end
+func (ri *remoteInterest) begin() uint64 {
+	ri.mu.Lock()
+	defer ri.mu.Unlock()
+	ri.stream++
+	ri.reset()
+	return ri.stream
+}
+
+//Go back to forwarding everything. The mutex must be held
+func (ri *remoteInterest) reset() {
+	ri.building = nil
+	ri.patterns = nil
+	ri.synced = false
+	ri.matcher.Store((*interestMatcher)(nil))
+}
+
+//Apply an update received from the designated router on the given stream
+func (ri *remoteInterest) apply(stream uint64, u *pb.InterestUpdate) {
+	ri.mu.Lock()
+	defer ri.mu.Unlock()
+	if stream != ri.stream {
+		return
+	}
+	if u.Reset_ {
+		//The current matcher stays in use until the new set is complete
+		ri.building = &interestMatcher{
+			tokens: newTokenTable(),
+			tree:   newSnode(),
+			cache:  newMatchCache(),
+		}
+		ri.patterns = make(map[string]*subTreeNode)
+		ri.synced = false
+	} else if ri.patterns == nil {
+		//Changes mean nothing without the initial set
+		return
+	}
+	m := ri.building
+	for _, pattern := range u.Added {
+		if _, ok := ri.patterns[pattern]; ok {
+			continue
+		}
+		uri := ri.namespace + "/" + pattern
+		ri.patterns[pattern] = m.tree.addSub(m.tokens.intern(uri), &subscription{
+			subid: ID(uri),
+			uri:   uri,
+		})
+	}
+	for _, pattern := range u.Removed {
+		node, ok := ri.patterns[pattern]
+		if !ok {
+			continue
+		}
+		next := node.copy()
+		delete(next.subz, ID(ri.namespace+"/"+pattern))
+		node.v.Store(*next)
+		delete(ri.patterns, pattern)
+	}
+	m.cache.Invalidate()
+	if !u.More && !ri.synced {
+		ri.synced = true
+		ri.matcher.Store(m)
+	}
+}
+
+//Forget what the given stream reported and go back to forwarding
+//everything, unless a newer stream has started
+func (ri *remoteInterest) end(stream uint64) {
+	ri.mu.Lock()
+	if stream == ri.stream {
+		ri.reset()
+	}
+	ri.mu.Unlock()
+}
+
+//Could anything at the designated router be subscribed to the given
+//namespace prefixed URI
+func (ri *remoteInterest) interested(uri string) bool {
+	m := ri.matcher.Load().(*interestMatcher)
+	if m == nil {
+		return true
+	}
+	subs := m.cache.Get(uri, func() []*subscription {
+		return m.tree.matchSubs(m.tokens.lookup(uri))
+	})
+	return len(subs) > 0
+}
+
+//Follow the interest the designated router reports for a namespace until
+//ctx is cancelled or the stream fails
+func (t *Terminus) followInterest(ctx context.Context, peer pb.WAVEMQPeeringClient, namespace string) {
+	ri := t.upstreamInterest[namespace]
+	id := ri.begin()
+	defer ri.end(id)
+	nsbin, err := base64.URLEncoding.DecodeString(namespace)
+	if err != nil {
+		panic(err)
+	}
+	params, werr := t.am.FormInterestRequest(nsbin, t.ourNodeId)
+	if werr != nil {
+		//Without the interest permission we forward everything
+		fmt.Printf("could not form interest request for %s: %v\n", namespace, werr)
+		return
+	}
+	stream, err := peer.PeerInterest(ctx, params)
+	if err != nil {
+		return
+	}
+	for {
+		u, err := stream.Recv()
+		if err != nil {
+			//This includes designated routers that predate interest
+			//propagation, we just forward everything to them
+			if ctx.Err() == nil {
+				fmt.Printf("interest stream for %s failed: %v\n", namespace, err)
+			}
+			return
+		}
+		if u.Error != nil {
+			fmt.Printf("interest stream for %s failed: %s\n", namespace, u.Error.Message)
+			return
+		}
+		ri.apply(id, u)
+	}
+}
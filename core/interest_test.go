@@ -0,0 +1,110 @@
+package core
+
+import (
+	"sort"
+	"testing"
+
+	pb "github.com/immesys/wavemq/mqpb"
+	"github.com/stretchr/testify/require"
+)
+
+func takeSorted(w *interestWatcher) ([]string, []string) {
+	added, removed := w.take()
+	sort.Strings(added)
+	sort.Strings(removed)
+	return added, removed
+}
+
+func TestInterestRegistry(t *testing.T) {
+	ir := newInterestRegistry()
+	ir.update("ns", "a/b", "", 1)
+	w, initial := ir.watch("ns", "edge1")
+	require.Equal(t, []string{"a/b"}, initial)
+
+	//A second subscription to a reported pattern is not a change
+	ir.update("ns", "a/b", "", 1)
+	added, removed := takeSorted(w)
+	require.Nil(t, added)
+	require.Nil(t, removed)
+
+	//Subscriptions delivering to the watching router are not reported to it
+	ir.update("ns", "c/*", "edge1", 1)
+	added, _ = takeSorted(w)
+	require.Nil(t, added)
+	ir.update("ns", "c/*", "edge2", 1)
+	added, _ = takeSorted(w)
+	require.Equal(t, []string{"c/*"}, added)
+
+	ir.update("ns", "a/b", "", -1)
+	ir.update("ns", "a/b", "", -1)
+	_, removed = takeSorted(w)
+	require.Equal(t, []string{"a/b"}, removed)
+
+	//Other namespaces are not reported
+	ir.update("other", "x", "", 1)
+	added, _ = takeSorted(w)
+	require.Nil(t, added)
+
+	ir.unwatch("ns", w)
+	ir.update("ns", "d", "", 1)
+	added, _ = takeSorted(w)
+	require.Nil(t, added)
+}
+
+func TestRemoteInterest(t *testing.T) {
+	ri := newRemoteInterest("ns")
+	//Until we have heard from the DR, everything is forwarded
+	require.True(t, ri.interested("ns/a/b"))
+
+	id := ri.begin()
+	//Changes before the initial set are ignored
+	ri.apply(id, &pb.InterestUpdate{
+		Added: []string{"x"},
+	})
+	require.True(t, ri.interested("ns/z"))
+	ri.apply(id, &pb.InterestUpdate{
+		Reset_: true,
+		Added:  []string{"a/+"},
+		More:   true,
+	})
+	//Not synced until the whole initial set has arrived
+	require.True(t, ri.interested("ns/z"))
+	ri.apply(id, &pb.InterestUpdate{
+		Added: []string{"c/*"},
+	})
+	require.True(t, ri.interested("ns/a/b"))
+	require.True(t, ri.interested("ns/c/d/e"))
+	require.False(t, ri.interested("ns/z"))
+	require.False(t, ri.interested("ns/x"))
+
+	ri.apply(id, &pb.InterestUpdate{
+		Removed: []string{"a/+"},
+	})
+	require.False(t, ri.interested("ns/a/b"))
+	ri.apply(id, &pb.InterestUpdate{
+		Added: []string{"a/b"},
+	})
+	require.True(t, ri.interested("ns/a/b"))
+
+	//A reconnect, the old stream ends after the new one has synced
+	next := ri.begin()
+	ri.apply(id, &pb.InterestUpdate{
+		Reset_: true,
+		Added:  []string{"z"},
+	})
+	require.True(t, ri.interested("ns/q"))
+	ri.apply(next, &pb.InterestUpdate{
+		Reset_: true,
+		Added:  []string{"q"},
+	})
+	ri.end(id)
+	ri.apply(next, &pb.InterestUpdate{
+		Added: []string{"r"},
+	})
+	require.True(t, ri.interested("ns/q"))
+	require.True(t, ri.interested("ns/r"))
+	require.False(t, ri.interested("ns/z"))
+
+	ri.end(next)
+	require.True(t, ri.interested("ns/z"))
+}
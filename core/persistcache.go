@@ -0,0 +1,199 @@
+package core
+
+import (
+	"container/list"
+	"sync"
+
+	"github.com/prometheus/client_golang/prometheus"
+)
+
+//The maximum number of persisted message tree paths remembered as existing
+const PersistParentCacheMaxEntries = 100000
+
+const persistParentCacheShards = 16
+
+//The maximum number of topics whose latest persisted message is kept in
+//memory, and the maximum total size of those messages
+const PersistLatestCacheMaxEntries = 20000
+const PersistLatestCacheMaxSize = 64 * 1024 * 1024
+
+//Messages larger than this are always read from the database
+const PersistLatestCacheMaxValueSize = 64 * 1024
+
+const persistLatestCacheShards = 16
+
+var pmPersistParentCacheHits = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "route",
+	Name:      "persist_parent_cache_hits",
+	Help:      "Number of persisted message parent paths found in the cache",
+})
+var pmPersistParentCacheMisses = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "route",
+	Name:      "persist_parent_cache_misses",
+	Help:      "Number of persisted message parent paths looked up in the database",
+})
+
+var pmPersistLatestCacheHits = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "route",
+	Name:      "persist_latest_cache_hits",
+	Help:      "Number of persisted message lookups served from the cache",
+})
+var pmPersistLatestCacheMisses = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "route",
+	Name:      "persist_latest_cache_misses",
+	Help:      "Number of persisted message lookups that read the database",
+})
+
+func init() {
+	prometheus.MustRegister(pmPersistParentCacheHits)
+	prometheus.MustRegister(pmPersistParentCacheMisses)
+	prometheus.MustRegister(pmPersistLatestCacheHits)
+	prometheus.MustRegister(pmPersistLatestCacheMisses)
+}
+
+//FNV-1a
+func fnv64(key string) uint64 {
+	h := uint64(14695981039346656037)
+	for i := 0; i < len(key); i++ {
+		h ^= uint64(key[i])
+		h *= 1099511628211
+	}
+	return h
+}
+
+//Remembers which paths of the persisted message trees exist, so that
+//putMessage does not need to read the database to find out where the
+//parents of a message stop. Paths are never removed from the trees, so
+//entries never go stale. A shard that fills up is emptied and warms up
+//again from the database
+type parentCache struct {
+	shards [persistParentCacheShards]parentCacheShard
+}
+
+type parentCacheShard struct {
+	mu      sync.RWMutex
+	entries map[string]struct{}
+}
+
+func newParentCache() *parentCache {
+	rv := &parentCache{}
+	for i := range rv.shards {
+		rv.shards[i].entries = make(map[string]struct{})
+	}
+	return rv
+}
+
+//The keys are the tree followed by the path
+func (c *parentCache) shard(key []byte) *parentCacheShard {
+	return &c.shards[fnv64(string(key))&(persistParentCacheShards-1)]
+}
+
+func (c *parentCache) has(key []byte) bool {
+	s := c.shard(key)
+	s.mu.RLock()
+	_, ok := s.entries[string(key)]
+	s.mu.RUnlock()
+	return ok
+}
+
+func (c *parentCache) add(key []byte) {
+	s := c.shard(key)
+	s.mu.Lock()
+	if len(s.entries) >= PersistParentCacheMaxEntries/persistParentCacheShards {
+		s.entries = make(map[string]struct{})
+	}
+	s.entries[string(key)] = struct{}{}
+	s.mu.Unlock()
+}
+
+//Keeps the latest persisted message of the most recently used topics, so
+//that queries on hot topics do not read the database. putMessage writes
+//through it, and lookups that miss fill it from the database
+type latestCache struct {
+	shards [persistLatestCacheShards]latestCacheShard
+}
+
+type latestCacheShard struct {
+	mu      sync.Mutex
+	entries map[string]*list.Element
+	//The entries by last use, the front is the most recent
+	lru  *list.List
+	size int
+	//Incremented by every put, so that a lookup can tell if the value it
+	//read from the database may have been overwritten since
+	puts uint64
+}
+
+type latestCacheEntry struct {
+	topic string
+	value []byte
+}
+
+func newLatestCache() *latestCache {
+	rv := &latestCache{}
+	for i := range rv.shards {
+		rv.shards[i].entries = make(map[string]*list.Element)
+		rv.shards[i].lru = list.New()
+	}
+	return rv
+}
+
+func (c *latestCache) shard(topic string) *latestCacheShard {
+	return &c.shards[fnv64(topic)&(persistLatestCacheShards-1)]
+}
+
+//Return the cached message on a topic. If there is none, gen must be
+//passed to fill once the message has been read from the database
+func (c *latestCache) get(topic string) (value []byte, ok bool, gen uint64) {
+	s := c.shard(topic)
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	el, ok := s.entries[topic]
+	if !ok {
+		pmPersistLatestCacheMisses.Inc()
+		return nil, false, s.puts
+	}
+	pmPersistLatestCacheHits.Inc()
+	s.lru.MoveToFront(el)
+	return el.Value.(*latestCacheEntry).value, true, 0
+}
+
+//Record the message stored on a topic
+func (c *latestCache) put(topic string, value []byte) {
+	s := c.shard(topic)
+	s.mu.Lock()
+	s.puts++
+	s.set(topic, value)
+	s.mu.Unlock()
+}
+
+//Cache a message read from the database, unless a message may have been
+//stored since the read began
+func (c *latestCache) fill(topic string, value []byte, gen uint64) {
+	s := c.shard(topic)
+	s.mu.Lock()
+	if s.puts == gen {
+		s.set(topic, value)
+	}
+	s.mu.Unlock()
+}
+
+//The mutex must be held
+func (s *latestCacheShard) set(topic string, value []byte) {
+	if el, ok := s.entries[topic]; ok {
+		s.size -= len(el.Value.(*latestCacheEntry).value)
+		s.lru.Remove(el)
+		delete(s.entries, topic)
+	}
+	if len(value) > PersistLatestCacheMaxValueSize {
+		return
+	}
+	s.entries[topic] = s.lru.PushFront(&latestCacheEntry{topic: topic, value: value})
+	s.size += len(value)
+	for len(s.entries) > PersistLatestCacheMaxEntries/persistLatestCacheShards ||
+		s.size > PersistLatestCacheMaxSize/persistLatestCacheShards {
+		e := s.lru.Remove(s.lru.Back()).(*latestCacheEntry)
+		delete(s.entries, e.topic)
+		s.size -= len(e.value)
+	}
+}
@@ -4,7 +4,9 @@ package core
 //improved
 
 import (
+	"encoding/binary"
 	"fmt"
+	"sort"
 	"strings"
 	"sync"
 
@@ -67,6 +69,16 @@ func advancedUnInterlaceURI(rv []string, frontD []string, backD []string) []stri
 const cfMsgI = 1
 const cfMsg = 2
 
+//Messages are only stored in the normal tree. The leaves of the
+//interlaced tree hold this reference instead, the message is found under
+//the uninterlaced URI. Stores written by older versions hold a second copy
+//of the message here, MigratePersistedMessages replaces it
+var interlacedRef = []byte{0, 1}
+
+func isInterlacedRef(value []byte) bool {
+	return len(value) == 2 && value[0] == 0 && value[1] == 1
+}
+
 func (t *Terminus) LoadID() (id string) {
 	key := []byte("routerid")
 	v, err := rocksdb.PersistGet(key)
@@ -132,7 +144,7 @@ type DBIterator interface {
 }
 
 type iteratorAdapter struct {
-	it  *rocksdb.Iterator
+	it  rocksdb.Iterator
 	pfx []byte
 }
 
@@ -156,16 +168,54 @@ func (t *Terminus) createIterator(cf int, pfx []byte) DBIterator {
 	key := make([]byte, len(pfx)+1)
 	key[0] = byte(cf)
 	copy(key[1:], pfx)
-	it := rocksdb.NewIterator(rocksdb.PERSIST, pfx)
+	it := rocksdb.NewIterator(rocksdb.PERSIST, key)
 	return &iteratorAdapter{
 		it:  it,
 		pfx: key,
 	}
 }
 
+//A write batch of persisted messages, with the keys it sets so that a
+//path added by the batch is not looked for in the database
+type persistBatch struct {
+	wb   rocksdb.WriteBatch
+	keys map[string]struct{}
+}
+
+func newPersistBatch() *persistBatch {
+	return &persistBatch{
+		wb:   rocksdb.NewWriteBatch(rocksdb.PERSIST),
+		keys: make(map[string]struct{}),
+	}
+}
+
+func (b *persistBatch) set(cf int, path []byte, object []byte) {
+	key := make([]byte, len(path)+1)
+	key[0] = byte(cf)
+	copy(key[1:], path)
+	b.wb.Set(key, object)
+	b.keys[string(key)] = struct{}{}
+}
+
+func (b *persistBatch) commit() {
+	if err := b.wb.Commit(); err != nil {
+		panic(err)
+	}
+}
+
 //PutMessage inserts a message into the database. Note that the topic must be
 //well formed and complete (no wildcards etc)
 func (t *Terminus) putMessage(topic string, payload []byte) {
+	b := newPersistBatch()
+	t.batchMessage(b, topic, payload)
+	b.commit()
+	t.latest.put(topic, payload)
+}
+
+//Add a message to a batch. The parent cache is updated as though the
+//batch has been committed, the latest value cache must be updated once it
+//has been
+func (t *Terminus) batchMessage(b *persistBatch, topic string, payload []byte) {
 	ts := strings.Split(topic, "/")
 	tb := make([]byte, len(topic)+1)
 	copy(tb[1:], []byte(topic))
@@ -175,38 +225,78 @@ func (t *Terminus) putMessage(topic string, payload []byte) {
 	smrg := make([]byte, len(smrgs)+1)
 	copy(smrg[1:], []byte(smrgs))
 	smrg[0] = byte(len(mrg))
-	t.putObject(cfMsgI, smrg, payload)
-	t.putObject(cfMsg, tb, payload)
-
-	//Put parents
-	for i := len(ts) - 1; i > 0; i-- {
-		pstrs := []byte(strings.Join(ts[0:i], "/"))
-		pstr := make([]byte, len(pstrs)+1)
-		pstr[0] = byte(i)
-		copy(pstr[1:], pstrs)
-		if !t.exists(cfMsg, pstr) {
-			t.putObject(cfMsg, pstr, []byte{0})
-		} else {
-			//We assume that if a path exists, all its parents exist
+	b.set(cfMsgI, smrg, interlacedRef)
+	b.set(cfMsg, tb, payload)
+	//The message may be the parent of later ones
+	t.parents.add(append([]byte{cfMsgI}, smrg...))
+	t.parents.add(append([]byte{cfMsg}, tb...))
+
+	t.putParents(b, cfMsg, ts)
+	t.putParents(b, cfMsgI, mrg)
+}
+
+//Create the dummy parents of a path that do not exist yet, starting from
+//the closest one. We assume that if a path exists, all its parents exist
+func (t *Terminus) putParents(b *persistBatch, cf int, parts []string) {
+	for i := len(parts) - 1; i > 0; i-- {
+		pstrs := strings.Join(parts[0:i], "/")
+		//The tree followed by the path, as the parent cache and the batch
+		//key it
+		ckey := make([]byte, len(pstrs)+2)
+		ckey[0] = byte(cf)
+		ckey[1] = byte(i)
+		copy(ckey[2:], pstrs)
+		pstr := ckey[1:]
+		if t.parents.has(ckey) {
+			pmPersistParentCacheHits.Add(1)
+			break
+		}
+		pmPersistParentCacheMisses.Add(1)
+		if _, ok := b.keys[string(ckey)]; ok || t.exists(cf, pstr) {
+			t.parents.add(ckey)
 			break
 		}
+		b.set(cf, pstr, []byte{0})
+		t.parents.add(ckey)
 	}
+}
 
-	for i := len(mrg) - 1; i > 0; i-- {
-		pstrs := []byte(strings.Join(mrg[0:i], "/"))
-		pstr := make([]byte, len(pstrs)+1)
-		pstr[0] = byte(i)
-		copy(pstr[1:], pstrs)
-		if !t.exists(cfMsgI, pstr) {
-			t.putObject(cfMsgI, pstr, []byte{0})
-		} else {
-			//We assume that if a path exists, all its parents exist
-			break
+//Replace the message copies in the interlaced tree of a store written by
+//an older version with references, returning how many were replaced. The
+//store can be in use while this runs
+func MigratePersistedMessages() (int, error) {
+	it := rocksdb.NewIterator(rocksdb.PERSIST, []byte{cfMsgI})
+	wb := rocksdb.NewWriteBatch(rocksdb.PERSIST)
+	migrated := 0
+	for ; it.HasNext(); it.Next() {
+		//A copy that cannot be read is replaced as well, the message is in
+		//the normal tree
+		value := it.Value()
+		if it.Err() == nil && (isDummy(value) || isInterlacedRef(value)) {
+			continue
+		}
+		wb.Set(it.Key(), interlacedRef)
+		migrated++
+		if wb.Size() >= FlushBatchMaxBytes {
+			if err := wb.Commit(); err != nil {
+				return migrated, err
+			}
+			wb = rocksdb.NewWriteBatch(rocksdb.PERSIST)
 		}
 	}
+	if err := wb.Commit(); err != nil {
+		return migrated, err
+	}
+	return migrated, nil
 }
 
+//Return the message persisted on a topic, from the latest value cache if
+//possible. The value must not be modified
 func (t *Terminus) getExactMessage(topic string) ([]byte, bool) {
+	value, ok, gen := t.latest.get(topic)
+	if ok {
+		return value, true
+	}
 	ts := strings.Split(topic, "/")
 	key := make([]byte, len(topic)+1)
 	copy(key[1:], []byte(topic))
@@ -215,6 +305,7 @@ func (t *Terminus) getExactMessage(topic string) ([]byte, bool) {
 	if err != nil || isDummy(value) {
 		return nil, false
 	}
+	t.latest.fill(topic, value, gen)
 	return value, true
 }
 
@@ -241,6 +332,10 @@ func mkkey(uri []string) []byte {
 }
 func mkchildkey(uri []string) []byte {
 	ms := strings.Join(uri, "/")
+	if len(uri) > 0 {
+		//Without the separator a/bc/d would be a child of a/b
+		ms += "/"
+	}
 	key := make([]byte, len(ms)+1)
 	key[0] = byte(len(uri) + 1) //This is so we find children
 	copy(key[1:], []byte(ms))
@@ -280,12 +375,12 @@ func (t *Terminus) getMatchingMessage(interlaced bool, uri []string, prefix int,
 		if len(backD) != 0 || len(frontD) != 0 {
 			panic("invariant failure")
 		}
-		value, err := t.getObject(cf, mkkey(uri))
-		if err == nil && !isDummy(value) {
-			var newUri []string
-			if interlaced {
-				newUri = unInterlaceURI(uri)
-			}
+		//The interlaced tree only references the message
+		newUri := uri
+		if interlaced {
+			newUri = unInterlaceURI(uri)
+		}
+		if value, ok := t.getExactMessage(strings.Join(newUri, "/")); ok {
 			handle <- MakeSMFromParts(newUri, value)
 		}
 		wg.Done()
@@ -312,8 +407,7 @@ func (t *Terminus) getMatchingMessage(interlaced bool, uri []string, prefix int,
 				idx++
 			}
 		}
-		value, err := t.getObject(cfMsg, mkkey(directUri))
-		if err == nil && !isDummy(value) {
+		if value, ok := t.getExactMessage(strings.Join(directUri, "/")); ok {
 			handle <- MakeSMFromParts(directUri, value)
 		}
 	}
@@ -373,6 +467,33 @@ func (t *Terminus) getMatchingMessage(interlaced bool, uri []string, prefix int,
 		return
 	}
 }
+//Page through the results of a query in URI order, for engines that
+//cannot evaluate queries themselves. All the results are found for each
+//page, so this is only suitable for small stores
+func (t *Terminus) getSortedPage(uri string, limit int, resume bool, after string, handle chan SM, next *[]byte, qerr *error) {
+	all := make(chan SM, 10)
+	go t.GetMatchingPage(uri, 0, nil, all, nil, qerr)
+	results := []SM{}
+	for sm := range all {
+		if !resume || sm.URI > after {
+			results = append(results, sm)
+		}
+	}
+	sort.Slice(results, func(i, j int) bool {
+		return results[i].URI < results[j].URI
+	})
+	if limit != 0 && len(results) > limit {
+		results = results[:limit]
+		if next != nil {
+			*next = encodeQueryCursor(uri, queryCursorSorted, []byte(results[limit-1].URI))
+		}
+	}
+	for _, sm := range results {
+		handle <- sm
+	}
+	close(handle)
+}
+
 func (t *Terminus) ListChildren(uri string, handle chan string) {
 	parts := strings.Split(uri, "/")
 	ckey := mkchildkey(parts)
@@ -386,7 +507,51 @@ func (t *Terminus) ListChildren(uri string, handle chan string) {
 	close(handle)
 }
 
+//A query cursor is the version, the kind of query it continues, the hash
+//of the namespace prefixed URI pattern and the position. An engine cursor
+//is opaque, a sorted cursor is the URI of the last message returned
+const queryCursorVersion = 1
+
+const (
+	queryCursorEngine = 'e'
+	queryCursorSorted = 's'
+)
+
+func encodeQueryCursor(uri string, kind byte, pos []byte) []byte {
+	rv := make([]byte, 10, 10+len(pos))
+	rv[0] = queryCursorVersion
+	rv[1] = kind
+	binary.BigEndian.PutUint64(rv[2:10], fnv64(uri))
+	return append(rv, pos...)
+}
+
+//Return the kind and position of a cursor, ok is false if it was not
+//returned for the URI pattern
+func decodeQueryCursor(uri string, cursor []byte) (kind byte, pos []byte, ok bool) {
+	if len(cursor) < 10 || cursor[0] != queryCursorVersion ||
+		binary.BigEndian.Uint64(cursor[2:10]) != fnv64(uri) {
+		return 0, nil, false
+	}
+	kind = cursor[1]
+	if kind != queryCursorEngine && kind != queryCursorSorted {
+		return 0, nil, false
+	}
+	return kind, cursor[10:], true
+}
+
 func (t *Terminus) GetMatchingMessage(uri string, handle chan SM) {
+	t.GetMatchingPage(uri, 0, nil, handle, nil, nil)
+}
+
+//Like GetMatchingMessage, but if limit is nonzero at most that many
+//messages are returned, and if there are more *next is set to the
+//cursor of the next page before handle is closed. If cursor is not nil,
+//the messages start after the page it was returned with. It must have been
+//checked with decodeQueryCursor. If the storage engine fails to read the
+//messages, the results are incomplete and *qerr is set to the error before
+//handle is closed
+func (t *Terminus) GetMatchingPage(uri string, limit int, cursor []byte, handle chan SM, next *[]byte, qerr *error) {
+	kind, pos, _ := decodeQueryCursor(uri, cursor)
 	parts := strings.Split(uri, "/")
 	staridx := -1
 	pluscount := 0
@@ -399,13 +564,41 @@ func (t *Terminus) GetMatchingMessage(uri string, handle chan SM) {
 		}
 	}
 	if pluscount == 0 && staridx == -1 {
+		//There is only one page
 		m, ok := t.getExactMessage(uri)
-		if ok {
+		if ok && cursor == nil {
 			handle <- MakeSMFromParts(parts, m)
 		}
 		close(handle)
 		return
 	}
+	//Let the storage engine evaluate the query if it can, it avoids a
+	//goroutine and an iterator per level, and it stops once the limit is
+	//reached
+	if kind != queryCursorSorted {
+		enext, err := rocksdb.PersistQuery(uri, limit, pos, func(ruri string, value []byte) bool {
+			handle <- SM{URI: ruri, Body: value}
+			return true
+		})
+		if err != rocksdb.ErrQueryUnsupported {
+			if err != nil {
+				if qerr != nil {
+					*qerr = err
+				} else {
+					fmt.Printf("persisted message query failed: %v\n", err)
+				}
+			}
+			if enext != nil && next != nil {
+				*next = encodeQueryCursor(uri, queryCursorEngine, enext)
+			}
+			close(handle)
+			return
+		}
+	}
+	if limit != 0 || cursor != nil {
+		t.getSortedPage(uri, limit, cursor != nil, string(pos), handle, next, qerr)
+		return
+	}
 
 	if staridx == -1 {
 		wg := &sync.WaitGroup{}
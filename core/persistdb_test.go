@@ -0,0 +1,111 @@
+package core
+
+import (
+	"sort"
+	"testing"
+
+	"github.com/stretchr/testify/require"
+)
+
+func matching(t *Terminus, uri string) []string {
+	handle := make(chan SM, 10)
+	go t.GetMatchingMessage(uri, handle)
+	rv := []string{}
+	for sm := range handle {
+		rv = append(rv, sm.URI+"="+string(sm.Body))
+	}
+	sort.Strings(rv)
+	return rv
+}
+
+func TestPersistWildcardQuery(t *testing.T) {
+	term := getTerminus(t)
+	for _, uri := range []string{"q/a/b", "q/a/bc/d", "q/a/b/d", "q/x/y/z/d", "q/x"} {
+		term.putMessage(uri, []byte(uri[2:]))
+	}
+	require.Equal(t, []string{"q/a/b=a/b"}, matching(term, "q/a/b"))
+	require.Equal(t, []string{"q/a/b/d=a/b/d", "q/a/bc/d=a/bc/d"}, matching(term, "q/a/+/d"))
+	require.Equal(t, []string{"q/a/b/d=a/b/d"}, matching(term, "q/a/b/+"))
+	require.Equal(t, []string{"q/a/b/d=a/b/d", "q/a/b=a/b", "q/a/bc/d=a/bc/d", "q/x/y/z/d=x/y/z/d", "q/x=x"}, matching(term, "q/*"))
+	require.Equal(t, []string{"q/a/b/d=a/b/d", "q/a/bc/d=a/bc/d", "q/x/y/z/d=x/y/z/d"}, matching(term, "q/*/d"))
+	require.Equal(t, []string{"q/a/b/d=a/b/d", "q/a/b=a/b"}, matching(term, "q/a/b/*"))
+	//A cached ancestor must not stop the missing parents being created
+	term.putMessage("q/a/b/e/f", []byte("a/b/e/f"))
+	require.Equal(t, []string{"q/a/b/e/f=a/b/e/f"}, matching(term, "q/a/b/e/+"))
+	require.Equal(t, []string{"q/a/b/e/f=a/b/e/f"}, matching(term, "q/*/f"))
+}
+
+func TestMigratePersistedMessages(t *testing.T) {
+	term := getTerminus(t)
+	term.putMessage("m/a/b/c", []byte("abc"))
+	//Write the interlaced copy the way older versions did
+	term.putObject(cfMsgI, mkkey(interlaceURI([]string{"m", "a", "b", "c"})), []byte("abc"))
+	migrated, err := MigratePersistedMessages()
+	require.NoError(t, err)
+	require.Equal(t, 1, migrated)
+	value, err := term.getObject(cfMsgI, mkkey(interlaceURI([]string{"m", "a", "b", "c"})))
+	require.NoError(t, err)
+	require.Equal(t, interlacedRef, value)
+	require.Equal(t, []string{"m/a/b/c=abc"}, matching(term, "m/*/c"))
+	migrated, err = MigratePersistedMessages()
+	require.NoError(t, err)
+	require.Equal(t, 0, migrated)
+}
+
+func TestPersistLatestCache(t *testing.T) {
+	term := getTerminus(t)
+	term.putMessage("l/a/b", []byte("1"))
+	term.putMessage("l/a/b", []byte("2"))
+	value, ok := term.getExactMessage("l/a/b")
+	require.True(t, ok)
+	require.Equal(t, []byte("2"), value)
+	require.Equal(t, []string{"l/a/b=2"}, matching(term, "l/+/b"))
+
+	//A lookup that missed fills the cache from the database
+	_, ok, _ = term.latest.get("l/c")
+	require.False(t, ok)
+	term.putObject(cfMsg, mkkey([]string{"l", "c"}), []byte("3"))
+	value, ok = term.getExactMessage("l/c")
+	require.True(t, ok)
+	require.Equal(t, []byte("3"), value)
+	value, ok, _ = term.latest.get("l/c")
+	require.True(t, ok)
+	require.Equal(t, []byte("3"), value)
+
+	//But not with a value a put may have replaced
+	_, _, gen := term.latest.get("l/d")
+	term.putMessage("l/d", []byte("new"))
+	term.latest.fill("l/d", []byte("old"), gen)
+	value, _ = term.getExactMessage("l/d")
+	require.Equal(t, []byte("new"), value)
+	_, ok = term.getExactMessage("l/e")
+	require.False(t, ok)
+}
+
+func TestPersistQueryPages(t *testing.T) {
+	term := getTerminus(t)
+	for _, uri := range []string{"g/a", "g/b/c", "g/d", "g/e"} {
+		term.putMessage(uri, []byte(uri[2:]))
+	}
+	var cursor []byte
+	pages := [][]string{}
+	for {
+		handle := make(chan SM, 10)
+		var next []byte
+		go term.GetMatchingPage("g/*", 3, cursor, handle, &next, nil)
+		page := []string{}
+		for sm := range handle {
+			page = append(page, sm.URI)
+		}
+		pages = append(pages, page)
+		if next == nil {
+			break
+		}
+		_, _, ok := decodeQueryCursor("g/*", next)
+		require.True(t, ok)
+		cursor = next
+	}
+	require.Equal(t, [][]string{{"g/a", "g/b/c", "g/d"}, {"g/e"}}, pages)
+	_, _, ok := decodeQueryCursor("g/+", cursor)
+	require.False(t, ok)
+}
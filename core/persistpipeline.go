@@ -0,0 +1,189 @@
+package core
+
+import (
+	"sync"
+
+	pb "github.com/immesys/wavemq/mqpb"
+	"github.com/prometheus/client_golang/prometheus"
+)
+
+//Persisted messages are written by a single goroutine rather than by
+//Publish, so that publish latency does not include the database reads and
+//writes. The messages waiting to be written are coalesced into write
+//batches, and a message overwritten by a later one on the same topic in
+//the same batch is not written at all. When the pipeline is full, Publish
+//waits for it. With RoutingConfig.SyncPersist, Publish also waits for its
+//message to be written. The servers keep publishing while the router shuts
+//down, messages that arrive after the pipeline has stopped are dropped
+
+//The maximum number of persisted messages waiting to be written
+const PersistPipelineLength = 4096
+
+//The maximum number of messages taken from the pipeline for one batch
+const PersistBatchMaxMessages = 512
+
+//Some instrumentation
+var pmPersistBatches = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "route",
+	Name:      "persist_batches",
+	Help:      "Number of write batches of persisted messages committed",
+})
+var pmPersistCoalesced = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "route",
+	Name:      "persist_coalesced",
+	Help:      "Number of persisted messages not written because a later one on the topic was in the same batch",
+})
+var pmPersistPipelineFull = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "route",
+	Name:      "persist_pipeline_full",
+	Help:      "Number of publishes that waited because the persist pipeline was full",
+})
+var pmPersistDropped = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "route",
+	Name:      "persist_dropped",
+	Help:      "Number of persisted messages dropped because the router was shutting down",
+})
+
+func init() {
+	prometheus.MustRegister(pmPersistBatches)
+	prometheus.MustRegister(pmPersistCoalesced)
+	prometheus.MustRegister(pmPersistPipelineFull)
+	prometheus.MustRegister(pmPersistDropped)
+}
+
+type persistReq struct {
+	topic string
+	m     *pb.Message
+	//Closed once the message has been written, if not nil
+	done chan struct{}
+}
+
+type persistPipeline struct {
+	t *Terminus
+	//Held for reading while queueing, so that reqs is not closed under a
+	//sender
+	mu      sync.RWMutex
+	closed  bool
+	reqs    chan *persistReq
+	stopped chan struct{}
+}
+
+func newPersistPipeline(t *Terminus) *persistPipeline {
+	p := &persistPipeline{
+		t:       t,
+		reqs:    make(chan *persistReq, PersistPipelineLength),
+		stopped: make(chan struct{}),
+	}
+	go p.run()
+	return p
+}
+
+//Queue a message to be written. If done is not nil, it is closed once the
+//message has been written, or dropped because the pipeline has stopped
+func (p *persistPipeline) enqueue(topic string, m *pb.Message, done chan struct{}) {
+	p.mu.RLock()
+	defer p.mu.RUnlock()
+	if p.closed {
+		pmPersistDropped.Inc()
+		if done != nil {
+			close(done)
+		}
+		return
+	}
+	req := &persistReq{
+		topic: topic,
+		m:     m,
+		done:  done,
+	}
+	select {
+	case p.reqs <- req:
+	default:
+		pmPersistPipelineFull.Inc()
+		p.reqs <- req
+	}
+}
+
+func (p *persistPipeline) run() {
+	defer close(p.stopped)
+	batch := make([]*persistReq, 0, PersistBatchMaxMessages)
+	for req := range p.reqs {
+		batch = append(batch[:0], req)
+	drain:
+		for len(batch) < PersistBatchMaxMessages {
+			select {
+			case req, ok := <-p.reqs:
+				if !ok {
+					break drain
+				}
+				batch = append(batch, req)
+			default:
+				break drain
+			}
+		}
+		p.write(batch)
+	}
+}
+
+type persistedValue struct {
+	topic   string
+	payload []byte
+}
+
+//Write a batch of messages, in write batches of up to FlushBatchMaxBytes
+func (p *persistPipeline) write(batch []*persistReq) {
+	t := p.t
+	last := make(map[string]*persistReq, len(batch))
+	for _, req := range batch {
+		last[req.topic] = req
+	}
+	b := newPersistBatch()
+	written := make([]persistedValue, 0, len(last))
+	commit := func() {
+		b.commit()
+		pmPersistBatches.Inc()
+		for _, v := range written {
+			t.latest.put(v.topic, v.payload)
+		}
+		written = written[:0]
+	}
+	for _, req := range batch {
+		if last[req.topic] != req {
+			pmPersistCoalesced.Inc()
+			continue
+		}
+		//The proof is stored separately, before the message
+		serial := proofs.marshal(req.m)
+		t.batchMessage(b, req.topic, serial)
+		written = append(written, persistedValue{topic: req.topic, payload: serial})
+		if b.wb.Size() >= FlushBatchMaxBytes {
+			commit()
+			b = newPersistBatch()
+		}
+	}
+	if len(written) > 0 {
+		commit()
+	}
+	for _, req := range batch {
+		if req.done != nil {
+			close(req.done)
+		}
+	}
+}
+
+//Write the messages in the pipeline and stop. Messages queued after this
+//are dropped
+func (p *persistPipeline) stop() {
+	p.mu.Lock()
+	if !p.closed {
+		p.closed = true
+		close(p.reqs)
+	}
+	p.mu.Unlock()
+	<-p.stopped
+}
+
+//Write the persisted messages that have been published. Persisted messages
+//published after this are not stored
+func (t *Terminus) Shutdown() {
+	t.persister.stop()
+}
@@ -0,0 +1,44 @@
+package core
+
+import (
+	"testing"
+
+	"github.com/golang/protobuf/proto"
+	pb "github.com/immesys/wavemq/mqpb"
+	"github.com/stretchr/testify/require"
+)
+
+func persistedSignature(t *testing.T, term *Terminus, topic string) []byte {
+	value, ok := term.getExactMessage(topic)
+	require.True(t, ok)
+	m := pb.Message{}
+	require.NoError(t, proto.Unmarshal(value, &m))
+	return m.Signature
+}
+
+func TestPersistPipeline(t *testing.T) {
+	term := getTerminus(t)
+	p := newPersistPipeline(term)
+	for i := 0; i < 10; i++ {
+		p.enqueue("pp/a/b", &pb.Message{Signature: []byte{byte(i)}}, nil)
+	}
+	done := make(chan struct{})
+	p.enqueue("pp/a/c", &pb.Message{Signature: []byte("c")}, done)
+	<-done
+	//Everything queued before the message has been written too
+	require.Equal(t, []byte("c"), persistedSignature(t, term, "pp/a/c"))
+	require.Equal(t, []byte{9}, persistedSignature(t, term, "pp/a/b"))
+	require.Equal(t, 2, len(matching(term, "pp/*")))
+
+	//Stopping writes the messages still in the pipeline
+	p.enqueue("pp/d", &pb.Message{Signature: []byte("d")}, nil)
+	p.stop()
+	require.Equal(t, []byte("d"), persistedSignature(t, term, "pp/d"))
+
+	//Publishes that race with the shutdown are dropped
+	done = make(chan struct{})
+	p.enqueue("pp/e", &pb.Message{Signature: []byte("e")}, done)
+	<-done
+	_, ok := term.getExactMessage("pp/e")
+	require.False(t, ok)
+}
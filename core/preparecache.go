@@ -0,0 +1,141 @@
+package core
+
+import (
+	"encoding/binary"
+	"sync"
+	"time"
+
+	"github.com/creachadair/cityhash"
+	"github.com/immesys/wave/wve"
+	pb "github.com/immesys/wavemq/mqpb"
+	"github.com/prometheus/client_golang/prometheus"
+	"golang.org/x/crypto/sha3"
+)
+
+//How long a decrypted message is kept for other subscribers that share
+//the same perspective. This only needs to span the fan out of a single
+//message to the local subscribers
+const PreparedMessageCacheTime = 30 * time.Second
+
+//The maximum number of decrypted messages kept. If the cache is full
+//messages are decrypted without being cached
+const PreparedMessageCacheMaxEntries = 10000
+
+//Some instrumentation
+var pmPrepareCacheHits = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "preparecache",
+	Name:      "hits",
+	Help:      "Number of message decryptions served from the cache or coalesced with one in flight",
+})
+var pmPrepareCacheMisses = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "preparecache",
+	Name:      "misses",
+	Help:      "Number of message decryptions that were performed",
+})
+
+func init() {
+	prometheus.MustRegister(pmPrepareCacheHits)
+	prometheus.MustRegister(pmPrepareCacheMisses)
+}
+
+//The message is identified by its signature, which binds the content
+//because every queued message has been verified. The perspective is
+//identified by a SHA3 hash of its secret and passphrase, so a subscriber
+//with the wrong passphrase cannot read another subscriber's decryption
+type pcacheKey struct {
+	SigLow  uint64
+	SigHigh uint64
+	Persp   [32]byte
+}
+
+type pcacheEntry struct {
+	//Closed once msg and err are populated
+	done chan struct{}
+	msg  *pb.Message
+	err  wve.WVE
+	//Zero while the decryption is in flight
+	expires time.Time
+}
+
+//A short lived cache of prepared messages. Concurrent requests for the
+//same key wait for a single decryption rather than each doing their own
+type prepareCache struct {
+	mu      sync.Mutex
+	entries map[pcacheKey]*pcacheEntry
+}
+
+func newPrepareCache() *prepareCache {
+	return &prepareCache{
+		entries: make(map[pcacheKey]*pcacheEntry),
+	}
+}
+
+func mkPcacheKey(persp *pb.Perspective, m *pb.Message) pcacheKey {
+	k := pcacheKey{}
+	k.SigLow, k.SigHigh = cityhash.Hash128(m.Signature)
+	h := sha3.New256()
+	derlen := [4]byte{}
+	binary.BigEndian.PutUint32(derlen[:], uint32(len(persp.EntitySecret.DER)))
+	h.Write(derlen[:])
+	h.Write(persp.EntitySecret.DER)
+	h.Write(persp.EntitySecret.Passphrase)
+	h.Sum(k.Persp[:0])
+	return k
+}
+
+//Return the cached result for the key, waiting for it if it is in flight.
+//Otherwise call prepare and cache what it returns. The returned message
+//is shared and must not be modified
+func (c *prepareCache) do(k pcacheKey, prepare func() (*pb.Message, wve.WVE)) (*pb.Message, wve.WVE) {
+	c.mu.Lock()
+	e, ok := c.entries[k]
+	if ok && (e.expires.IsZero() || e.expires.After(time.Now())) {
+		c.mu.Unlock()
+		pmPrepareCacheHits.Add(1)
+		<-e.done
+		return e.msg, e.err
+	}
+	pmPrepareCacheMisses.Add(1)
+	if !ok && len(c.entries) >= PreparedMessageCacheMaxEntries {
+		c.sweepLocked()
+		if len(c.entries) >= PreparedMessageCacheMaxEntries {
+			c.mu.Unlock()
+			return prepare()
+		}
+	}
+	e = &pcacheEntry{
+		done: make(chan struct{}),
+	}
+	c.entries[k] = e
+	c.mu.Unlock()
+
+	e.msg, e.err = prepare()
+
+	c.mu.Lock()
+	if e.err != nil {
+		//Don't remember failures, the perspective may be resynced
+		delete(c.entries, k)
+	} else {
+		e.expires = time.Now().Add(PreparedMessageCacheTime)
+	}
+	c.mu.Unlock()
+	close(e.done)
+	return e.msg, e.err
+}
+
+//Remove expired entries
+func (c *prepareCache) Sweep() {
+	c.mu.Lock()
+	c.sweepLocked()
+	c.mu.Unlock()
+}
+
+//Remove expired entries, the mutex must be held
+func (c *prepareCache) sweepLocked() {
+	nw := time.Now()
+	for k, e := range c.entries {
+		if !e.expires.IsZero() && !e.expires.After(nw) {
+			delete(c.entries, k)
+		}
+	}
+}
@@ -0,0 +1,53 @@
+package core
+
+import (
+	"sync"
+	"sync/atomic"
+	"testing"
+
+	"github.com/immesys/wave/wve"
+	pb "github.com/immesys/wavemq/mqpb"
+	"github.com/stretchr/testify/require"
+)
+
+func TestPrepareCacheCoalesces(t *testing.T) {
+	c := newPrepareCache()
+	persp := &pb.Perspective{
+		EntitySecret: &pb.EntitySecret{
+			DER: []byte("secret"),
+		},
+	}
+	m := &pb.Message{
+		Signature: []byte("signature"),
+	}
+	var calls int64
+	release := make(chan struct{})
+	prepare := func() (*pb.Message, wve.WVE) {
+		atomic.AddInt64(&calls, 1)
+		<-release
+		return m, nil
+	}
+	wg := sync.WaitGroup{}
+	for i := 0; i < 10; i++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			rv, err := c.do(mkPcacheKey(persp, m), prepare)
+			require.NoError(t, err)
+			require.Equal(t, m, rv)
+		}()
+	}
+	close(release)
+	wg.Wait()
+	require.Equal(t, int64(1), calls)
+
+	//A different passphrase must not share the decryption
+	other := &pb.Perspective{
+		EntitySecret: &pb.EntitySecret{
+			DER:        []byte("secret"),
+			Passphrase: []byte("wrong"),
+		},
+	}
+	c.do(mkPcacheKey(other, m), prepare)
+	require.Equal(t, int64(2), calls)
+}
@@ -0,0 +1,223 @@
+package core
+
+import (
+	"container/list"
+	"encoding/binary"
+	"sync"
+	"time"
+
+	"github.com/prometheus/client_golang/prometheus"
+)
+
+//The number of independently locked shards in a proof cache. Must be a
+//power of two
+const proofCacheShards = 64
+
+//Some instrumentation
+var pmProofCacheHits = prometheus.NewCounterVec(prometheus.CounterOpts{
+	Subsystem: "proofcache",
+	Name:      "hits",
+	Help:      "Number of proof cache lookups that found a live entry",
+}, []string{"cache"})
+var pmProofCacheMisses = prometheus.NewCounterVec(prometheus.CounterOpts{
+	Subsystem: "proofcache",
+	Name:      "misses",
+	Help:      "Number of proof cache lookups that found no live entry",
+}, []string{"cache"})
+var pmProofCacheEvictions = prometheus.NewCounterVec(prometheus.CounterOpts{
+	Subsystem: "proofcache",
+	Name:      "evictions",
+	Help:      "Number of proof cache entries evicted to stay within the byte budget",
+}, []string{"cache"})
+var pmProofCacheExpirations = prometheus.NewCounterVec(prometheus.CounterOpts{
+	Subsystem: "proofcache",
+	Name:      "expirations",
+	Help:      "Number of proof cache entries removed because they expired",
+}, []string{"cache"})
+var pmProofCacheBytes = prometheus.NewGaugeVec(prometheus.GaugeOpts{
+	Subsystem: "proofcache",
+	Name:      "bytes",
+	Help:      "Approximate number of bytes held in the proof cache",
+}, []string{"cache"})
+
+func init() {
+	prometheus.MustRegister(pmProofCacheHits)
+	prometheus.MustRegister(pmProofCacheMisses)
+	prometheus.MustRegister(pmProofCacheEvictions)
+	prometheus.MustRegister(pmProofCacheExpirations)
+	prometheus.MustRegister(pmProofCacheBytes)
+}
+
+//A key in a proof cache. Keys must be comparable values (not pointers)
+type proofCacheKey interface {
+	//Used to pick the shard, does not need to be unique
+	shardHash() uint64
+	//Approximate number of bytes the key occupies
+	size() int
+}
+
+//A value in a proof cache
+type proofCacheItem interface {
+	//After this time the entry is no longer returned and may be swept
+	expiry() time.Time
+	//Approximate number of bytes the value occupies
+	size() int
+}
+
+//A concurrent, sharded LRU cache with a byte budget, used for the results
+//of proof validation and proof building
+type proofCache struct {
+	name          string
+	maxShardBytes int64
+	shards        [proofCacheShards]proofCacheShard
+}
+
+type proofCacheShard struct {
+	mu sync.Mutex
+	//The most recently used entries are at the front
+	lru     *list.List
+	entries map[proofCacheKey]*list.Element
+	bytes   int64
+}
+
+type proofCacheEntry struct {
+	key   proofCacheKey
+	value proofCacheItem
+	size  int64
+}
+
+//The fixed per-entry overhead we assume on top of the key and value sizes
+const proofCacheEntryOverhead = 128
+
+func newProofCache(name string, maxBytes int64) *proofCache {
+	rv := &proofCache{
+		name:          name,
+		maxShardBytes: maxBytes / proofCacheShards,
+	}
+	for i := range rv.shards {
+		rv.shards[i].lru = list.New()
+		rv.shards[i].entries = make(map[proofCacheKey]*list.Element)
+	}
+	return rv
+}
+
+func (c *proofCache) shard(k proofCacheKey) *proofCacheShard {
+	return &c.shards[k.shardHash()&(proofCacheShards-1)]
+}
+
+//Get returns the cached item, or nil if there is no unexpired entry
+func (c *proofCache) Get(k proofCacheKey) proofCacheItem {
+	s := c.shard(k)
+	s.mu.Lock()
+	el, ok := s.entries[k]
+	if !ok {
+		s.mu.Unlock()
+		pmProofCacheMisses.WithLabelValues(c.name).Inc()
+		return nil
+	}
+	e := el.Value.(*proofCacheEntry)
+	if !e.value.expiry().After(time.Now()) {
+		s.remove(el)
+		s.mu.Unlock()
+		pmProofCacheBytes.WithLabelValues(c.name).Sub(float64(e.size))
+		pmProofCacheExpirations.WithLabelValues(c.name).Inc()
+		pmProofCacheMisses.WithLabelValues(c.name).Inc()
+		return nil
+	}
+	s.lru.MoveToFront(el)
+	s.mu.Unlock()
+	pmProofCacheHits.WithLabelValues(c.name).Inc()
+	return e.value
+}
+
+//Put inserts or replaces an entry, evicting the least recently used
+//entries in the shard if it is over budget
+func (c *proofCache) Put(k proofCacheKey, v proofCacheItem) {
+	e := &proofCacheEntry{
+		key:   k,
+		value: v,
+		size:  int64(k.size() + v.size() + proofCacheEntryOverhead),
+	}
+	s := c.shard(k)
+	delta := e.size
+	evicted := 0
+	s.mu.Lock()
+	if el, ok := s.entries[k]; ok {
+		delta -= el.Value.(*proofCacheEntry).size
+		s.remove(el)
+	}
+	s.entries[k] = s.lru.PushFront(e)
+	s.bytes += e.size
+	//Never evict the entry we just added, even if it alone is over budget
+	for s.bytes > c.maxShardBytes && s.lru.Len() > 1 {
+		victim := s.lru.Back()
+		delta -= victim.Value.(*proofCacheEntry).size
+		s.remove(victim)
+		evicted++
+	}
+	s.mu.Unlock()
+	pmProofCacheBytes.WithLabelValues(c.name).Add(float64(delta))
+	if evicted > 0 {
+		pmProofCacheEvictions.WithLabelValues(c.name).Add(float64(evicted))
+	}
+}
+
+//Remove all expired entries
+func (c *proofCache) Sweep() {
+	for i := range c.shards {
+		s := &c.shards[i]
+		var freed int64
+		expired := 0
+		s.mu.Lock()
+		nw := time.Now()
+		for el := s.lru.Front(); el != nil; {
+			next := el.Next()
+			e := el.Value.(*proofCacheEntry)
+			if !e.value.expiry().After(nw) {
+				freed += e.size
+				expired++
+				s.remove(el)
+			}
+			el = next
+		}
+		s.mu.Unlock()
+		if expired > 0 {
+			pmProofCacheBytes.WithLabelValues(c.name).Sub(float64(freed))
+			pmProofCacheExpirations.WithLabelValues(c.name).Add(float64(expired))
+		}
+	}
+}
+
+//Remove an element, the shard lock must be held
+func (s *proofCacheShard) remove(el *list.Element) {
+	e := el.Value.(*proofCacheEntry)
+	s.lru.Remove(el)
+	delete(s.entries, e.key)
+	s.bytes -= e.size
+}
+
+func (k icacheKey) shardHash() uint64 {
+	return k.ProofLow ^ binary.LittleEndian.Uint64(k.Entity[:8]) ^ binary.LittleEndian.Uint64(k.Namespace[:8])
+}
+func (k icacheKey) size() int {
+	return 64 + 16 + len(k.URI) + len(k.Permission)
+}
+func (i *icacheItem) expiry() time.Time {
+	return i.CacheExpiry
+}
+func (i *icacheItem) size() int {
+	return len(i.DER)
+}
+
+func (k bcacheKey) shardHash() uint64 {
+	return binary.LittleEndian.Uint64(k.PolicyHash[:8]) ^ binary.LittleEndian.Uint64(k.Target[:8])
+}
+func (k bcacheKey) size() int {
+	return 96
+}
+func (i *bcacheItem) expiry() time.Time {
+	return i.CacheExpiry
+}
+func (i *bcacheItem) size() int {
+	return len(i.DER)
+}
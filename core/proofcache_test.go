@@ -0,0 +1,116 @@
+package core
+
+import (
+	"testing"
+	"time"
+
+	"github.com/stretchr/testify/require"
+)
+
+func mkick(uri string) icacheKey {
+	k := icacheKey{
+		URI:        uri,
+		Permission: WAVEMQPublish,
+	}
+	k.ProofLow = uint64(len(uri))
+	return k
+}
+
+func TestProofCacheGetPut(t *testing.T) {
+	c := newProofCache("test", 1024*1024)
+	k := mkick("a/b/c")
+	require.Nil(t, c.Get(k))
+	c.Put(k, &icacheItem{
+		CacheExpiry: time.Now().Add(time.Hour),
+		Valid:       true,
+		DER:         []byte("proof"),
+	})
+	e, ok := c.Get(k).(*icacheItem)
+	require.True(t, ok)
+	require.True(t, e.Valid)
+	require.Equal(t, []byte("proof"), e.DER)
+	require.Nil(t, c.Get(mkick("a/b/d")))
+}
+
+func TestProofCacheExpiry(t *testing.T) {
+	c := newProofCache("test", 1024*1024)
+	k := mkick("a/b/c")
+	c.Put(k, &icacheItem{
+		CacheExpiry: time.Now().Add(-time.Second),
+		Valid:       true,
+	})
+	require.Nil(t, c.Get(k))
+
+	k2 := mkick("a/b/d")
+	c.Put(k2, &icacheItem{
+		CacheExpiry: time.Now().Add(-time.Second),
+		Valid:       true,
+	})
+	c.Sweep()
+	s := c.shard(k2)
+	require.Equal(t, 0, s.lru.Len())
+	require.Equal(t, int64(0), s.bytes)
+}
+
+func TestProofCacheEviction(t *testing.T) {
+	c := newProofCache("test", proofCacheShards*4096)
+	//All of these keys land in the same shard
+	keys := []icacheKey{}
+	for i := 0; i < 10; i++ {
+		k := mkick("x")
+		k.ProofHigh = uint64(i)
+		keys = append(keys, k)
+		c.Put(k, &icacheItem{
+			CacheExpiry: time.Now().Add(time.Hour),
+			Valid:       true,
+			DER:         make([]byte, 1000),
+		})
+	}
+	s := c.shard(keys[0])
+	require.True(t, s.bytes <= c.maxShardBytes)
+	//The oldest entries are evicted first
+	require.Nil(t, c.Get(keys[0]))
+	require.NotNil(t, c.Get(keys[9]))
+}
+
+func BenchmarkProofCacheGetParallel(b *testing.B) {
+	c := newProofCache("bench", 64*1024*1024)
+	keys := make([]icacheKey, 1024)
+	for i := range keys {
+		keys[i] = mkick("a/b/c")
+		keys[i].ProofLow = uint64(i) * 0x9e3779b97f4a7c15
+		c.Put(keys[i], &icacheItem{
+			CacheExpiry: time.Now().Add(time.Hour),
+			Valid:       true,
+		})
+	}
+	b.ResetTimer()
+	b.RunParallel(func(pb *testing.PB) {
+		i := 0
+		for pb.Next() {
+			c.Get(keys[i&1023])
+			i++
+		}
+	})
+}
+
+func TestValidatedProofSerialization(t *testing.T) {
+	k := mkick("a/b/c")
+	k.Namespace[0] = 1
+	k.Entity[31] = 2
+	k.ProofHigh = 3
+	k.ProofLow = 4
+	k2, err := loadIcacheKey(k.Serialize())
+	require.NoError(t, err)
+	require.Equal(t, k, k2)
+
+	item := &icacheItem{
+		CacheExpiry: time.Unix(0, time.Now().UnixNano()),
+		ProofExpiry: time.Unix(0, time.Now().Add(time.Hour).UnixNano()),
+		Valid:       true,
+		DER:         []byte("proof"),
+	}
+	item2, err := loadIcacheItem(item.Serialize())
+	require.NoError(t, err)
+	require.Equal(t, item, item2)
+}
@@ -0,0 +1,340 @@
+package core
+
+import (
+	"encoding/binary"
+	"fmt"
+	"sync"
+	"time"
+
+	"github.com/creachadair/cityhash"
+	"github.com/golang/protobuf/proto"
+	pb "github.com/immesys/wavemq/mqpb"
+	rocksdb "github.com/immesys/wavemq/rockstorage"
+	"github.com/prometheus/client_golang/prometheus"
+)
+
+//Every message carries the DER of its proof, which is often several KB,
+//but a handful of proofs cover most messages. Queued and persisted
+//messages are stored with the proof replaced by its hash, the same
+//elision used between peers, and the proof is stored once in the proof
+//column family. In memory, messages with the same proof share one copy of
+//the DER. Proofs that no stored message references are removed by a
+//periodic sweep
+
+//Proofs smaller than this are stored with the message
+const ProofDedupMinSize = 64
+
+//The maximum number of proofs kept in memory. Proofs that are dropped are
+//loaded from the database again when needed
+const ProofDedupMaxEntries = 10000
+
+//How often stored proofs that are no longer referenced are removed
+const ProofGCInterval = 6 * time.Hour
+
+//A stored proof is only removed if no message referencing it has been
+//stored for this long. This must be longer than it takes for a message to
+//be written after its proof
+const ProofGCGrace = time.Hour
+
+//The DB key prefix for a deduplicated proof
+const dedupProofPrefix = "d/"
+
+//The field number of ProofHash in pb.Message
+const messageProofHashField = 9
+
+//Some instrumentation
+var pmProofDedupSavedBytes = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "proofdedup",
+	Name:      "saved_bytes",
+	Help:      "Number of proof bytes not written because the proof was stored by reference",
+})
+var pmProofDedupStored = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "proofdedup",
+	Name:      "stored_proofs",
+	Help:      "Number of proofs written to the database",
+})
+var pmProofDedupCollected = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "proofdedup",
+	Name:      "collected_proofs",
+	Help:      "Number of unreferenced proofs removed from the database",
+})
+
+func init() {
+	prometheus.MustRegister(pmProofDedupSavedBytes)
+	prometheus.MustRegister(pmProofDedupStored)
+	prometheus.MustRegister(pmProofDedupCollected)
+}
+
+type dedupProof struct {
+	key peerProofCacheKey
+	der []byte
+	//True once the proof is known to be in the database
+	stored bool
+	//When a message referencing the proof was last stored
+	lastUsed time.Time
+}
+
+type proofDedup struct {
+	//Held while proofs are written or deleted, so that the sweep cannot
+	//delete a proof that marshal has just stored. It is taken before mu
+	storemu sync.Mutex
+	mu      sync.Mutex
+	byHash  map[peerProofCacheKey]*dedupProof
+	//Interned DERs, so they need not be hashed again
+	byPtr map[*byte]*dedupProof
+	//When proofs were last dropped from memory. A proof that is not in
+	//memory may have been used up until then
+	forgotten time.Time
+}
+
+//The proofs of all queued and persisted messages
+var proofs = newProofDedup()
+
+func newProofDedup() *proofDedup {
+	return &proofDedup{
+		byHash:    make(map[peerProofCacheKey]*dedupProof),
+		byPtr:     make(map[*byte]*dedupProof),
+		forgotten: time.Now(),
+	}
+}
+
+func dedupProofKey(k peerProofCacheKey) []byte {
+	return append([]byte(dedupProofPrefix), k.Serialize()...)
+}
+
+//Return the entry for a proof, adding it if required. The mutex must be
+//held
+func (d *proofDedup) add(k peerProofCacheKey, der []byte) *dedupProof {
+	if e, ok := d.byHash[k]; ok {
+		return e
+	}
+	if len(d.byHash) >= ProofDedupMaxEntries {
+		d.byHash = make(map[peerProofCacheKey]*dedupProof)
+		d.byPtr = make(map[*byte]*dedupProof)
+		d.forgotten = time.Now()
+	}
+	e := &dedupProof{key: k, der: der}
+	d.byHash[k] = e
+	d.byPtr[&der[0]] = e
+	return e
+}
+
+//Return the entry for a proof DER
+func (d *proofDedup) entry(der []byte) *dedupProof {
+	d.mu.Lock()
+	e, ok := d.byPtr[&der[0]]
+	d.mu.Unlock()
+	if ok && len(e.der) == len(der) {
+		return e
+	}
+	k := peerProofCacheKey{}
+	k.Low, k.High = cityhash.Hash128(der)
+	d.mu.Lock()
+	e = d.add(k, der)
+	d.mu.Unlock()
+	return e
+}
+
+//Return a copy of the DER that is shared with the other messages that
+//have the same proof
+func (d *proofDedup) intern(der []byte) []byte {
+	if len(der) < ProofDedupMinSize {
+		return der
+	}
+	return d.entry(der).der
+}
+
+//Marshal a message for storage, storing its proof separately
+func (d *proofDedup) marshal(m *pb.Message) []byte {
+	if len(m.ProofDER) < ProofDedupMinSize {
+		bin, err := proto.Marshal(m)
+		if err != nil {
+			panic(err)
+		}
+		return bin
+	}
+	e := d.entry(m.ProofDER)
+	//The use is recorded before checking if the proof is stored, so that
+	//the sweep either sees the use or has already marked it as not stored
+	d.mu.Lock()
+	e.lastUsed = time.Now()
+	stored := e.stored
+	d.mu.Unlock()
+	if !stored {
+		d.storemu.Lock()
+		if err := rocksdb.ProofSet(dedupProofKey(e.key), e.der); err != nil {
+			panic(err)
+		}
+		pmProofDedupStored.Inc()
+		d.mu.Lock()
+		e.stored = true
+		d.mu.Unlock()
+		d.storemu.Unlock()
+	}
+	elided := pb.ShallowCloneMessageForDrops(m)
+	elided.ProofDER = nil
+	elided.ProofHash = e.key.Serialize()
+	bin, err := proto.Marshal(elided)
+	if err != nil {
+		panic(err)
+	}
+	pmProofDedupSavedBytes.Add(float64(len(m.ProofDER) - len(elided.ProofHash)))
+	return bin
+}
+
+//Put the proof back into a message loaded from storage
+func (d *proofDedup) restore(m *pb.Message) error {
+	if m.ProofDER != nil || len(m.ProofHash) != 16 {
+		return nil
+	}
+	k := peerProofCacheKey{}
+	k.High = binary.BigEndian.Uint64(m.ProofHash[:8])
+	k.Low = binary.BigEndian.Uint64(m.ProofHash[8:])
+	d.mu.Lock()
+	e, ok := d.byHash[k]
+	d.mu.Unlock()
+	if !ok {
+		//A proof loaded while the sweep is deleting it would be marked as
+		//stored after it is gone
+		d.storemu.Lock()
+		der, err := rocksdb.ProofGet(dedupProofKey(k))
+		if err != nil {
+			d.storemu.Unlock()
+			return fmt.Errorf("could not load proof %x: %v", m.ProofHash, err)
+		}
+		d.mu.Lock()
+		e = d.add(k, der)
+		e.stored = true
+		d.mu.Unlock()
+		d.storemu.Unlock()
+	}
+	m.ProofDER = e.der
+	m.ProofHash = nil
+	return nil
+}
+
+//The size a message is accounted as in a queue. Its proof is shared, so
+//only the reference to it is counted
+func queuedSize(m *pb.Message) int {
+	sz := proto.Size(m)
+	if n := len(m.ProofDER); n >= ProofDedupMinSize {
+		sz += (1 + 1 + 16) - (1 + proto.SizeVarint(uint64(n)) + n)
+	}
+	return sz
+}
+
+//Return the proof hash of a stored message without unmarshalling it
+func storedProofHash(bin []byte) []byte {
+	for len(bin) > 0 {
+		tag, n := binary.Uvarint(bin)
+		if n <= 0 {
+			return nil
+		}
+		bin = bin[n:]
+		switch tag & 7 {
+		case 0:
+			_, n = binary.Uvarint(bin)
+			if n <= 0 {
+				return nil
+			}
+		case 1:
+			n = 8
+		case 2:
+			ln, vn := binary.Uvarint(bin)
+			if vn <= 0 || uint64(len(bin)-vn) < ln {
+				return nil
+			}
+			if tag>>3 == messageProofHashField {
+				return bin[vn : vn+int(ln)]
+			}
+			n = vn + int(ln)
+		case 5:
+			n = 4
+		default:
+			return nil
+		}
+		if n > len(bin) {
+			return nil
+		}
+		bin = bin[n:]
+	}
+	return nil
+}
+
+//Remove the stored proofs that no queued or persisted message references
+func (d *proofDedup) sweep() int {
+	start := time.Now()
+	referenced := make(map[string]bool)
+	scan := func(col rocksdb.Column, prefix []byte) {
+		it := rocksdb.NewIterator(col, prefix)
+		for ; it.HasNext(); it.Next() {
+			//A message that cannot be read cannot be delivered either, so
+			//its proof is not needed
+			if h := storedProofHash(it.Value()); h != nil {
+				referenced[string(h)] = true
+			}
+		}
+	}
+	scan(rocksdb.QUEUE, []byte("q/"))
+	scan(rocksdb.PERSIST, []byte{cfMsg})
+
+	unreferenced := []peerProofCacheKey{}
+	it := rocksdb.NewIterator(rocksdb.PROOF, []byte(dedupProofPrefix))
+	for ; it.HasNext(); it.Next() {
+		h := it.Key()[len(dedupProofPrefix):]
+		if len(h) != 16 || referenced[string(h)] {
+			continue
+		}
+		k := peerProofCacheKey{}
+		k.High = binary.BigEndian.Uint64(h[:8])
+		k.Low = binary.BigEndian.Uint64(h[8:])
+		unreferenced = append(unreferenced, k)
+	}
+
+	//Messages stored since the scan began may reference the proofs, they
+	//are covered by the grace period. Only the choice of proofs is made
+	//under mu, so that publishing and flushing are not held up by the
+	//deletes. A message stored after the choice finds its proof marked as
+	//not stored, and waits on storemu to write it again
+	cutoff := start.Add(-ProofGCGrace)
+	d.storemu.Lock()
+	defer d.storemu.Unlock()
+	victims := []peerProofCacheKey{}
+	d.mu.Lock()
+	for _, k := range unreferenced {
+		lastUsed := d.forgotten
+		e, ok := d.byHash[k]
+		if ok {
+			lastUsed = e.lastUsed
+		}
+		if lastUsed.After(cutoff) {
+			continue
+		}
+		if ok {
+			e.stored = false
+		}
+		victims = append(victims, k)
+	}
+	d.mu.Unlock()
+	for _, k := range victims {
+		if err := rocksdb.ProofDelete(dedupProofKey(k)); err != nil {
+			panic(err)
+		}
+	}
+	pmProofDedupCollected.Add(float64(len(victims)))
+	return len(victims)
+}
+
+//Periodically remove unreferenced proofs until the manager is shut down
+func (qm *QManager) proofGC() {
+	for {
+		select {
+		case <-qm.ctx.Done():
+			return
+		case <-time.After(ProofGCInterval):
+		}
+		if n := proofs.sweep(); n > 0 {
+			fmt.Printf("removed %d unreferenced proofs\n", n)
+		}
+	}
+}
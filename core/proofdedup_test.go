@@ -0,0 +1,55 @@
+package core
+
+import (
+	"bytes"
+	"testing"
+	"time"
+
+	"github.com/golang/protobuf/proto"
+	pb "github.com/immesys/wavemq/mqpb"
+	rocksdb "github.com/immesys/wavemq/rockstorage"
+	"github.com/stretchr/testify/require"
+)
+
+func TestProofDedup(t *testing.T) {
+	rocksdb.Initialize(rocksdb.StorageConfig{
+		Engine: rocksdb.EngineMemory,
+	})
+	d := newProofDedup()
+	der := bytes.Repeat([]byte{7}, 2000)
+	m := &pb.Message{ProofDER: der, Signature: []byte("signature")}
+	bin := d.marshal(m)
+	require.True(t, len(bin) < 100)
+	require.Equal(t, der, m.ProofDER)
+	require.Equal(t, len(bin), queuedSize(m))
+	hash := storedProofHash(bin)
+	require.Len(t, hash, 16)
+
+	//Another message with the same proof shares it
+	require.True(t, &d.intern(append([]byte{}, der...))[0] == &der[0])
+
+	//An empty cache loads the proof from the database
+	loaded := &pb.Message{}
+	require.NoError(t, proto.Unmarshal(bin, loaded))
+	require.NoError(t, newProofDedup().restore(loaded))
+	require.Equal(t, der, loaded.ProofDER)
+	require.Nil(t, loaded.ProofHash)
+
+	//Unreferenced, but used within the grace period
+	require.Equal(t, 0, d.sweep())
+	for _, e := range d.byHash {
+		e.lastUsed = time.Time{}
+	}
+	d.forgotten = time.Time{}
+	persistKey := []byte{cfMsg, 1, 'x'}
+	require.NoError(t, rocksdb.PersistSet(persistKey, bin))
+	require.Equal(t, 0, d.sweep())
+	require.NoError(t, rocksdb.PersistDelete(persistKey))
+	require.Equal(t, 1, d.sweep())
+	_, err := rocksdb.ProofGet(append([]byte(dedupProofPrefix), hash...))
+	require.Equal(t, rocksdb.ErrObjNotFound, err)
+
+	//Storing another message puts the proof back
+	d.marshal(m)
+	require.NoError(t, newProofDedup().restore(loaded))
+}
@@ -0,0 +1,127 @@
+package core
+
+import (
+	"encoding/binary"
+	"fmt"
+	"time"
+
+	rocksdb "github.com/immesys/wavemq/rockstorage"
+)
+
+//Validated proof results are written to the proof column family so that
+//the incoming cache is warm after a restart. Without this every entity
+//and peer pays for a full proof verification after a restart, and peers
+//sending elided proofs get ProofNotCached until they resend the full proof
+
+//The DB key prefix for a validated proof result
+const validatedProofPrefix = "v/"
+
+//Serialize an incoming cache key for use as a DB key
+func (k *icacheKey) Serialize() []byte {
+	rv := make([]byte, 0, len(validatedProofPrefix)+32+32+16+1+len(k.Permission)+len(k.URI))
+	rv = append(rv, validatedProofPrefix...)
+	rv = append(rv, k.Namespace[:]...)
+	rv = append(rv, k.Entity[:]...)
+	var proof [16]byte
+	binary.BigEndian.PutUint64(proof[0:8], k.ProofHigh)
+	binary.BigEndian.PutUint64(proof[8:16], k.ProofLow)
+	rv = append(rv, proof[:]...)
+	rv = append(rv, byte(len(k.Permission)))
+	rv = append(rv, k.Permission...)
+	rv = append(rv, k.URI...)
+	return rv
+}
+
+//Deserialize an incoming cache key from a DB key
+func loadIcacheKey(ser []byte) (icacheKey, error) {
+	k := icacheKey{}
+	ser = ser[len(validatedProofPrefix):]
+	if len(ser) < 32+32+16+1 {
+		return k, fmt.Errorf("corrupt validated proof key")
+	}
+	copy(k.Namespace[:], ser[0:32])
+	copy(k.Entity[:], ser[32:64])
+	k.ProofHigh = binary.BigEndian.Uint64(ser[64:72])
+	k.ProofLow = binary.BigEndian.Uint64(ser[72:80])
+	plen := int(ser[80])
+	ser = ser[81:]
+	if len(ser) < plen {
+		return k, fmt.Errorf("corrupt validated proof key")
+	}
+	k.Permission = string(ser[:plen])
+	k.URI = string(ser[plen:])
+	return k, nil
+}
+
+//Serialize an incoming cache item for use as a DB value
+func (i *icacheItem) Serialize() []byte {
+	rv := make([]byte, 17+len(i.DER))
+	binary.BigEndian.PutUint64(rv[0:8], uint64(i.CacheExpiry.UnixNano()))
+	binary.BigEndian.PutUint64(rv[8:16], uint64(i.ProofExpiry.UnixNano()))
+	if i.Valid {
+		rv[16] = 1
+	}
+	copy(rv[17:], i.DER)
+	return rv
+}
+
+//Deserialize an incoming cache item from a DB value
+func loadIcacheItem(ser []byte) (*icacheItem, error) {
+	if len(ser) < 17 {
+		return nil, fmt.Errorf("corrupt validated proof")
+	}
+	rv := &icacheItem{
+		CacheExpiry: time.Unix(0, int64(binary.BigEndian.Uint64(ser[0:8]))),
+		ProofExpiry: time.Unix(0, int64(binary.BigEndian.Uint64(ser[8:16]))),
+		Valid:       ser[16] == 1,
+	}
+	if len(ser) > 17 {
+		rv.DER = make([]byte, len(ser)-17)
+		copy(rv.DER, ser[17:])
+	}
+	return rv, nil
+}
+
+//Insert a proof validation result into the incoming cache and persist it
+//so that it survives a restart
+func (am *AuthModule) cacheValidatedProof(ick icacheKey, item *icacheItem) {
+	am.icache.Put(ick, item)
+	err := rocksdb.ProofSet(ick.Serialize(), item.Serialize())
+	if err != nil {
+		fmt.Printf("could not persist validated proof: %v\n", err)
+	}
+}
+
+//Walk the persisted validated proofs, deleting the expired or corrupt ones.
+//If restore is true, the live ones are loaded into the incoming cache
+func (am *AuthModule) scanValidatedProofs(restore bool) {
+	nw := time.Now()
+	//Never trust a persisted result for longer than we would have trusted
+	//it had we just validated it
+	maxExpiry := nw.Add(ValidatedProofMaxCacheTime)
+	toremove := [][]byte{}
+	restored := 0
+	it := rocksdb.NewIterator(rocksdb.PROOF, []byte(validatedProofPrefix))
+	for it.HasNext() {
+		k, kerr := loadIcacheKey(it.Key())
+		item, ierr := loadIcacheItem(it.Value())
+		if kerr != nil || ierr != nil || !item.CacheExpiry.After(nw) {
+			toremove = append(toremove, it.Key())
+		} else if restore {
+			if item.CacheExpiry.After(maxExpiry) {
+				item.CacheExpiry = maxExpiry
+			}
+			am.icache.Put(k, item)
+			restored++
+		}
+		it.Next()
+	}
+	for _, k := range toremove {
+		if err := rocksdb.ProofDelete(k); err != nil {
+			fmt.Printf("could not delete expired validated proof: %v\n", err)
+		}
+	}
+	if restore {
+		fmt.Printf("restored %d validated proofs (%d expired)\n", restored, len(toremove))
+	}
+}
@@ -0,0 +1,330 @@
+package core
+
+import (
+	"container/list"
+	"encoding/base64"
+	"strings"
+	"sync"
+	"time"
+
+	pb "github.com/immesys/wavemq/mqpb"
+	"github.com/prometheus/client_golang/prometheus"
+)
+
+//An edge router forwards every query to the designated router and checks
+//every message that comes back. Dashboards poll the same URIs over and
+//over, so if RoutingConfig.QueryCacheTime is set the checked results are
+//kept per namespace and URI pattern. Persisted messages that pass through
+//the router, published here or delivered to a local subscription, refresh
+//or invalidate the results they match. The cache time bounds how stale a
+//result can get on topics that nobody here subscribes to
+
+//The budget of the query cache in MB if RoutingConfig.QueryCacheMaxSize
+//is not set
+const QueryCacheDefaultMaxSize = 64
+
+//Some instrumentation
+var pmQueryCacheHits = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "querycache",
+	Name:      "hits",
+	Help:      "Number of queries answered from the edge query cache",
+})
+var pmQueryCacheMisses = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "querycache",
+	Name:      "misses",
+	Help:      "Number of queries forwarded to the designated router",
+})
+var pmQueryCacheRefreshes = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "querycache",
+	Name:      "refreshes",
+	Help:      "Number of cached query results updated by a passing message",
+})
+var pmQueryCacheInvalidations = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "querycache",
+	Name:      "invalidations",
+	Help:      "Number of cached query results dropped because of a passing message",
+})
+var pmQueryCacheSize = prometheus.NewGauge(prometheus.GaugeOpts{
+	Subsystem: "querycache",
+	Name:      "size_bytes",
+	Help:      "Size of the messages in the edge query cache",
+})
+
+func init() {
+	prometheus.MustRegister(pmQueryCacheHits)
+	prometheus.MustRegister(pmQueryCacheMisses)
+	prometheus.MustRegister(pmQueryCacheRefreshes)
+	prometheus.MustRegister(pmQueryCacheInvalidations)
+	prometheus.MustRegister(pmQueryCacheSize)
+}
+
+type queryCacheEntry struct {
+	//The namespace prefixed pattern
+	key     string
+	ns      string
+	pattern []string
+	msgs    []*pb.Message
+	size    int
+	expires time.Time
+	elem    *list.Element
+}
+
+//A query to the designated router whose results will be cached. If a
+//matching message passes through while it is in progress, the results may
+//already be out of date and are not cached
+type QueryCacheFill struct {
+	key     string
+	ns      string
+	pattern []string
+	stale   bool
+	started time.Time
+	msgs    []*pb.Message
+}
+
+type queryCache struct {
+	ttl     time.Duration
+	maxSize int
+
+	mu      sync.Mutex
+	size    int
+	entries map[string]*queryCacheEntry
+	//The entries and fills of each namespace, to find the ones a message
+	//matches
+	byNS  map[string]map[*queryCacheEntry]struct{}
+	fills map[string]map[*QueryCacheFill]struct{}
+	//The entries by last use, the front is the most recent
+	lru *list.List
+}
+
+func newQueryCache(ttl time.Duration, maxSize int) *queryCache {
+	return &queryCache{
+		ttl:     ttl,
+		maxSize: maxSize,
+		entries: make(map[string]*queryCacheEntry),
+		byNS:    make(map[string]map[*queryCacheEntry]struct{}),
+		fills:   make(map[string]map[*QueryCacheFill]struct{}),
+		lru:     list.New(),
+	}
+}
+
+//Does the URI match the pattern, which may contain + and * wildcards
+func uriMatches(pattern []string, uri []string) bool {
+	for len(pattern) > 0 {
+		switch pattern[0] {
+		case "*":
+			for i := 0; i <= len(uri); i++ {
+				if uriMatches(pattern[1:], uri[i:]) {
+					return true
+				}
+			}
+			return false
+		case "+":
+			if len(uri) == 0 {
+				return false
+			}
+		default:
+			if len(uri) == 0 || uri[0] != pattern[0] {
+				return false
+			}
+		}
+		pattern = pattern[1:]
+		uri = uri[1:]
+	}
+	return len(uri) == 0
+}
+
+func isWildcard(pattern []string) bool {
+	for _, p := range pattern {
+		if p == "*" || p == "+" {
+			return true
+		}
+	}
+	return false
+}
+
+//Remove an entry. The mutex must be held
+func (c *queryCache) remove(e *queryCacheEntry) {
+	delete(c.entries, e.key)
+	delete(c.byNS[e.ns], e)
+	if len(c.byNS[e.ns]) == 0 {
+		delete(c.byNS, e.ns)
+	}
+	c.lru.Remove(e.elem)
+	c.size -= e.size
+	pmQueryCacheSize.Set(float64(c.size))
+}
+
+//Return the cached results of a query, if any
+func (c *queryCache) get(ns string, uri string) ([]*pb.Message, bool) {
+	c.mu.Lock()
+	defer c.mu.Unlock()
+	e, ok := c.entries[ns+"/"+uri]
+	if ok && time.Now().After(e.expires) {
+		c.remove(e)
+		ok = false
+	}
+	if !ok {
+		pmQueryCacheMisses.Inc()
+		return nil, false
+	}
+	c.lru.MoveToFront(e.elem)
+	pmQueryCacheHits.Inc()
+	return e.msgs, true
+}
+
+//Begin a query to the designated router
+func (c *queryCache) begin(ns string, uri string) *QueryCacheFill {
+	f := &QueryCacheFill{
+		key:     ns + "/" + uri,
+		ns:      ns,
+		pattern: strings.Split(uri, "/"),
+		started: time.Now(),
+	}
+	c.mu.Lock()
+	if c.fills[ns] == nil {
+		c.fills[ns] = make(map[*QueryCacheFill]struct{})
+	}
+	c.fills[ns][f] = struct{}{}
+	c.mu.Unlock()
+	return f
+}
+
+//Finish a query to the designated router, caching its results if it
+//completed and nothing it matches has passed through since it began
+func (c *queryCache) end(f *QueryCacheFill, complete bool) {
+	c.mu.Lock()
+	defer c.mu.Unlock()
+	delete(c.fills[f.ns], f)
+	if len(c.fills[f.ns]) == 0 {
+		delete(c.fills, f.ns)
+	}
+	if !complete || f.stale {
+		return
+	}
+	size := 0
+	for _, m := range f.msgs {
+		size += queuedSize(m)
+	}
+	if size > c.maxSize {
+		return
+	}
+	if old, ok := c.entries[f.key]; ok {
+		c.remove(old)
+	}
+	e := &queryCacheEntry{
+		key:     f.key,
+		ns:      f.ns,
+		pattern: f.pattern,
+		msgs:    f.msgs,
+		size:    size,
+		expires: f.started.Add(c.ttl),
+	}
+	e.elem = c.lru.PushFront(e)
+	c.entries[e.key] = e
+	if c.byNS[e.ns] == nil {
+		c.byNS[e.ns] = make(map[*queryCacheEntry]struct{})
+	}
+	c.byNS[e.ns][e] = struct{}{}
+	c.size += size
+	for c.size > c.maxSize {
+		c.remove(c.lru.Back().Value.(*queryCacheEntry))
+	}
+	pmQueryCacheSize.Set(float64(c.size))
+}
+
+//Update the cache with a persisted message passing through the router.
+//The message must have been checked
+func (c *queryCache) observe(ns string, m *pb.Message) {
+	c.mu.Lock()
+	defer c.mu.Unlock()
+	if len(c.byNS[ns]) == 0 && len(c.fills[ns]) == 0 {
+		return
+	}
+	uri := strings.Split(m.Tbs.Uri, "/")
+	for f := range c.fills[ns] {
+		if uriMatches(f.pattern, uri) {
+			f.stale = true
+		}
+	}
+	for e := range c.byNS[ns] {
+		if !uriMatches(e.pattern, uri) {
+			continue
+		}
+		//The designated router keeps the latest message on each URI, so an
+		//exact query now returns this message. A wildcard query can be
+		//updated in place if it already returned a message on the URI,
+		//otherwise we do not know where the new one goes
+		if !isWildcard(e.pattern) {
+			c.resize(e, []*pb.Message{m})
+			pmQueryCacheRefreshes.Inc()
+			continue
+		}
+		replaced := false
+		for i, em := range e.msgs {
+			if em.Tbs.Uri == m.Tbs.Uri {
+				msgs := make([]*pb.Message, len(e.msgs))
+				copy(msgs, e.msgs)
+				msgs[i] = m
+				c.resize(e, msgs)
+				replaced = true
+				break
+			}
+		}
+		if replaced {
+			pmQueryCacheRefreshes.Inc()
+		} else {
+			c.remove(e)
+			pmQueryCacheInvalidations.Inc()
+		}
+	}
+}
+
+//Replace the messages of an entry. The cached slices are shared with
+//queries in progress, so they are never modified. The mutex must be held
+func (c *queryCache) resize(e *queryCacheEntry, msgs []*pb.Message) {
+	size := 0
+	for _, m := range msgs {
+		size += queuedSize(m)
+	}
+	c.size += size - e.size
+	e.msgs = msgs
+	e.size = size
+	for c.size > c.maxSize && c.lru.Len() > 0 {
+		c.remove(c.lru.Back().Value.(*queryCacheEntry))
+	}
+	pmQueryCacheSize.Set(float64(c.size))
+}
+
+//Return the cached results of a query on the given namespace, if the
+//query cache is enabled and has them. The messages have been checked and
+//must not be modified. The caller must check that the client may query
+//the URI, with CheckQuery, before returning them
+func (t *Terminus) CachedQuery(namespace []byte, uri string) ([]*pb.Message, bool) {
+	if t.qcache == nil {
+		return nil, false
+	}
+	return t.qcache.get(base64.URLEncoding.EncodeToString(namespace), uri)
+}
+
+//Begin a query to the designated router whose results can be cached.
+//Returns nil if the query cache is disabled
+func (t *Terminus) BeginCachedQuery(namespace []byte, uri string) *QueryCacheFill {
+	if t.qcache == nil {
+		return nil
+	}
+	return t.qcache.begin(base64.URLEncoding.EncodeToString(namespace), uri)
+}
+
+//Add a checked message returned by the designated router to the results
+func (f *QueryCacheFill) Add(m *pb.Message) {
+	if f != nil {
+		f.msgs = append(f.msgs, m)
+	}
+}
+
+//Finish the query, complete is false if it did not return all results
+func (t *Terminus) EndCachedQuery(f *QueryCacheFill, complete bool) {
+	if f != nil {
+		t.qcache.end(f, complete)
+	}
+}
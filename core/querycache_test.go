@@ -0,0 +1,101 @@
+package core
+
+import (
+	"strings"
+	"testing"
+	"time"
+
+	pb "github.com/immesys/wavemq/mqpb"
+	"github.com/stretchr/testify/require"
+)
+
+func qcMessage(uri string, content string) *pb.Message {
+	return &pb.Message{
+		Tbs: &pb.MessageTBS{
+			Uri: uri,
+			Payload: []*pb.PayloadObject{
+				{Schema: "test", Content: []byte(content)},
+			},
+		},
+		Persist: true,
+	}
+}
+
+func qcFill(c *queryCache, uri string, msgs ...*pb.Message) {
+	f := c.begin("ns", uri)
+	for _, m := range msgs {
+		f.Add(m)
+	}
+	c.end(f, true)
+}
+
+func qcContents(msgs []*pb.Message) string {
+	rv := []string{}
+	for _, m := range msgs {
+		rv = append(rv, m.Tbs.Uri+"="+string(m.Tbs.Payload[0].Content))
+	}
+	return strings.Join(rv, ",")
+}
+
+func TestURIMatches(t *testing.T) {
+	split := func(s string) []string { return strings.Split(s, "/") }
+	require.True(t, uriMatches(split("a/b"), split("a/b")))
+	require.True(t, uriMatches(split("a/+/c"), split("a/b/c")))
+	require.False(t, uriMatches(split("a/+/c"), split("a/c")))
+	require.True(t, uriMatches(split("a/*"), split("a")))
+	require.True(t, uriMatches(split("a/*/d"), split("a/b/c/d")))
+	require.False(t, uriMatches(split("a/*/d"), split("a/b/c")))
+}
+
+func TestQueryCache(t *testing.T) {
+	c := newQueryCache(time.Minute, 1024*1024)
+	_, ok := c.get("ns", "a/b")
+	require.False(t, ok)
+
+	qcFill(c, "a/b", qcMessage("a/b", "1"))
+	qcFill(c, "a/+", qcMessage("a/b", "1"), qcMessage("a/c", "1"))
+	msgs, ok := c.get("ns", "a/b")
+	require.True(t, ok)
+	require.Equal(t, "a/b=1", qcContents(msgs))
+
+	//A message on a cached URI refreshes both results
+	c.observe("ns", qcMessage("a/b", "2"))
+	msgs, _ = c.get("ns", "a/b")
+	require.Equal(t, "a/b=2", qcContents(msgs))
+	msgs, _ = c.get("ns", "a/+")
+	require.Equal(t, "a/b=2,a/c=1", qcContents(msgs))
+
+	//A message on a new URI invalidates the wildcard result
+	c.observe("ns", qcMessage("a/d", "1"))
+	_, ok = c.get("ns", "a/+")
+	require.False(t, ok)
+	_, ok = c.get("ns", "a/b")
+	require.True(t, ok)
+
+	//A query that a message overtook is not cached
+	f := c.begin("ns", "x/*")
+	f.Add(qcMessage("x/y", "1"))
+	c.observe("ns", qcMessage("x/y", "2"))
+	c.end(f, true)
+	_, ok = c.get("ns", "x/*")
+	require.False(t, ok)
+
+	//Entries expire
+	c = newQueryCache(-time.Second, 1024*1024)
+	qcFill(c, "a/b", qcMessage("a/b", "1"))
+	_, ok = c.get("ns", "a/b")
+	require.False(t, ok)
+
+	//The least recently used entries are evicted to fit the budget
+	m := qcMessage("a/b", "1")
+	c = newQueryCache(time.Minute, 2*queuedSize(m))
+	qcFill(c, "a/b", m)
+	qcFill(c, "a/c", qcMessage("a/c", "1"))
+	c.get("ns", "a/b")
+	qcFill(c, "a/d", qcMessage("a/d", "1"))
+	_, ok = c.get("ns", "a/b")
+	require.True(t, ok)
+	_, ok = c.get("ns", "a/c")
+	require.False(t, ok)
+	require.Equal(t, 2*queuedSize(m), c.size)
+}
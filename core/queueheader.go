@@ -0,0 +1,140 @@
+package core
+
+import (
+	"encoding/binary"
+	"fmt"
+	"time"
+
+	"github.com/golang/protobuf/proto"
+	pb "github.com/immesys/wavemq/mqpb"
+	rocksdb "github.com/immesys/wavemq/rockstorage"
+)
+
+//The queue header is stored in two parts. The hot part holds the fields
+//that change as the queue is used (the index and expiry) in a small fixed
+//layout under keyHeader. The cold part holds the fields that are set when
+//the queue is created or resubscribed (the subscription request with its
+//proof, the recipient and so on) under keyHeaderCold. Headers written by
+//older versions are a single gob under keyHeader, they are still loaded
+//and are rewritten in the new format on recovery
+
+//The hot header is the magic followed by Expires and Index
+var hotHeaderMagic = [4]byte{'w', 'q', 'h', 1}
+
+const hotHeaderLength = 4 + 8 + 8
+
+const coldHeaderVersion = 1
+
+const (
+	coldFlagPeerUpstream = 1 << iota
+)
+
+//Serialize the frequently changing part of a queue header
+func (qh *QueueHeader) serializeHot() []byte {
+	rv := make([]byte, hotHeaderLength)
+	copy(rv[0:4], hotHeaderMagic[:])
+	binary.BigEndian.PutUint64(rv[4:12], uint64(qh.Expires))
+	binary.BigEndian.PutUint64(rv[12:20], uint64(qh.Index))
+	return rv
+}
+
+//Serialize the rarely changing part of a queue header
+func (qh *QueueHeader) serializeCold() []byte {
+	var subreq []byte
+	if qh.SubRequest != nil {
+		var err error
+		subreq, err = proto.Marshal(qh.SubRequest)
+		if err != nil {
+			panic(err)
+		}
+	}
+	rv := make([]byte, 0, 1+3*8+1+2*binary.MaxVarintLen64+len(qh.RecipientID)+len(subreq))
+	rv = append(rv, coldHeaderVersion)
+	var num [8]byte
+	for _, v := range []int64{qh.MaxLength, qh.MaxSize, qh.Created.UnixNano()} {
+		binary.BigEndian.PutUint64(num[:], uint64(v))
+		rv = append(rv, num[:]...)
+	}
+	var flags byte
+	if qh.PeerUpstream {
+		flags |= coldFlagPeerUpstream
+	}
+	rv = append(rv, flags)
+	var vi [binary.MaxVarintLen64]byte
+	rv = append(rv, vi[:binary.PutUvarint(vi[:], uint64(len(qh.RecipientID)))]...)
+	rv = append(rv, qh.RecipientID...)
+	rv = append(rv, vi[:binary.PutUvarint(vi[:], uint64(len(subreq)))]...)
+	rv = append(rv, subreq...)
+	return rv
+}
+
+func isHotHeader(ser []byte) bool {
+	return len(ser) == hotHeaderLength && string(ser[0:4]) == string(hotHeaderMagic[:])
+}
+
+func (qh *QueueHeader) loadHot(ser []byte) {
+	qh.Expires = int64(binary.BigEndian.Uint64(ser[4:12]))
+	qh.Index = int64(binary.BigEndian.Uint64(ser[12:20]))
+}
+
+func (qh *QueueHeader) loadCold(ser []byte) error {
+	corrupt := fmt.Errorf("corrupt database")
+	if len(ser) < 1+3*8+1 || ser[0] != coldHeaderVersion {
+		return corrupt
+	}
+	qh.MaxLength = int64(binary.BigEndian.Uint64(ser[1:9]))
+	qh.MaxSize = int64(binary.BigEndian.Uint64(ser[9:17]))
+	qh.Created = time.Unix(0, int64(binary.BigEndian.Uint64(ser[17:25])))
+	qh.PeerUpstream = ser[25]&coldFlagPeerUpstream != 0
+	ser = ser[26:]
+	ln, n := binary.Uvarint(ser)
+	if n <= 0 || uint64(len(ser)-n) < ln {
+		return corrupt
+	}
+	qh.RecipientID = string(ser[n : n+int(ln)])
+	ser = ser[n+int(ln):]
+	ln, n = binary.Uvarint(ser)
+	if n <= 0 || uint64(len(ser)-n) != ln {
+		return corrupt
+	}
+	if ln > 0 {
+		qh.SubRequest = &pb.PeerSubscribeParams{}
+		if err := proto.Unmarshal(ser[n:], qh.SubRequest); err != nil {
+			return corrupt
+		}
+	}
+	return nil
+}
+
+//Load the header of a queue given the value stored under keyHeader. If it
+//is in the old single gob format, legacy is true and the header should be
+//rewritten
+func loadQueueHeader(id ID, ser []byte) (hdr *QueueHeader, legacy bool, err error) {
+	if !isHotHeader(ser) {
+		hdr, err = LoadQueueHeader(ser)
+		return hdr, true, err
+	}
+	hdr = &QueueHeader{ID: id}
+	hdr.loadHot(ser)
+	cold, err := rocksdb.QueueGet([]byte(keyHeaderCold(id)))
+	if err != nil {
+		return nil, false, err
+	}
+	if err := hdr.loadCold(cold); err != nil {
+		return nil, false, err
+	}
+	return hdr, false, nil
+}
+
+//Add the changed parts of the header to the write batch and clear the
+//change flags. The mutex must be held
+func (q *Queue) batchHeader(wb rocksdb.WriteBatch) {
+	if q.hdrChanged {
+		wb.Set([]byte(keyHeader(q.hdr.ID)), q.hdr.serializeHot())
+		q.hdrChanged = false
+	}
+	if q.coldChanged {
+		wb.Set([]byte(keyHeaderCold(q.hdr.ID)), q.hdr.serializeCold())
+		q.coldChanged = false
+	}
+}
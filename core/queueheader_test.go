@@ -0,0 +1,48 @@
+package core
+
+import (
+	"testing"
+	"time"
+
+	pb "github.com/immesys/wavemq/mqpb"
+	"github.com/stretchr/testify/require"
+)
+
+func TestQueueHeaderEncoding(t *testing.T) {
+	hdr := &QueueHeader{
+		Expires:   time.Now().UnixNano(),
+		ID:        ID("q1"),
+		Index:     42,
+		MaxLength: 1000,
+		MaxSize:   1 << 20,
+		Created:   time.Unix(0, time.Now().UnixNano()),
+		SubRequest: &pb.PeerSubscribeParams{
+			ProofDER: []byte("proof"),
+		},
+		RecipientID:  "router",
+		PeerUpstream: true,
+	}
+	hot := hdr.serializeHot()
+	require.True(t, isHotHeader(hot))
+	//Headers written by older versions are told apart from the new format
+	require.False(t, isHotHeader(hdr.Serialize()))
+
+	rv := &QueueHeader{ID: hdr.ID}
+	rv.loadHot(hot)
+	require.NoError(t, rv.loadCold(hdr.serializeCold()))
+	require.Equal(t, hdr.Expires, rv.Expires)
+	require.Equal(t, hdr.Index, rv.Index)
+	require.Equal(t, hdr.MaxLength, rv.MaxLength)
+	require.Equal(t, hdr.MaxSize, rv.MaxSize)
+	require.True(t, hdr.Created.Equal(rv.Created))
+	require.Equal(t, hdr.RecipientID, rv.RecipientID)
+	require.True(t, rv.PeerUpstream)
+	require.Equal(t, hdr.SubRequest.ProofDER, rv.SubRequest.ProofDER)
+
+	//A queue without a subscription request
+	hdr.SubRequest = nil
+	rv = &QueueHeader{}
+	require.NoError(t, rv.loadCold(hdr.serializeCold()))
+	require.Nil(t, rv.SubRequest)
+	require.Error(t, rv.loadCold([]byte{coldHeaderVersion, 1, 2}))
+}
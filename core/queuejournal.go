@@ -0,0 +1,291 @@
+package core
+
+import (
+	"encoding/binary"
+	"fmt"
+	"sort"
+
+	"github.com/golang/protobuf/proto"
+	pb "github.com/immesys/wavemq/mqpb"
+	rocksdb "github.com/immesys/wavemq/rockstorage"
+	"github.com/prometheus/client_golang/prometheus"
+)
+
+//If QManagerConfig.JournalDataStore is set, every enqueued item is also
+//appended to a journal, which is fsynced within a few milliseconds. The
+//RocksDB flush is unchanged, the journal only covers the items that are
+//still uncommitted. An item's journal record is released when the item is
+//dequeued, when it has been committed to RocksDB or when its queue is
+//removed. Releasing an item also appends a trim record for its queue so
+//that recovery does not resurrect it while its segment is kept alive by
+//other records. Trim records are not fsynced eagerly, so a crash may
+//redeliver a few items, but it does not lose them
+
+//Journal record kinds
+const (
+	//An item was enqueued
+	journalEnqueue = 1
+	//Items with an index up to and including this one are gone
+	journalTrim = 2
+	//The queue was removed or reset
+	journalReset = 3
+)
+
+//Some instrumentation
+var pmJournaledMessages = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "queue",
+	Name:      "journaled_messages",
+	Help:      "Number of messages appended to the queue journal",
+})
+var pmJournalSegments = prometheus.NewGauge(prometheus.GaugeOpts{
+	Subsystem: "queue",
+	Name:      "journal_segments",
+	Help:      "Number of segment files in the queue journal",
+})
+
+func init() {
+	prometheus.MustRegister(pmJournaledMessages)
+	prometheus.MustRegister(pmJournalSegments)
+}
+
+func encodeJournalRecord(kind byte, id ID, index int64, bin []byte) []byte {
+	rv := make([]byte, 0, 1+2*binary.MaxVarintLen64+len(id)+len(bin))
+	var vi [binary.MaxVarintLen64]byte
+	rv = append(rv, kind)
+	rv = append(rv, vi[:binary.PutUvarint(vi[:], uint64(len(id)))]...)
+	rv = append(rv, id...)
+	rv = append(rv, vi[:binary.PutVarint(vi[:], index)]...)
+	rv = append(rv, bin...)
+	return rv
+}
+
+func decodeJournalRecord(rec []byte) (kind byte, id ID, index int64, bin []byte, err error) {
+	corrupt := fmt.Errorf("corrupt journal record")
+	if len(rec) < 1 {
+		return 0, "", 0, nil, corrupt
+	}
+	kind = rec[0]
+	rec = rec[1:]
+	ln, n := binary.Uvarint(rec)
+	if n <= 0 || uint64(len(rec)-n) < ln {
+		return 0, "", 0, nil, corrupt
+	}
+	id = ID(rec[n : n+int(ln)])
+	rec = rec[n+int(ln):]
+	index, n = binary.Varint(rec)
+	if n <= 0 {
+		return 0, "", 0, nil, corrupt
+	}
+	return kind, id, index, rec[n:], nil
+}
+
+func (q *Queue) journal() *rocksdb.Journal {
+	if q.mgr == nil {
+		return nil
+	}
+	return q.mgr.journal
+}
+
+//Marshal messages for the journal, or return nil if there is no journal
+func (q *Queue) journalMarshal(msgs []*pb.Message) [][]byte {
+	if q.journal() == nil {
+		return nil
+	}
+	rv := make([][]byte, len(msgs))
+	for i, m := range msgs {
+		rv[i] = proofs.marshal(m)
+	}
+	return rv
+}
+
+//Append a newly enqueued item to the journal, the mutex must be held
+func (q *Queue) journalItem(it *Item, bin []byte) {
+	j := q.journal()
+	if j == nil {
+		return
+	}
+	it.jref, _ = j.Append(encodeJournalRecord(journalEnqueue, q.hdr.ID, it.Index, bin), true)
+	pmJournaledMessages.Inc()
+}
+
+//Release the journal record of an uncommitted item that was dequeued
+func (q *Queue) journalDequeued(it *Item) {
+	j := q.journal()
+	if j == nil {
+		return
+	}
+	j.Append(encodeJournalRecord(journalTrim, q.hdr.ID, it.Index, nil), false)
+	j.Release(it.jref)
+}
+
+//Release the journal records of all uncommitted items because the queue is
+//being removed, the mutex must be held
+func (q *Queue) journalRemoved() {
+	j := q.journal()
+	if j == nil {
+		return
+	}
+	j.Append(encodeJournalRecord(journalReset, q.hdr.ID, 0, nil), false)
+	for it := q.uncommitedHead; it != nil; it = it.Next {
+		j.Release(it.jref)
+	}
+}
+
+//The journal records made obsolete by a write batch, released once the
+//batch is committed
+type journalDone struct {
+	refs  []rocksdb.JournalRef
+	trims []journalTrimmed
+}
+
+type journalTrimmed struct {
+	id    ID
+	index int64
+}
+
+//Record that the items from ucHead to ucTail are in the write batch
+func (d *journalDone) add(q *Queue, ucHead *Item, ucTail *Item) {
+	if q.journal() == nil || ucHead == nil {
+		return
+	}
+	for it := ucHead; it != nil; it = it.Next {
+		d.refs = append(d.refs, it.jref)
+		if it == ucTail {
+			break
+		}
+	}
+	d.trims = append(d.trims, journalTrimmed{id: q.hdr.ID, index: ucTail.Index})
+}
+
+//Release the journal records once the write batch has been committed
+func (qm *QManager) journalCommitted(d *journalDone) {
+	if qm == nil || qm.journal == nil {
+		return
+	}
+	for _, t := range d.trims {
+		qm.journal.Append(encodeJournalRecord(journalTrim, t.id, t.index, nil), false)
+	}
+	for _, ref := range d.refs {
+		qm.journal.Release(ref)
+	}
+	pmJournalSegments.Set(float64(qm.journal.Segments()))
+}
+
+type journaledItem struct {
+	index int64
+	ref   rocksdb.JournalRef
+	bin   []byte
+}
+
+//Open the journal and add the items it holds to the uncommitted part of
+//the recovered queues. largest is the largest index each queue holds in
+//RocksDB, and the queue indices are advanced past the journaled items
+func (qm *QManager) replayJournal(largest map[ID]int64) error {
+	items := make(map[ID][]journaledItem)
+	released := []rocksdb.JournalRef{}
+	//Queues that no longer exist
+	gone := make(map[ID]bool)
+	var rerr error
+	j, err := rocksdb.OpenJournal(qm.cfg.JournalDataStore, func(ref rocksdb.JournalRef, rec []byte) bool {
+		kind, id, index, bin, err := decodeJournalRecord(rec)
+		if err != nil {
+			rerr = err
+			return false
+		}
+		if _, ok := qm.qz[id]; !ok {
+			gone[id] = true
+			return false
+		}
+		switch kind {
+		case journalEnqueue:
+			//Already flushed to RocksDB
+			if l, ok := largest[id]; ok && index <= l {
+				return false
+			}
+			items[id] = append(items[id], journaledItem{
+				index: index,
+				ref:   ref,
+				bin:   append([]byte{}, bin...),
+			})
+			return true
+		case journalTrim:
+			kept := items[id][:0]
+			for _, it := range items[id] {
+				if it.index <= index {
+					released = append(released, it.ref)
+				} else {
+					kept = append(kept, it)
+				}
+			}
+			items[id] = kept
+		case journalReset:
+			for _, it := range items[id] {
+				released = append(released, it.ref)
+			}
+			delete(items, id)
+		}
+		return false
+	})
+	if err != nil {
+		return err
+	}
+	if rerr != nil {
+		return rerr
+	}
+	//Make sure the records of removed queues are not replayed into a new
+	//queue with the same ID
+	for id := range gone {
+		j.Append(encodeJournalRecord(journalReset, id, 0, nil), false)
+	}
+	for _, ref := range released {
+		j.Release(ref)
+	}
+	for id, its := range items {
+		q := qm.qz[id]
+		sort.Slice(its, func(a, b int) bool { return its[a].index < its[b].index })
+		for _, ji := range its {
+			m := &pb.Message{}
+			if err := proto.Unmarshal(ji.bin, m); err != nil {
+				return err
+			}
+			if err := proofs.restore(m); err != nil {
+				fmt.Printf("dropping journaled message %d of queue %s: %v\n", ji.index, id, err)
+				continue
+			}
+			q.enqueueJournaled(ji.index, ji.ref, m)
+			if l, ok := largest[id]; !ok || ji.index > l {
+				largest[id] = ji.index
+			}
+		}
+	}
+	qm.journal = j
+	pmJournalSegments.Set(float64(j.Segments()))
+	return nil
+}
+
+//Enqueue directly into the uncommitted queue, only used for on-startup
+//recovery
+func (q *Queue) enqueueJournaled(index int64, ref rocksdb.JournalRef, m *pb.Message) {
+	q.ck()
+	defer q.ck()
+	it := &Item{
+		Index:   index,
+		Content: m,
+		jref:    ref,
+	}
+	if q.uncommitedHead == nil {
+		q.uncommitedHead = it
+		if q.tail != nil {
+			q.tail.Next = it
+		}
+	} else {
+		q.uncommitedTail.Next = it
+	}
+	q.uncommitedTail = it
+	sz := queuedSize(m)
+	q.uncommittedSize += int64(sz)
+	pmQueuedBytes.Add(float64(sz))
+	pmQueuedMessages.Add(1)
+	q.uncommittedLength++
+	q.markDirty()
+}
@@ -72,6 +72,12 @@ type QManager struct {
 	//The mutex must be held whenever qz is modified
 	qzmu sync.Mutex
 
+	//The dirty set and expiry heap used by the background tasks
+	tasks qmTasks
+
+	//Nil unless JournalDataStore is set
+	journal *rocksdb.Journal
+
 	ctx       context.Context
 	ctxcancel context.CancelFunc
 }
@@ -104,6 +110,11 @@ type Queue struct {
 	//When the index is changed, the header is asynchronously flushed
 	//to the database. This flush happens if this flag is true
 	hdrChanged bool
+	//Like hdrChanged, but for the rarely changing part of the header
+	coldChanged bool
+
+	//True if the queue is in the manager's dirty set
+	dirty bool
 
 	//A list of keys that should be deleted from the db. This is added to
 	//whenever a commited entry is dequeued.
@@ -145,6 +156,10 @@ type QManagerConfig struct {
 
 	//Seconds between to-disk flushes
 	FlushInterval int64
+
+	//If set, the directory of the journal that makes enqueued items
+	//durable between flushes
+	JournalDataStore string
 }
 
 //Details about a queue that are persisted to disk
@@ -186,9 +201,12 @@ type Item struct {
 	Next    *Item
 	Index   int64
 	Content *pb.Message
+	//The journal record of the item while it is uncommitted
+	jref rocksdb.JournalRef
 }
 
-//Serialize a queue header
+//Serialize a queue header in the old single gob format. Headers are now
+//written in two parts, see queueheader.go
 func (qh *QueueHeader) Serialize() []byte {
 	buf := bytes.Buffer{}
 	enc := gob.NewEncoder(&buf)
@@ -199,7 +217,7 @@ func (qh *QueueHeader) Serialize() []byte {
 	return buf.Bytes()
 }
 
-//Deserialize a queue header
+//Deserialize a queue header in the old single gob format
 func LoadQueueHeader(ser []byte) (*QueueHeader, error) {
 	buf := bytes.NewBuffer(ser)
 	dec := gob.NewDecoder(buf)
@@ -226,6 +244,7 @@ func NewQManager(cfg *QManagerConfig) (*QManager, error) {
 		return nil, err
 	}
 	go rv.bgTasks()
+	go rv.proofGC()
 
 	return rv, nil
 }
@@ -236,6 +255,11 @@ func (qm *QManager) Shutdown() {
 		q.Flush()
 	}
 	qm.ctxcancel()
+	if qm.journal != nil {
+		if err := qm.journal.Close(); err != nil {
+			fmt.Printf("could not close queue journal: %v\n", err)
+		}
+	}
 	rocksdb.Close()
 }
 
@@ -306,8 +330,14 @@ func (qm *QManager) Remove(id ID) {
 func (qm *QManager) recover() error {
 	it := rocksdb.NewIterator(rocksdb.QUEUE, []byte("h/"))
 	for it.HasNext() {
+		id := ID(it.Key()[len("h/"):])
 		v := it.Value()
-		hdr, err := LoadQueueHeader(v)
+		if err := it.Err(); err != nil {
+			fmt.Printf("dropping queue %s: %v\n", id, err)
+			it.Next()
+			continue
+		}
+		hdr, legacy, err := loadQueueHeader(id, v)
 		if err != nil {
 			return err
 		}
@@ -317,17 +347,21 @@ func (qm *QManager) recover() error {
 			mgr:       qm,
 			Ctx:       ctx,
 			ctxcancel: cancel,
+			//Rewrite old headers in the new format
+			coldChanged: legacy,
 		}
 		if q.expired() {
 			q.ctxcancel()
 			q.remove()
 		} else {
 			qm.qz[hdr.ID] = q
+			qm.trackExpiry(q, hdr.Expires)
 		}
 		it.Next()
 	}
+	//The largest committed index of each queue
+	largest := make(map[ID]int64)
 	for _, q := range qm.qz {
-		var largest int64
 		qprefix := []byte(keyQueuePrefix(q.hdr.ID))
 		it := rocksdb.NewIterator(rocksdb.QUEUE, qprefix)
 		for it.HasNext() {
@@ -337,19 +371,38 @@ func (qm *QManager) recover() error {
 			if err != nil {
 				return err
 			}
-			if index > largest {
-				largest = index
+			if l, ok := largest[q.hdr.ID]; !ok || index > l {
+				largest[q.hdr.ID] = index
 			}
 			v := it.Value()
+			if err := it.Err(); err != nil {
+				fmt.Printf("dropping message %d of queue %s: %v\n", index, q.ID(), err)
+				it.Next()
+				continue
+			}
 			m := &pb.Message{}
 			err = proto.Unmarshal(v, m)
 			if err != nil {
 				return err
 			}
+			if err := proofs.restore(m); err != nil {
+				fmt.Printf("dropping message %d of queue %s: %v\n", index, q.ID(), err)
+				it.Next()
+				continue
+			}
 			q.enqueueCommitted(index, m)
 			it.Next()
 		}
-		q.hdr.Index = largest + 1
+	}
+	//Items that were not flushed before a crash are in the journal
+	if qm.cfg.JournalDataStore != "" {
+		if err := qm.replayJournal(largest); err != nil {
+			return err
+		}
+	}
+	for _, q := range qm.qz {
+		q.hdr.Index = largest[q.hdr.ID] + 1
+		q.hdrChanged = true
 		q.WriteHeader()
 	}
 
@@ -361,12 +414,11 @@ func (qm *QManager) recover() error {
 
 }
 
-//Runs the periodic background tasks for all queues
+//Runs the periodic background tasks for the queues that need them
 func (qm *QManager) bgTasks() {
 	last := time.Now()
 	for {
 		last = last.Add(time.Duration(qm.cfg.FlushInterval * 1e9))
-		fmt.Println(1)
 		toSleep := last.Sub(time.Now())
 		if toSleep > 0 {
 			time.Sleep(toSleep)
@@ -376,70 +428,14 @@ func (qm *QManager) bgTasks() {
 		if qm.ctx.Err() != nil {
 			return
 		}
-		fmt.Println(2)
-		//Collate a list of queues to process
-		qm.qzmu.Lock()
-		qz := make([]*Queue, 0, len(qm.qz))
-		for _, q := range qm.qz {
-			qz = append(qz, q)
-		}
-		qm.qzmu.Unlock()
-
-		toremove := []ID{}
 		nw := time.Now()
-		for _, q := range qz {
-			if qm.ctx.Err() != nil {
-				return
-			}
-			//We want to cancel the context for any timed out queues. This causes
-			//an unsub in terminus
-			if !q.GetIsPeerUpstream() && q.expired() {
-				toremove = append(toremove, q.hdr.ID)
-				q.ctxcancel()
-				q.remove()
-				continue
-			}
-
-			//GC the entries in the DB if they have been processed
-			fmt.Println(3)
-			q.GC()
-
-			//Write out a new header. Flush will also do this, but for an active
-			//queue, the flush might not trigger below
-			fmt.Println(4)
-			q.mu.Lock()
-			if q.hdrChanged {
-				err := q.writeHeader()
-				if err != nil {
-					panic(err)
-				}
-			}
-
-			fmt.Println(5)
-			//There are a couple reasons we might want to flush. We don't
-			//want to do it on an active queue for no reason though
-			if nw.Sub(q.lastDequeue) > IdleFlushTime ||
-				q.uncommittedSize > IdleFlushSize {
-				q.mu.Unlock()
-				//Move uncommited entries to committed
-				err := q.Flush()
-				if err != nil {
-					panic(err)
-				}
-			} else {
-				q.mu.Unlock()
-			}
-		}
-		fmt.Println(6)
+		//Removing the expired queues will cause an unsub in terminus
+		qm.expireQueues(nw)
 
-		qm.qzmu.Lock()
-		for _, q := range toremove {
-			delete(qm.qz, q)
-		}
-		pmNumQueues.Set(float64(len(qm.qz)))
-		qm.qzmu.Unlock()
+		dirty := qm.takeDirty()
+		pmDirtyQueues.Set(float64(len(dirty)))
+		qm.flushDirty(dirty, nw)
 	}
-
 }
 
 //Subscribe for notifications when the queue transitions from empty to
@@ -467,7 +463,8 @@ func (q *Queue) Header() *QueueHeader {
 func (q *Queue) SetSubRequest(r *pb.PeerSubscribeParams) {
 	q.mu.Lock()
 	q.hdr.SubRequest = r
-	q.hdrChanged = true
+	q.coldChanged = true
+	q.markDirty()
 	q.mu.Unlock()
 }
 
@@ -480,7 +477,8 @@ func (q *Queue) GetSubRequest() *pb.PeerSubscribeParams {
 func (q *Queue) SetRecipientID(s string) {
 	q.mu.Lock()
 	q.hdr.RecipientID = s
-	q.hdrChanged = true
+	q.coldChanged = true
+	q.markDirty()
 	q.mu.Unlock()
 }
 
@@ -493,7 +491,8 @@ func (q *Queue) GetRecipientID() string {
 func (q *Queue) SetIsPeerUpstream(b bool) {
 	q.mu.Lock()
 	q.hdr.PeerUpstream = b
-	q.hdrChanged = true
+	q.coldChanged = true
+	q.markDirty()
 	q.mu.Unlock()
 }
 
@@ -546,14 +545,61 @@ func (q *Queue) SetTrunking(v bool) {
 		q.hdr.MaxSize = q.mgr.cfg.SubscriptionQueueMaxSize * 1024 * 1024
 		q.hdr.MaxLength = q.mgr.cfg.SubscriptionQueueMaxLength
 	}
-	q.hdrChanged = true
+	q.coldChanged = true
 	q.writeHeader()
 }
 
 //Add an element to the queue, dropping old records as required
 func (q *Queue) Enqueue(m *pb.Message) error {
-	sz := proto.Size(m)
+	sz := queuedSize(m)
+	var bin []byte
+	if bins := q.journalMarshal([]*pb.Message{m}); bins != nil {
+		bin = bins[0]
+	}
 	q.mu.Lock()
+	mustnotify := q.enqueue(m, sz, bin)
+	if mustnotify {
+		q.notifyAndDropLock()
+	} else {
+		q.mu.Unlock()
+	}
+	return nil
+}
+
+//Add several elements to the queue under a single lock acquisition,
+//dropping old records as required. Subscribers are notified at most once
+func (q *Queue) EnqueueBatch(msgs []*pb.Message) error {
+	if len(msgs) == 0 {
+		return nil
+	}
+	sizes := make([]int, len(msgs))
+	for i, m := range msgs {
+		sizes[i] = queuedSize(m)
+	}
+	bins := q.journalMarshal(msgs)
+	q.mu.Lock()
+	mustnotify := false
+	for i, m := range msgs {
+		var bin []byte
+		if bins != nil {
+			bin = bins[i]
+		}
+		if q.enqueue(m, sizes[i], bin) {
+			mustnotify = true
+		}
+	}
+	if mustnotify {
+		q.notifyAndDropLock()
+	} else {
+		q.mu.Unlock()
+	}
+	return nil
+}
+
+//Internal enqueue, mutex must be held. Returns true if the queue
+//transitioned from empty to non-empty and subscribers must be notified.
+//bin is the marshalled message if there is a journal
+func (q *Queue) enqueue(m *pb.Message, sz int, bin []byte) bool {
 	q.ck()
 	//Drop elements to make space for the new one
 	for {
@@ -575,6 +621,8 @@ func (q *Queue) Enqueue(m *pb.Message) error {
 	it.Index = q.hdr.Index
 	q.hdr.Index++
 	q.hdrChanged = true
+	q.markDirty()
+	q.journalItem(it, bin)
 	mustnotify := false
 	if q.uncommitedHead == nil {
 		q.uncommitedHead = it
@@ -593,12 +641,7 @@ func (q *Queue) Enqueue(m *pb.Message) error {
 	pmQueuedMessages.Add(1)
 	q.uncommittedLength++
 	q.ck()
-	if mustnotify {
-		q.notifyAndDropLock()
-	} else {
-		q.mu.Unlock()
-	}
-	return nil
+	return mustnotify
 }
 
 //Return the remaining space in the queue
@@ -631,6 +674,34 @@ func (q *Queue) Dequeue() *pb.Message {
 	return q.dequeue(true)
 }
 
+//Remove up to maxLength elements from the queue under a single lock
+//acquisition. Elements stop being removed once their total size would
+//exceed maxSize, but at least one element is always returned if the
+//queue is not empty
+func (q *Queue) DequeueBatch(maxLength int, maxSize int64) []*pb.Message {
+	q.mu.Lock()
+	defer q.mu.Unlock()
+	var rv []*pb.Message
+	var total int64
+	for len(rv) < maxLength {
+		next := q.head
+		if next == nil {
+			next = q.uncommitedHead
+		}
+		if next == nil {
+			break
+		}
+		sz := int64(proto.Size(next.Content))
+		if len(rv) > 0 && total+sz > maxSize {
+			break
+		}
+		total += sz
+		// this is an 'active' dequeue, so we refresh the expiry
+		rv = append(rv, q.dequeue(true))
+	}
+	return rv
+}
+
 //Get the ID of the queue
 func (q *Queue) ID() ID {
 	return q.hdr.ID
@@ -689,7 +760,7 @@ func (q *Queue) Flush() error {
 
 	q.mu.Lock()
 	//Flush the header if it has changed
-	if q.hdrChanged {
+	if q.hdrChanged || q.coldChanged {
 		q.writeHeader()
 	}
 
@@ -699,10 +770,29 @@ func (q *Queue) Flush() error {
 		return nil
 	}
 
-	//local copies of uc pointers
-	ucHead := q.uncommitedHead
-	ucTail := q.uncommitedTail
+	ucHead, ucTail := q.commitUncommitted()
+	q.mu.Unlock()
+
+	wb := rocksdb.NewWriteBatch(rocksdb.QUEUE)
+	done := &journalDone{}
+	q.batchItems(wb, ucHead, ucTail, done)
+	if err := wb.Commit(); err != nil {
+		panic(err)
+	}
+	q.mgr.journalCommitted(done)
+
+	return nil
+}
 
+//Move the uncommitted items to the end of the committed list and return
+//the moved span, which must then be written with batchItems. The mutex
+//and flushmu must be held
+func (q *Queue) commitUncommitted() (ucHead *Item, ucTail *Item) {
+	ucHead = q.uncommitedHead
+	ucTail = q.uncommitedTail
+	if ucHead == nil {
+		return nil, nil
+	}
 	if q.head == nil {
 		q.head = ucHead
 		q.tail = ucTail
@@ -716,33 +806,26 @@ func (q *Queue) Flush() error {
 	q.uncommittedLength = 0
 	q.uncommitedHead = nil
 	q.uncommitedTail = nil
+	return ucHead, ucTail
+}
 
-	q.mu.Unlock()
-
+//Add the items from ucHead to ucTail to the write batch, and their journal
+//records to done. flushmu must be held, the mutex need not be
+func (q *Queue) batchItems(wb rocksdb.WriteBatch, ucHead *Item, ucTail *Item, done *journalDone) {
+	done.add(q, ucHead, ucTail)
 	//While dequeue might modify q.head it won't modify the pointers within
 	//the elements, so there is no danger of the list being corrupted while
 	//we walk it here. The only danger is that another flush modifies
-	//the Next pointer of the tail, so we hold flushmu to prevent that
-
-	wb := rocksdb.NewWriteBatch(rocksdb.QUEUE)
-	it := ucHead
-	for it != nil {
-		nextit := it.Next
-		bin, err := proto.Marshal(it.Content)
-		if err != nil {
-			wb.Commit()
-			panic(err)
-		}
+	//the Next pointer of the tail, so we hold flushmu to prevent that.
+	//Enqueue may link new uncommitted items after the tail, so we stop there
+	for it := ucHead; it != nil; it = it.Next {
+		bin := proofs.marshal(it.Content)
 		wb.Set([]byte(keyQueueItem(q.hdr.ID, it.Index)), bin)
 		pmCommittedMessages.Add(1)
-		it = nextit
-	}
-	fmt.Println("finished flush")
-	if err := wb.Commit(); err != nil {
-		panic(err)
+		if it == ucTail {
+			break
+		}
 	}
-
-	return nil
 }
 
 func (q *Queue) Destroy() {
@@ -767,11 +850,16 @@ func (q *Queue) Drops() int64 {
 //Removes all the data in the database pertaining to this queue. Does
 //not clear the datastructure for reuse (see reset for that)
 func (q *Queue) remove() error {
-	//Remove the header
+	//Remove the header. The hot part goes first so that recovery never
+	//finds a queue without its cold part
 	hdrprefix := []byte(keyHeader(q.hdr.ID))
 	if err := rocksdb.QueueDelete(hdrprefix); err != nil {
 		return err
 	}
+	if err := rocksdb.QueueDelete([]byte(keyHeaderCold(q.hdr.ID))); err != nil {
+		return err
+	}
+	q.journalRemoved()
 
 	pmQueuedMessages.Add(-float64((q.length + q.uncommittedLength)))
 	pmQueuedBytes.Add(-float64((q.size + q.uncommittedSize)))
@@ -811,8 +899,12 @@ func (q *Queue) reset() error {
 		mgr:       q.mgr,
 		Ctx:       ctx,
 		ctxcancel: cancel,
+
+		hdrChanged:  true,
+		coldChanged: true,
 	}
 	q.writeHeader()
+	q.mgr.trackExpiry(q, qh.Expires)
 	return nil
 }
 
@@ -849,7 +941,7 @@ func (q *Queue) enqueueCommitted(index int64, m *pb.Message) error {
 		q.tail.Next = it
 	}
 	q.tail = it
-	sz := proto.Size(m)
+	sz := queuedSize(m)
 	q.size += int64(sz)
 	pmQueuedBytes.Add(float64(sz))
 	pmQueuedMessages.Add(1)
@@ -865,10 +957,16 @@ func (q *Queue) dequeue(refresh bool) *pb.Message {
 	defer q.ck()
 	nw := time.Now()
 	if refresh {
-		q.hdr.Expires = q.newExpiry()
+		expires := q.newExpiry()
+		//The expiry heap only catches up with expiries that move later, an
+		//earlier one needs its own entry
+		if expires != 0 && (q.hdr.Expires == 0 || expires < q.hdr.Expires) && q.mgr != nil {
+			q.mgr.trackExpiry(q, expires)
+		}
+		q.hdr.Expires = expires
+		q.hdrChanged = true
 	}
-	//TODO: is it necessary to update the header if we don't refresh the expiry?
-	q.hdrChanged = true
+	q.markDirty()
 	q.lastDequeue = nw
 	if q.head != nil {
 		it := q.head
@@ -881,7 +979,7 @@ func (q *Queue) dequeue(refresh bool) *pb.Message {
 			q.head = q.head.Next
 		}
 		q.togc = append(q.togc, keyQueueItem(q.hdr.ID, it.Index))
-		sz := proto.Size(it.Content)
+		sz := queuedSize(it.Content)
 		q.size -= int64(sz)
 		pmQueuedBytes.Add(-float64(sz))
 		pmQueuedMessages.Add(-1)
@@ -897,7 +995,8 @@ func (q *Queue) dequeue(refresh bool) *pb.Message {
 	if q.uncommitedHead == nil {
 		q.uncommitedTail = nil
 	}
-	sz := proto.Size(it.Content)
+	q.journalDequeued(it)
+	sz := queuedSize(it.Content)
 	q.uncommittedSize -= int64(sz)
 	pmQueuedBytes.Add(-float64(sz))
 	pmQueuedMessages.Add(-1)
@@ -905,9 +1004,19 @@ func (q *Queue) dequeue(refresh bool) *pb.Message {
 	return it.Content
 }
 
-//Write the header out to the database
+//Write the changed parts of the header out to the database
 func (q *Queue) writeHeader() error {
-	return rocksdb.QueueSet([]byte(keyHeader(q.hdr.ID)), q.hdr.Serialize())
+	if !q.hdrChanged && !q.coldChanged {
+		return nil
+	}
+	hdrChanged, coldChanged := q.hdrChanged, q.coldChanged
+	wb := rocksdb.NewWriteBatch(rocksdb.QUEUE)
+	q.batchHeader(wb)
+	err := wb.Commit()
+	if err != nil {
+		q.hdrChanged, q.coldChanged = hdrChanged, coldChanged
+	}
+	return err
 }
 
 func (i *Iterator) Next() {
@@ -930,6 +1039,12 @@ func keyHeader(id ID) string {
 	return "h/" + string(id)
 }
 
+//The DB key for the rarely changing part of a header. This must not
+//start with "h/" as recovery iterates over that prefix
+func keyHeaderCold(id ID) string {
+	return "hc/" + string(id)
+}
+
 //The DB key for a specific item in a queue
 func keyQueueItem(id ID, index int64) string {
 	return fmt.Sprintf("q/%s/%08d", id, index)
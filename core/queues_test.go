@@ -2,12 +2,13 @@ package core
 
 import (
 	"crypto/rand"
-	"io/ioutil"
+	"fmt"
 	"testing"
 	"time"
 
 	"github.com/golang/protobuf/proto"
 	pb "github.com/immesys/wavemq/mqpb"
+	rocksdb "github.com/immesys/wavemq/rockstorage"
 	"github.com/stretchr/testify/require"
 )
 
@@ -22,22 +23,54 @@ func mkmsg() *pb.Message {
 	rand.Read(m.ProofDER)
 	return m
 }
+//The queue tests use the in-memory storage engine, so they measure the
+//CPU cost of the queues and need no native library
 func getqm(t testing.TB) *QManager {
-	td, err := ioutil.TempDir("/tmp", "mq")
-	require.NoError(t, err)
+	rocksdb.Initialize(rocksdb.StorageConfig{
+		Engine: rocksdb.EngineMemory,
+	})
 	cfg := &QManagerConfig{
-		QueueDataStore:             td,
 		QueueExpiry:                int64(24 * time.Hour),
 		SubscriptionQueueMaxLength: 100,
 		SubscriptionQueueMaxSize:   1 * 1024 * 1024,
 		TrunkingQueueMaxLength:     100,
 		TrunkingQueueMaxSize:       1 * 1024 * 1024,
+		FlushInterval:              1,
 	}
 	rv, err := NewQManager(cfg)
 	require.NoError(t, err)
 	return rv
 }
 
+//A terminus with just what the persisted message store needs, on the
+//in-memory storage engine
+func getTerminus(t testing.TB) *Terminus {
+	rocksdb.Initialize(rocksdb.StorageConfig{
+		Engine: rocksdb.EngineMemory,
+	})
+	return &Terminus{parents: newParentCache(), latest: newLatestCache()}
+}
+
+func BenchmarkQueueEnqueueFlushDequeue(b *testing.B) {
+	qm := getqm(b)
+	q, err := qm.NewQ(ID(fmt.Sprintf("bench%d", b.N)))
+	require.NoError(b, err)
+	//Dequeueing refreshes the expiry from the subscription request, which
+	//peer upstream queues don't have
+	q.SetIsPeerUpstream(true)
+	m := mkmsg()
+	m.ProofDER = m.ProofDER[:1000]
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		q.Enqueue(m)
+		if i%50 == 49 {
+			q.Flush()
+			for q.Dequeue() != nil {
+			}
+		}
+	}
+}
+
 func BenchmarkMessageSerialization(b *testing.B) {
 	m := mkmsg()
 	for i := 0; i < b.N; i++ {
@@ -0,0 +1,291 @@
+package core
+
+import (
+	"container/heap"
+	"sync"
+	"time"
+
+	rocksdb "github.com/immesys/wavemq/rockstorage"
+	"github.com/prometheus/client_golang/prometheus"
+)
+
+//The background tasks only visit queues that have work to do. A queue
+//adds itself to the dirty set when it gains uncommitted items, items to
+//GC or header changes, and queue expiry is tracked in a min-heap. An idle
+//queue therefore costs nothing per flush cycle
+
+//The number of goroutines building write batches in a flush cycle
+const FlushWorkers = 8
+
+//A flush worker commits its write batch once it is this large
+const FlushBatchMaxBytes = 4 * 1024 * 1024
+
+//Some instrumentation
+var pmDirtyQueues = prometheus.NewGauge(prometheus.GaugeOpts{
+	Subsystem: "queue",
+	Name:      "dirty",
+	Help:      "Number of queues processed in the last flush cycle",
+})
+var pmExpiredQueues = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "queue",
+	Name:      "expired",
+	Help:      "Number of queues removed because they expired",
+})
+
+var pmFlushBatches = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "queue",
+	Name:      "flush_batches",
+	Help:      "Number of write batches committed by the flush cycle",
+})
+var pmFlushBatchBytes = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "queue",
+	Name:      "flush_batch_bytes",
+	Help:      "Number of bytes in write batches committed by the flush cycle",
+})
+var pmFlushCycleTime = prometheus.NewGauge(prometheus.GaugeOpts{
+	Subsystem: "queue",
+	Name:      "flush_cycle_ms",
+	Help:      "Time taken by the last flush cycle in milliseconds",
+})
+
+func init() {
+	prometheus.MustRegister(pmDirtyQueues)
+	prometheus.MustRegister(pmExpiredQueues)
+	prometheus.MustRegister(pmFlushBatches)
+	prometheus.MustRegister(pmFlushBatchBytes)
+	prometheus.MustRegister(pmFlushCycleTime)
+}
+
+type expiryEntry struct {
+	expires int64
+	q       *Queue
+}
+
+//A min-heap of queue expiry times. Entries are not updated when a queue's
+//expiry is extended, instead the entry is pushed back with the new expiry
+//when it reaches the top of the heap
+type expiryHeap []expiryEntry
+
+func (h expiryHeap) Len() int            { return len(h) }
+func (h expiryHeap) Less(i, j int) bool  { return h[i].expires < h[j].expires }
+func (h expiryHeap) Swap(i, j int)       { h[i], h[j] = h[j], h[i] }
+func (h *expiryHeap) Push(x interface{}) { *h = append(*h, x.(expiryEntry)) }
+func (h *expiryHeap) Pop() interface{} {
+	old := *h
+	e := old[len(old)-1]
+	*h = old[:len(old)-1]
+	return e
+}
+
+//State for the queue manager background tasks
+type qmTasks struct {
+	dirtymu sync.Mutex
+	dirty   []*Queue
+
+	expirymu sync.Mutex
+	expiries expiryHeap
+
+	subsmu sync.Mutex
+	//Called with the ID of every queue that expires
+	expirySubs []func(id ID)
+}
+
+//Add the queue to the dirty set, the queue mutex must be held
+func (q *Queue) markDirty() {
+	if q.dirty || q.mgr == nil {
+		return
+	}
+	q.dirty = true
+	q.mgr.tasks.dirtymu.Lock()
+	q.mgr.tasks.dirty = append(q.mgr.tasks.dirty, q)
+	q.mgr.tasks.dirtymu.Unlock()
+}
+
+//Start tracking the expiry of the queue
+func (qm *QManager) trackExpiry(q *Queue, expires int64) {
+	if expires == 0 {
+		return
+	}
+	qm.tasks.expirymu.Lock()
+	heap.Push(&qm.tasks.expiries, expiryEntry{expires: expires, q: q})
+	qm.tasks.expirymu.Unlock()
+}
+
+//SubscribeExpiry registers a function to be called with the ID of every
+//queue that expires. The queue has already been removed when it is called
+func (qm *QManager) SubscribeExpiry(cb func(id ID)) {
+	qm.tasks.subsmu.Lock()
+	qm.tasks.expirySubs = append(qm.tasks.expirySubs, cb)
+	qm.tasks.subsmu.Unlock()
+}
+
+//Remove the queues that have expired by the given time
+func (qm *QManager) expireQueues(nw time.Time) {
+	due := []expiryEntry{}
+	qm.tasks.expirymu.Lock()
+	for qm.tasks.expiries.Len() > 0 && qm.tasks.expiries[0].expires <= nw.UnixNano() {
+		due = append(due, heap.Pop(&qm.tasks.expiries).(expiryEntry))
+	}
+	qm.tasks.expirymu.Unlock()
+
+	expired := []*Queue{}
+	for _, e := range due {
+		qm.qzmu.Lock()
+		live := qm.qz[e.q.hdr.ID] == e.q
+		qm.qzmu.Unlock()
+		if !live {
+			continue
+		}
+		e.q.mu.Lock()
+		expires := e.q.hdr.Expires
+		upstream := e.q.hdr.PeerUpstream
+		e.q.mu.Unlock()
+		//Upstream peer queues don't expire
+		if upstream || expires == 0 {
+			continue
+		}
+		if expires > nw.UnixNano() {
+			//The queue was used since this entry was pushed
+			qm.trackExpiry(e.q, expires)
+			continue
+		}
+		expired = append(expired, e.q)
+	}
+	if len(expired) == 0 {
+		return
+	}
+
+	qm.qzmu.Lock()
+	for _, q := range expired {
+		delete(qm.qz, q.hdr.ID)
+	}
+	pmNumQueues.Set(float64(len(qm.qz)))
+	qm.qzmu.Unlock()
+
+	qm.tasks.subsmu.Lock()
+	subs := qm.tasks.expirySubs
+	qm.tasks.subsmu.Unlock()
+	for _, q := range expired {
+		//We want to cancel the context for any timed out queues, this stops
+		//consumers
+		q.mu.Lock()
+		q.ctxcancel()
+		q.remove()
+		q.mu.Unlock()
+		pmExpiredQueues.Add(1)
+		for _, cb := range subs {
+			cb(q.hdr.ID)
+		}
+	}
+}
+
+//Take the current dirty set
+func (qm *QManager) takeDirty() []*Queue {
+	qm.tasks.dirtymu.Lock()
+	rv := qm.tasks.dirty
+	qm.tasks.dirty = nil
+	qm.tasks.dirtymu.Unlock()
+	return rv
+}
+
+//Do the background work for a dirty queue, adding it to the write batch:
+//GC dequeued entries, write out the header and flush uncommitted entries
+//if the queue is idle or deep
+func (q *Queue) batchFlush(nw time.Time, wb rocksdb.WriteBatch, done *journalDone) {
+	//Hold flushmu until the items are in the batch, see batchItems
+	q.flushmu.Lock()
+	defer q.flushmu.Unlock()
+	q.mu.Lock()
+	//Any change from here on must put the queue back in the dirty set
+	q.dirty = false
+	if q.Ctx.Err() != nil {
+		//The queue has been destroyed
+		q.mu.Unlock()
+		return
+	}
+
+	//The keys to GC were written by an earlier, already committed, cycle
+	//so it is safe to delete them in the same batch as the new items
+	togc := q.togc
+	q.togc = []string{}
+
+	//Write out a new header. For an active queue, the flush might not
+	//trigger below
+	q.batchHeader(wb)
+
+	//There are a couple reasons we might want to flush. We don't
+	//want to do it on an active queue for no reason though
+	var ucHead, ucTail *Item
+	if nw.Sub(q.lastDequeue) > IdleFlushTime ||
+		q.uncommittedSize > IdleFlushSize {
+		//Move uncommited entries to committed
+		ucHead, ucTail = q.commitUncommitted()
+	} else if q.uncommitedHead != nil {
+		//Look at this queue again next cycle, it might be idle by then
+		q.markDirty()
+	}
+	q.mu.Unlock()
+
+	for _, k := range togc {
+		wb.Delete([]byte(k))
+		pmCommittedMessages.Add(-1)
+	}
+	q.batchItems(wb, ucHead, ucTail, done)
+}
+
+//Flush the dirty queues. The queues are split between FlushWorkers
+//goroutines that each build a write batch and commit it whenever it reaches
+//FlushBatchMaxBytes, so a cycle costs a few large commits rather than a
+//transaction per queue and per GC'd key
+func (qm *QManager) flushDirty(dirty []*Queue, nw time.Time) {
+	if len(dirty) == 0 {
+		return
+	}
+	then := time.Now()
+	workers := FlushWorkers
+	if len(dirty) < workers {
+		workers = len(dirty)
+	}
+	work := make(chan *Queue, workers)
+	wg := sync.WaitGroup{}
+	wg.Add(workers)
+	for i := 0; i < workers; i++ {
+		go func() {
+			defer wg.Done()
+			wb := rocksdb.NewWriteBatch(rocksdb.QUEUE)
+			done := &journalDone{}
+			for q := range work {
+				q.batchFlush(nw, wb, done)
+				if wb.Size() >= FlushBatchMaxBytes {
+					commitFlushBatch(wb)
+					qm.journalCommitted(done)
+					wb = rocksdb.NewWriteBatch(rocksdb.QUEUE)
+					done = &journalDone{}
+				}
+			}
+			commitFlushBatch(wb)
+			qm.journalCommitted(done)
+		}()
+	}
+	for _, q := range dirty {
+		if qm.ctx.Err() != nil {
+			//Anything left over is flushed by Shutdown
+			break
+		}
+		work <- q
+	}
+	close(work)
+	wg.Wait()
+	pmFlushCycleTime.Set(float64(time.Now().Sub(then)) / 1e6)
+}
+
+func commitFlushBatch(wb rocksdb.WriteBatch) {
+	sz := wb.Size()
+	if err := wb.Commit(); err != nil {
+		panic(err)
+	}
+	if sz > 0 {
+		pmFlushBatches.Inc()
+		pmFlushBatchBytes.Add(float64(sz))
+	}
+}
@@ -0,0 +1,42 @@
+package core
+
+import (
+	"container/heap"
+	"testing"
+	"time"
+
+	pb "github.com/immesys/wavemq/mqpb"
+	"github.com/stretchr/testify/require"
+)
+
+func TestExpiryHeapOrder(t *testing.T) {
+	h := &expiryHeap{}
+	for _, e := range []int64{50, 10, 40, 20, 30} {
+		heap.Push(h, expiryEntry{expires: e})
+	}
+	got := []int64{}
+	for h.Len() > 0 {
+		got = append(got, heap.Pop(h).(expiryEntry).expires)
+	}
+	require.Equal(t, []int64{10, 20, 30, 40, 50}, got)
+}
+
+func TestExpiryShortSubscription(t *testing.T) {
+	qm := getqm(t)
+	//In seconds
+	qm.cfg.QueueExpiry = 3600
+	q, err := qm.NewQ("shortexpiry")
+	require.NoError(t, err)
+	//The queue is tracked with the manager's expiry until a dequeue moves
+	//it to the much shorter one the subscriber asked for
+	q.SetSubRequest(&pb.PeerSubscribeParams{
+		Tbs: &pb.PeerSubscriptionTBS{Expiry: 1},
+	})
+	require.Nil(t, q.Dequeue())
+	qm.expireQueues(time.Now().Add(2 * time.Second))
+	qm.qzmu.Lock()
+	_, ok := qm.qz["shortexpiry"]
+	qm.qzmu.Unlock()
+	require.False(t, ok)
+	require.Error(t, q.Ctx.Err())
+}
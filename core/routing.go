@@ -38,6 +38,11 @@ var pmDownstreamMessages = prometheus.NewCounter(prometheus.CounterOpts{
 	Name:      "downstream_messages",
 	Help:      "Number of messages from downstream peering",
 })
+var pmDownstreamInvalidMessages = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "route",
+	Name:      "downstream_invalid_messages",
+	Help:      "Number of messages from downstream peering dropped due to bad proofs",
+})
 var pmUpstreamMessages = prometheus.NewCounter(prometheus.CounterOpts{
 	Subsystem: "route",
 	Name:      "upstream_messages",
@@ -73,6 +78,7 @@ func init() {
 	prometheus.MustRegister(pmPublishedMessages)
 	prometheus.MustRegister(pmEnqueuedMessages)
 	prometheus.MustRegister(pmDownstreamMessages)
+	prometheus.MustRegister(pmDownstreamInvalidMessages)
 	prometheus.MustRegister(pmUpstreamMessages)
 	prometheus.MustRegister(pmPeerErrors)
 	prometheus.MustRegister(pmSubscriptions)
@@ -80,6 +86,13 @@ func init() {
 	prometheus.MustRegister(pmQueriedMessages)
 }
 
+//The largest number of messages, and approximate number of bytes, that
+//will be packed into a single SubscriptionMessage frame when the subscriber
+//has indicated it understands batches. The byte limit keeps frames well
+//under the default gRPC maximum message size
+const MaxSubscriptionBatchMessages = 100
+const MaxSubscriptionBatchBytes = 1024 * 1024
+
 type ID string
 type subscription struct {
 	subid   ID
@@ -93,7 +106,7 @@ type subTreeNode struct {
 	v atomic.Value
 }
 type subTreeNodeValue struct {
-	children map[string]*subTreeNode
+	children map[tokenID]*subTreeNode
 	subz     map[ID]*subscription
 }
 
@@ -107,6 +120,19 @@ type subTreeNodeValue struct {
 type Terminus struct {
 	//The subscription tree
 	stree *subTreeNode
+	//The interned tokens of the subscription tree
+	tokens *tokenTable
+	//The subscriptions matching recently published topics
+	mcache *matchCache
+	//The paths known to exist in the persisted message trees
+	parents *parentCache
+	//The latest persisted message of hot topics
+	latest *latestCache
+	//Writes the persisted messages
+	persister *persistPipeline
+	//The results of queries forwarded to designated routers, nil if
+	//disabled
+	qcache *queryCache
 
 	//Other modules of the system
 	qm *QManager
@@ -134,9 +160,20 @@ type Terminus struct {
 	//The namespaces that we will be designated router for
 	drnamespaces map[string]bool
 
+	//The subscription patterns we report to edge routers, for the
+	//namespaces we are the designated router for
+	interest *interestRegistry
+	//The subscription patterns our designated routers have reported, by
+	//namespace
+	upstreamInterest map[string]*remoteInterest
+
 	uplinkConns  map[string]*PeerConnection
 	uplinkConnMu sync.RWMutex
 
+	//Local subscriptions sharing a peer subscription to the DR
+	upstreamGroups   map[upstreamGroupKey]*upstreamGroup
+	upstreamGroupsMu sync.Mutex
+
 	activeUplink int64
 }
 
@@ -159,11 +196,25 @@ type RoutingConfig struct {
 	Router []DesignatedRouter
 	//Namespaces we are a designated router for
 	DesignatedNamespaceFiles []string
+
+	//Seconds that the results of a query to a designated router are
+	//cached, zero disables the cache
+	QueryCacheTime int64
+	//MB of query results cached, QueryCacheDefaultMaxSize if zero
+	QueryCacheMaxSize int64
+
+	//If true, publishing a persisted message on a namespace we are the
+	//designated router for returns once the message has been written,
+	//rather than while it waits to be written in the background
+	SyncPersist bool
 }
 
 type QueryElement struct {
 	Error wve.WVE
 	Msg   *pb.Message
+	//If there are more results, a page ends with an element that carries
+	//only this
+	Cursor []byte
 }
 
 func NewTerminus(qm *QManager, am *AuthModule, cfg *RoutingConfig) (*Terminus, error) {
@@ -181,24 +232,51 @@ func NewTerminus(qm *QManager, am *AuthModule, cfg *RoutingConfig) (*Terminus, e
 		weRoute[ns] = true
 	}
 	rv := &Terminus{
-		stree:         newSnode(),
-		rstree:        make(map[ID]*subTreeNode),
-		qm:            qm,
-		am:            am,
-		cfg:           cfg,
-		downlinkConns: make(map[string]*PeerConnection),
-		uplinkConns:   make(map[string]*PeerConnection),
-		drnamespaces:  weRoute,
+		stree:          newSnode(),
+		tokens:         newTokenTable(),
+		mcache:         newMatchCache(),
+		parents:        newParentCache(),
+		latest:         newLatestCache(),
+		rstree:         make(map[ID]*subTreeNode),
+		qm:             qm,
+		am:             am,
+		cfg:            cfg,
+		downlinkConns:  make(map[string]*PeerConnection),
+		uplinkConns:    make(map[string]*PeerConnection),
+		drnamespaces:   weRoute,
+		interest:       newInterestRegistry(),
+		upstreamGroups: make(map[upstreamGroupKey]*upstreamGroup),
 	}
+	if cfg.QueryCacheTime > 0 {
+		maxSize := cfg.QueryCacheMaxSize
+		if maxSize == 0 {
+			maxSize = QueryCacheDefaultMaxSize
+		}
+		rv.qcache = newQueryCache(time.Duration(cfg.QueryCacheTime)*time.Second, int(maxSize*1024*1024))
+	}
+	rv.persister = newPersistPipeline(rv)
 	rv.namespaces = make(map[string]*DesignatedRouter)
+	rv.upstreamInterest = make(map[string]*remoteInterest)
 	for _, r := range cfg.Router {
 		dr := r
 		rv.namespaces[r.Namespace] = &dr
+		rv.upstreamInterest[r.Namespace] = newRemoteInterest(r.Namespace)
 	}
 
+	//ID
+	// "" -> local
+	// "something"
+
+	//Loaded before any peering starts, the upstream peering sends it with
+	//its interest requests
+	rv.ourNodeId = rv.LoadID()
+
 	//Have we already created the queue
 	foundRouters := make(map[string]ID)
-	//Restore all the subscriptions present from prior queues
+	//Restore all the subscriptions present from prior queues. The tree is
+	//built in one pass rather than with addSub, which copies the node maps
+	//on every insertion
+	restored := []*subscription{}
 	for _, id := range qm.AllQueueIDs() {
 		q, err := qm.GetQ(id)
 		if err != nil {
@@ -223,7 +301,14 @@ func NewTerminus(qm *QManager, am *AuthModule, cfg *RoutingConfig) (*Terminus, e
 			uri := base64.URLEncoding.EncodeToString(subreq.Tbs.Namespace) + "/" + subreq.Tbs.Uri
 			sub.uri = uri
 		}
-		rv.addSub(sub.uri, sub)
+		restored = append(restored, sub)
+	}
+	rv.stree, rv.rstree = buildSubTree(rv.tokens, restored)
+	pmSubscriptions.Set(float64(len(rv.rstree)))
+	fmt.Printf("Restored %d subscriptions\n", len(restored))
+	for _, sub := range restored {
+		rv.trackInterest(sub, 1)
+		rv.beginPeering(sub)
 	}
 
 	//Create queues for new router connections
@@ -261,11 +346,10 @@ func NewTerminus(qm *QManager, am *AuthModule, cfg *RoutingConfig) (*Terminus, e
 		go rv.beginUpstreamPeering(q, dr)
 	}
 
-	//ID
-	// "" -> local
-	// "something"
-
-	rv.ourNodeId = rv.LoadID()
+	//Remove subscriptions as their queues expire
+	qm.SubscribeExpiry(func(id ID) {
+		rv.unsubscribeInternalID(id)
+	})
 
 	//Run the BG tasks
 	go rv.bgTasks()
@@ -276,22 +360,33 @@ func (t *Terminus) RouterID() string {
 	return t.ourNodeId
 }
 
+//Publish routes a message into all matching queues. The message must
+//already have been formed by FormMessage or verified by CheckMessage:
+//queued messages are delivered without being checked again
 func (t *Terminus) Publish(m *pb.Message) {
 	publishspan := opentracing.StartSpan("publish")
 	defer publishspan.Finish()
 	pmPublishedMessages.Add(1)
 	//Append the initial routing time
 	m.Timestamps = append(m.Timestamps, time.Now().UnixNano())
+	//Share the proof with the other queued messages that have it
+	m.ProofDER = proofs.intern(m.ProofDER)
 
 	var clientlist []*subscription
 	ns := base64.URLEncoding.EncodeToString(m.Tbs.Namespace)
 	fullUri := ns + "/" + m.Tbs.Uri
-	t.rMatchSubs(fullUri, func(s *subscription) {
+	for _, s := range t.matchSubs(fullUri) {
 		if s.q.GetIsPeerUpstream() {
 			//We only deliver local messages
 			if m.Tbs.OriginRouter != t.ourNodeId {
 				//This came from upstream, don't send it back on upstream
-				return
+				continue
+			}
+			//Don't send the DR messages nobody there wants. Persisted
+			//messages are always sent because the DR stores them
+			if !m.Persist && !t.upstreamInterest[s.q.GetRecipientID()].interested(fullUri) {
+				pmUpstreamSkippedMessages.Add(1)
+				continue
 			}
 		} else {
 			if s.q.GetRecipientID() == m.Tbs.OriginRouter {
@@ -300,12 +395,12 @@ func (t *Terminus) Publish(m *pb.Message) {
 				}
 				//This queue goes to the same node that issued the message
 				//don't loop
-				return
+				continue
 			}
 		}
 
 		clientlist = append(clientlist, s)
-	})
+	}
 
 	//Enqueue the message in all live subscriptions
 	//Manually call unsubscribe on all queues that have expired
@@ -323,15 +418,22 @@ func (t *Terminus) Publish(m *pb.Message) {
 	}
 	enqueuespan.Finish()
 
+	if m.Persist && t.qcache != nil {
+		t.qcache.observe(ns, m)
+	}
+
 	persistspan := opentracing.StartSpan("persist", opentracing.ChildOf(publishspan.Context()))
 	//If we are the DR for this and it is a persist message, also persist it
 	if t.drnamespaces[ns] && m.Persist {
-		serial, err := proto.Marshal(m)
-		if err != nil {
-			panic(err)
-		}
 		pmPersistedMessages.Add(1)
-		t.putMessage(fullUri, serial)
+		var done chan struct{}
+		if t.cfg.SyncPersist {
+			done = make(chan struct{})
+		}
+		t.persister.enqueue(fullUri, m, done)
+		if done != nil {
+			<-done
+		}
 	}
 	persistspan.Finish()
 }
@@ -354,11 +456,13 @@ func (t *Terminus) unsubscribeInternalID(subid ID) wve.WVE {
 	sub := next.subz[subid]
 	delete(next.subz, subid)
 	node.v.Store(*next)
+	t.mcache.Invalidate()
 	//Remove it from the reverse lookup
 	delete(t.rstree, subid)
 	pmSubscriptions.Set(float64(len(t.rstree)))
 
 	t.rstree_lock.Unlock()
+	t.trackInterest(sub, -1)
 
 	//This will cancel the queue context, which should cause consumers
 	//to stop consuming
@@ -429,6 +533,19 @@ func (t *Terminus) CreateSubscription(ps *pb.PeerSubscribeParams) (*Queue, wve.W
 
 //addSub adds a subscription to terminus.
 func (tm *Terminus) addSub(topic string, s *subscription) {
+	tm.beginPeering(s)
+	fmt.Println("Add subscription: ", strings.Split(topic, "/"))
+	node := tm.stree.addSub(tm.tokens.intern(topic), s)
+	tm.mcache.Invalidate()
+	tm.rstree_lock.Lock()
+	tm.rstree[s.subid] = node
+	pmSubscriptions.Set(float64(len(tm.rstree)))
+	tm.rstree_lock.Unlock()
+	tm.trackInterest(s, 1)
+}
+
+//Start whatever peering a new subscription needs
+func (tm *Terminus) beginPeering(s *subscription) {
 	//TODO this function also needs to create the subscription in the DR
 	//it has what it needs in s.q.GetSubRequest
 
@@ -444,18 +561,14 @@ func (tm *Terminus) addSub(topic string, s *subscription) {
 			//pull from us.
 		}
 	}
-	parts := strings.Split(topic, "/")
-	fmt.Println("Add subscription: ", parts)
-	node := tm.stree.addSub(parts, s)
-	tm.rstree_lock.Lock()
-	tm.rstree[s.subid] = node
-	pmSubscriptions.Set(float64(len(tm.rstree)))
-	tm.rstree_lock.Unlock()
 }
 
-func (tm *Terminus) rMatchSubs(topic string, visitor func(s *subscription)) {
-	parts := strings.Split(topic, "/")
-	tm.stree.rmatchSubs(parts, visitor)
+//Return the subscriptions matching a published topic. The returned slice is
+//shared and must not be modified
+func (tm *Terminus) matchSubs(topic string) []*subscription {
+	return tm.mcache.Get(topic, func() []*subscription {
+		return tm.stree.matchSubs(tm.tokens.lookup(topic))
+	})
 }
 
 func (t *Terminus) bgTasks() {
@@ -469,13 +582,6 @@ func (t *Terminus) bgTasks() {
 	for {
 		time.Sleep(5 * time.Second)
 		t.rstree_lock.RLock()
-		toremove := []ID{}
-		for subid, stn := range t.rstree {
-			s := stn.v.Load().(subTreeNodeValue).subz[subid]
-			if s.q.Ctx.Err() != nil {
-				toremove = append(toremove, subid)
-			}
-		}
 		if len(t.rstree) > 0 {
 			fmt.Printf("Active subscriptions:\n")
 			fmt.Printf("  AGE   URI\n")
@@ -489,9 +595,6 @@ func (t *Terminus) bgTasks() {
 			fmt.Printf("No active subscriptions\n")
 		}
 		t.rstree_lock.RUnlock()
-		for _, r := range toremove {
-			t.unsubscribeInternalID(r)
-		}
 	}
 }
 
@@ -545,26 +648,43 @@ func (t *Terminus) beginDownstreamPeering(q *Queue) {
 		return
 	}
 
+	t.joinUpstreamGroup(q)
+}
+
+//Maintain the peer subscription for a group of local subscriptions until
+//the last of them is gone
+func (t *Terminus) upstreamGroupPeering(g *upstreamGroup) {
 	//We need to know which address to dial.
 	for {
-		//This way when we unsubscribe this downstream peering will die too
-		ctx, cancel := context.WithCancel(q.Ctx)
+		//This way when the group empties this downstream peering will die too
+		ctx, cancel := context.WithCancel(g.ctx)
+		g.mu.Lock()
+		g.restart = cancel
+		g.mu.Unlock()
 		downstreampeerspan, ctx := opentracing.StartSpanFromContext(ctx, "downstream_peer")
-		err := t.downstreamPeer(ctx, q)
-		pmPeerErrors.Add(1)
-		fmt.Printf("downstream peering error %v\n", err)
+		err := t.downstreamPeer(ctx, g)
 		cancel()
-		if q.Ctx.Err() != nil {
-			//This queue is no more
-			downstreampeerspan.Finish()
+		downstreampeerspan.Finish()
+		if g.ctx.Err() != nil {
+			//The group is no more
 			return
 		}
+		if err == nil {
+			//The member whose request we used left, subscribe again with
+			//another one
+			continue
+		}
+		pmPeerErrors.Add(1)
+		fmt.Printf("downstream peering error %v\n", err)
 		time.Sleep(30 * time.Second)
 	}
 }
-func (t *Terminus) downstreamPeer(ctx context.Context, q *Queue) (err error) {
-	subreq := q.GetSubRequest()
-	ns := base64.URLEncoding.EncodeToString(subreq.Tbs.Namespace)
+func (t *Terminus) downstreamPeer(ctx context.Context, g *upstreamGroup) (err error) {
+	subreq := g.request()
+	if subreq == nil {
+		return fmt.Errorf("no live subscriptions to peer")
+	}
+	ns := g.key.Namespace
 	conn, err := t.downstreamClient(ns)
 	if err != nil {
 		return err
@@ -581,6 +701,10 @@ func (t *Terminus) downstreamPeer(ctx context.Context, q *Queue) (err error) {
 	proofCache := make(map[peerProofCacheKey][]byte)
 
 	peer := pb.NewWAVEMQPeeringClient(conn.Conn)
+	//Ask the DR to batch messages. The request is our own copy. A DR that
+	//does not know about batching will ignore the field and send one message
+	//per frame
+	subreq.MaxBatchMessages = MaxSubscriptionBatchMessages
 	sub, err := peer.PeerSubscribe(ctx, subreq)
 	if err != nil {
 		panic(err)
@@ -596,39 +720,60 @@ func (t *Terminus) downstreamPeer(ctx context.Context, q *Queue) (err error) {
 			//If the above call fails, we rely on age-out upstream to clear the queue
 			return nil
 		}
-		msg, err := sub.Recv()
+		frame, err := sub.Recv()
 		if err != nil {
+			if ctx.Err() != nil {
+				//Unsubscribed while we were waiting, see above
+				continue
+			}
 			panic(err)
 		}
+		if frame.Error != nil {
+			panic(fmt.Errorf("peer subscribe error: %s", frame.Error.Message))
+		}
 		span, _ := opentracing.StartSpanFromContext(ctx, "recvdownstream")
-		fmt.Println("got msg", msg.Message.Timestamps)
-		//for i, ts := range msg.Message.Timestamps {
-		//	t := time.Unix(0, ts)
-		//	fmt.Printf("timestamp %d at %s\n", i, t)
-		//}
-		if docaching {
-			if msg.Message.ProofDER == nil && len(msg.Message.ProofHash) == 16 {
-				cacheKey := peerProofCacheKey{}
-				cacheKey.High = binary.BigEndian.Uint64(msg.Message.ProofHash[:8])
-				cacheKey.Low = binary.BigEndian.Uint64(msg.Message.ProofHash[8:])
-				proof := proofCache[cacheKey]
-				msg.Message.ProofDER = proof
-				msg.Message.ProofHash = nil
-			} else {
-				cacheKey := peerProofCacheKey{}
-				cacheKey.Low, cacheKey.High = cityhash.Hash128(msg.Message.ProofDER)
-				proofCache[cacheKey] = msg.Message.ProofDER
+		msgs := make([]*pb.Message, 0, len(frame.Messages)+1)
+		if frame.Message != nil {
+			msgs = append(msgs, frame.Message)
+		}
+		msgs = append(msgs, frame.Messages...)
+		verified := msgs[:0]
+		for _, m := range msgs {
+			if docaching {
+				if m.ProofDER == nil && len(m.ProofHash) == 16 {
+					cacheKey := peerProofCacheKey{}
+					cacheKey.High = binary.BigEndian.Uint64(m.ProofHash[:8])
+					cacheKey.Low = binary.BigEndian.Uint64(m.ProofHash[8:])
+					proof := proofCache[cacheKey]
+					m.ProofDER = proof
+					m.ProofHash = nil
+				} else {
+					cacheKey := peerProofCacheKey{}
+					cacheKey.Low, cacheKey.High = cityhash.Hash128(m.ProofDER)
+					proofCache[cacheKey] = m.ProofDER
+				}
 			}
+			//Verify the message once here, rather than every time it is
+			//delivered from the queue
+			if err := t.am.CheckMessage(m); err != nil {
+				pmDownstreamInvalidMessages.Add(1)
+				fmt.Printf("dropping downstream message on %q: %v\n", m.Tbs.GetUri(), err)
+				continue
+			}
+			m.Timestamps = append(m.Timestamps, time.Now().UnixNano())
+			verified = append(verified, m)
 		}
-		_now := time.Now()
-		last := len(msg.Message.Timestamps)
-		msg.Message.Timestamps = append(msg.Message.Timestamps, _now.UnixNano())
-		elapsed := _now.Sub(time.Unix(0, msg.Message.Timestamps[last-1]))
-		fmt.Printf("%s elapsed since last ts\n", elapsed)
 
-		pmDownstreamMessages.Add(1)
+		pmDownstreamMessages.Add(float64(len(verified)))
+		if t.qcache != nil {
+			for _, m := range verified {
+				if m.Persist {
+					t.qcache.observe(ns, m)
+				}
+			}
+		}
 		enqueue := opentracing.StartSpan("downstream_queue", opentracing.ChildOf(span.Context()))
-		q.Enqueue(msg.Message)
+		g.deliver(verified)
 		enqueue.Finish()
 		span.Finish()
 	}
@@ -709,6 +854,9 @@ func (t *Terminus) upstreamPeer(ctx context.Context, q *Queue, dr *DesignatedRou
 		Notify: notify,
 	})
 	peer := pb.NewWAVEMQPeeringClient(conn)
+	interestctx, interestcancel := context.WithCancel(ctx)
+	defer interestcancel()
+	go t.followInterest(interestctx, peer, dr.Namespace)
 	//TODO rather have a pool of workers that send frames to the peer, using
 	//the returned pool size as an indication of how much can be sent
 	// iterate -> workers x[ send across -> dequeue on complete ]
@@ -793,12 +941,26 @@ func (t *Terminus) upstreamPeer(ctx context.Context, q *Queue, dr *DesignatedRou
 	return <-errch
 }
 
-func (t *Terminus) Query(namespace []byte, uri string) chan QueryElement {
+//Return the persisted messages matching a URI pattern. If limit is
+//nonzero, at most that many are returned, followed by an element with the
+//cursor of the next page if there are more. If cursor is not nil, the
+//messages start after the page it was returned with
+func (t *Terminus) Query(namespace []byte, uri string, limit int, cursor []byte) chan QueryElement {
 	ns := base64.URLEncoding.EncodeToString(namespace)
 	ruri := ns + "/" + uri
-	smch := make(chan SM, 10)
-	go t.GetMatchingMessage(ruri, smch)
 	rv := make(chan QueryElement, 10)
+	if limit < 0 {
+		limit = 0
+	}
+	if _, _, ok := decodeQueryCursor(ruri, cursor); cursor != nil && !ok {
+		rv <- QueryElement{Error: wve.Err(wve.InvalidParameter, "invalid query cursor")}
+		close(rv)
+		return rv
+	}
+	smch := make(chan SM, 10)
+	var next []byte
+	var qerr error
+	go t.GetMatchingPage(ruri, limit, cursor, smch, &next, &qerr)
 	go func() {
 		for e := range smch {
 			m := pb.Message{}
@@ -807,9 +969,21 @@ func (t *Terminus) Query(namespace []byte, uri string) chan QueryElement {
 				fmt.Printf("failed to unmarshal proto message from persist: %v\n", err)
 				continue
 			}
+			if err := proofs.restore(&m); err != nil {
+				fmt.Printf("failed to load persisted message: %v\n", err)
+				continue
+			}
 			pmQueriedMessages.Add(1)
 			rv <- QueryElement{Msg: &m}
 		}
+		if qerr != nil {
+			rv <- QueryElement{Error: wve.ErrW(wve.InternalError, "could not query persisted messages", qerr)}
+			close(rv)
+			return
+		}
+		if next != nil {
+			rv <- QueryElement{Cursor: next}
+		}
 		close(rv)
 	}()
 	return rv
@@ -857,44 +1031,18 @@ func (t *Terminus) Query(namespace []byte, uri string) chan QueryElement {
 
 func newSnode() *subTreeNode {
 	n := subTreeNodeValue{
-		children: make(map[string]*subTreeNode),
+		children: make(map[tokenID]*subTreeNode),
 	}
 	rv := &subTreeNode{}
 	rv.v.Store(n)
 	return rv
 }
 
-//For a node in the tree, match the given subscription string and call visitor
-//for every subscription found
-func (s *subTreeNode) rmatchSubs(parts []string, visitor func(s *subscription)) {
-	n := s.v.Load().(subTreeNodeValue)
-	if len(parts) == 0 {
-		for _, sub := range n.subz {
-			visitor(sub)
-		}
-		return
-	}
-	v1, ok1 := n.children[parts[0]]
-	v2, ok2 := n.children["+"]
-	v3, ok3 := n.children["*"]
-	if ok1 {
-		v1.rmatchSubs(parts[1:], visitor)
-	}
-	if ok2 {
-		v2.rmatchSubs(parts[1:], visitor)
-	}
-	if ok3 {
-		for i := 0; i <= len(parts); i++ {
-			v3.rmatchSubs(parts[i:], visitor)
-		}
-	}
-}
-
 //Make a deep copy of the node value
 func (s *subTreeNode) copy() *subTreeNodeValue {
 	rv := &subTreeNodeValue{
 		subz:     make(map[ID]*subscription),
-		children: make(map[string]*subTreeNode),
+		children: make(map[tokenID]*subTreeNode),
 	}
 	n := s.v.Load().(subTreeNodeValue)
 	for id, sub := range n.subz {
@@ -908,7 +1056,7 @@ func (s *subTreeNode) copy() *subTreeNodeValue {
 
 //Add the given subscription parts starting from the given snode
 //returns the node added to the tree
-func (s *subTreeNode) addSub(parts []string, sub *subscription) *subTreeNode {
+func (s *subTreeNode) addSub(parts []tokenID, sub *subscription) *subTreeNode {
 	if len(parts) == 0 {
 		s.mu.Lock()
 		n := s.copy()
@@ -933,6 +1081,35 @@ func (s *subTreeNode) addSub(parts []string, sub *subscription) *subTreeNode {
 	}
 }
 
+//Build a subscription tree holding all the given subscriptions, along with
+//the map from subscription ID to the node that holds it. The tree is not
+//shared until this returns, so the node maps are filled in place instead
+//of being copied for every insertion
+func buildSubTree(tt *tokenTable, subs []*subscription) (*subTreeNode, map[ID]*subTreeNode) {
+	root := newSnode()
+	rstree := make(map[ID]*subTreeNode, len(subs))
+	for _, sub := range subs {
+		node := root
+		for _, tok := range tt.intern(sub.uri) {
+			n := node.v.Load().(subTreeNodeValue)
+			child, ok := n.children[tok]
+			if !ok {
+				child = newSnode()
+				n.children[tok] = child
+			}
+			node = child
+		}
+		n := node.v.Load().(subTreeNodeValue)
+		if n.subz == nil {
+			n.subz = make(map[ID]*subscription)
+			node.v.Store(n)
+		}
+		n.subz[sub.subid] = sub
+		rstree[sub.subid] = node
+	}
+	return root, rstree
+}
+
 func rounddur(d, r time.Duration) time.Duration {
 	if r <= 0 {
 		return d
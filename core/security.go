@@ -38,10 +38,22 @@ const WAVEMQSubscribe = "subscribe"
 const WAVEMQQuery = "query"
 const WAVEMQRoute = "route"
 
+//Lets a router follow the subscription patterns that its designated router
+//has in a namespace. The resource is always "*"
+const WAVEMQInterest = "interest"
+
 const ValidatedProofMaxCacheTime = 6 * time.Hour
 const SuccessfulProofCacheTime = 6 * time.Hour
 const FailedProofCacheTime = 5 * time.Minute
 
+//The byte budgets for the proof caches. The least recently used entries are
+//evicted when these are exceeded
+const IncomingProofCacheMaxBytes = 256 * 1024 * 1024
+const BuildProofCacheMaxBytes = 64 * 1024 * 1024
+
+//How often expired entries are swept out of the proof caches
+const ProofCacheSweepInterval = 1 * time.Minute
+
 const docaching = true
 
 type AuthModule struct {
@@ -50,12 +62,14 @@ type AuthModule struct {
 
 	// the Incoming cache stores the time that a given proof must be
 	// revalidated
-	icachemu sync.RWMutex
-	icache   map[icacheKey]*icacheItem
+	icache *proofCache
 
 	// the Build cache stores the results of proof build operations
-	bcachemu sync.RWMutex
-	bcache   map[bcacheKey]*bcacheItem
+	bcache *proofCache
+
+	// the Prepare cache stores decrypted messages for subscribers that share
+	// a perspective
+	pcache *prepareCache
 
 	ourPerspective  *eapipb.Perspective
 	perspectiveHash []byte
@@ -113,16 +127,36 @@ func NewAuthModule(cfg *waved.Configuration) (*AuthModule, error) {
 	iapi.InjectStorageInterface(si)
 	ws := poc.NewPOC(llsdb)
 	eapi := eapi.NewEAPI(ws)
-	return &AuthModule{
+	rv := &AuthModule{
 		cfg:            cfg,
 		wave:           eapi,
-		icache:         make(map[icacheKey]*icacheItem),
-		bcache:         make(map[bcacheKey]*bcacheItem),
+		icache:         newProofCache("incoming", IncomingProofCacheMaxBytes),
+		bcache:         newProofCache("build", BuildProofCacheMaxBytes),
+		pcache:         newPrepareCache(),
 		routingProofs:  make(map[string][]byte),
 		phashcache:     make(map[uint32][]byte),
 		jediClients:    make(map[string]*jedi.ClientState),
 		jediPublicInfo: jedistore.NewWAVEPublicInfo(eapi.GetEngineNoPerspective()),
-	}, nil
+	}
+	rv.scanValidatedProofs(true)
+	go rv.bgTasks()
+	return rv, nil
+}
+
+//Periodically remove expired entries from the proof caches, and from
+//the persisted validated proofs
+func (am *AuthModule) bgTasks() {
+	lastPrune := time.Now()
+	for {
+		time.Sleep(ProofCacheSweepInterval)
+		am.icache.Sweep()
+		am.bcache.Sweep()
+		am.pcache.Sweep()
+		if time.Now().Sub(lastPrune) > ValidatedProofMaxCacheTime {
+			am.scanValidatedProofs(false)
+			lastPrune = time.Now()
+		}
+	}
 }
 
 func (am *AuthModule) GetJEDIClient(ctx context.Context, perspective *eapipb.Perspective) (*jedi.ClientState, error) {
@@ -330,9 +364,7 @@ func (am *AuthModule) CheckMessage(m *pb.Message) wve.WVE {
 		ick.ProofLow, ick.ProofHigh = cityhash.Hash128(m.ProofDER)
 	}
 
-	am.icachemu.Lock()
-	entry, ok := am.icache[ick]
-	am.icachemu.Unlock()
+	entry, ok := am.icache.Get(ick).(*icacheItem)
 	if ok && entry.CacheExpiry.After(time.Now()) {
 		if entry.Valid {
 			//fmt.Printf("returning message valid from cache\n")
@@ -368,13 +400,11 @@ func (am *AuthModule) CheckMessage(m *pb.Message) wve.WVE {
 	}
 	if presp.Error != nil {
 		if docaching {
-			am.icachemu.Lock()
-			am.icache[ick] = &icacheItem{
+			am.cacheValidatedProof(ick, &icacheItem{
 				CacheExpiry: time.Now().Add(ValidatedProofMaxCacheTime),
 				Valid:       false,
 				DER:         m.ProofDER,
-			}
-			am.icachemu.Unlock()
+			})
 		}
 		return wve.Err(wve.ProofInvalid, presp.Error.Message)
 	}
@@ -383,15 +413,13 @@ func (am *AuthModule) CheckMessage(m *pb.Message) wve.WVE {
 	if expiry.After(time.Now().Add(ValidatedProofMaxCacheTime)) {
 		expiry = time.Now().Add(ValidatedProofMaxCacheTime)
 	}
-	am.icachemu.Lock()
 	if docaching {
-		am.icache[ick] = &icacheItem{
+		am.cacheValidatedProof(ick, &icacheItem{
 			CacheExpiry: expiry,
 			Valid:       true,
 			DER:         m.ProofDER,
-		}
+		})
 	}
-	am.icachemu.Unlock()
 	return nil
 }
 
@@ -430,9 +458,7 @@ func (am *AuthModule) CheckSubscription(s *pb.PeerSubscribeParams) wve.WVE {
 	// h.Write(s.ProofDER)
 	// h.Read(ick.ProofHash[:])
 
-	am.icachemu.Lock()
-	entry, ok := am.icache[ick]
-	am.icachemu.Unlock()
+	entry, ok := am.icache.Get(ick).(*icacheItem)
 	if ok && entry.CacheExpiry.After(time.Now()) {
 		if entry.Valid {
 			if time.Unix(0, s.AbsoluteExpiry).After(entry.ProofExpiry) {
@@ -467,9 +493,7 @@ func (am *AuthModule) CheckSubscription(s *pb.PeerSubscribeParams) wve.WVE {
 				CacheExpiry: time.Now().Add(ValidatedProofMaxCacheTime),
 				Valid:       false,
 			}
-			am.icachemu.Lock()
-			am.icache[ick] = entry
-			am.icachemu.Unlock()
+			am.cacheValidatedProof(ick, entry)
 		}
 		return wve.Err(wve.ProofInvalid, presp.Error.Message)
 	}
@@ -483,9 +507,7 @@ func (am *AuthModule) CheckSubscription(s *pb.PeerSubscribeParams) wve.WVE {
 		DER:         s.ProofDER,
 	}
 	if docaching {
-		am.icachemu.Lock()
-		am.icache[ick] = entry
-		am.icachemu.Unlock()
+		am.cacheValidatedProof(ick, entry)
 	}
 	//If the user did not specify an absolute expiry, or specified one greater than
 	//the proof allows, then set the field to the proof's expiry
@@ -526,9 +548,7 @@ func (am *AuthModule) CheckQuery(s *pb.PeerQueryParams) wve.WVE {
 	// h.Write(s.ProofDER)
 	// h.Read(ick.ProofHash[:])
 
-	am.icachemu.RLock()
-	entry, ok := am.icache[ick]
-	am.icachemu.RUnlock()
+	entry, ok := am.icache.Get(ick).(*icacheItem)
 	if ok && entry.CacheExpiry.After(time.Now()) {
 		if entry.Valid {
 			return nil
@@ -560,9 +580,7 @@ func (am *AuthModule) CheckQuery(s *pb.PeerQueryParams) wve.WVE {
 			Valid:       false,
 		}
 		if docaching {
-			am.icachemu.Lock()
-			am.icache[ick] = entry
-			am.icachemu.Unlock()
+			am.cacheValidatedProof(ick, entry)
 		}
 		return wve.Err(wve.ProofInvalid, presp.Error.Message)
 	}
@@ -574,16 +592,30 @@ func (am *AuthModule) CheckQuery(s *pb.PeerQueryParams) wve.WVE {
 		DER:         s.ProofDER,
 	}
 	if docaching {
-		am.icachemu.Lock()
-		am.icache[ick] = entry
-		am.icachemu.Unlock()
+		am.cacheValidatedProof(ick, entry)
 	}
 	return nil
 }
 
 //TODO check all params as well formed
 
+//Prepare a message for delivery to a client with the given perspective,
+//decrypting it if required. Decryptions are shared between subscribers
+//with the same perspective, so the returned message must not be modified
 func (am *AuthModule) PrepareMessage(persp *pb.Perspective, m *pb.Message) (*pb.Message, wve.WVE) {
+	if persp == nil || persp.EntitySecret == nil {
+		return nil, wve.Err(wve.InvalidParameter, "missing perspective")
+	}
+	if m.EncryptionPartition == nil && m.Tbs.JediData == nil {
+		//Nothing to decrypt, this is cheap
+		return am.prepareMessage(persp, m)
+	}
+	return am.pcache.do(mkPcacheKey(persp, m), func() (*pb.Message, wve.WVE) {
+		return am.prepareMessage(persp, m)
+	})
+}
+
+func (am *AuthModule) prepareMessage(persp *pb.Perspective, m *pb.Message) (*pb.Message, wve.WVE) {
 	perspective := &eapipb.Perspective{
 		EntitySecret: &eapipb.EntitySecret{
 			DER:        persp.EntitySecret.DER,
@@ -706,9 +738,7 @@ func (am *AuthModule) FormMessage(p *pb.PublishParams, routerID string) (*pb.Mes
 	poldigest := policyhash.Sum(nil)
 	copy(bk.PolicyHash[:], poldigest)
 
-	am.bcachemu.RLock()
-	cachedproof, ok := am.bcache[bk]
-	am.bcachemu.RUnlock()
+	cachedproof, ok := am.bcache.Get(bk).(*bcacheItem)
 
 	var proofder []byte
 
@@ -750,9 +780,7 @@ func (am *AuthModule) FormMessage(p *pb.PublishParams, routerID string) (*pb.Mes
 					Valid:       false,
 				}
 				if docaching {
-					am.bcachemu.Lock()
-					am.bcache[bk] = ci
-					am.bcachemu.Unlock()
+					am.bcache.Put(bk, ci)
 				}
 				return nil, wve.Err(wve.NoProofFound, proofresp.Error.Message)
 			}
@@ -768,9 +796,7 @@ func (am *AuthModule) FormMessage(p *pb.PublishParams, routerID string) (*pb.Mes
 				ci.CacheExpiry = ci.ProofExpiry
 			}
 			if docaching {
-				am.bcachemu.Lock()
-				am.bcache[bk] = ci
-				am.bcachemu.Unlock()
+				am.bcache.Put(bk, ci)
 			}
 		} else {
 			proofder = cachedproof.DER
@@ -939,9 +965,7 @@ func (am *AuthModule) FormSubRequest(p *pb.SubscribeParams, routerID string) (*p
 	poldigest := policyhash.Sum(nil)
 	copy(bk.PolicyHash[:], poldigest)
 
-	am.bcachemu.RLock()
-	cachedproof, ok := am.bcache[bk]
-	am.bcachemu.RUnlock()
+	cachedproof, ok := am.bcache.Get(bk).(*bcacheItem)
 
 	var proofder []byte
 	var expiry time.Time
@@ -979,9 +1003,7 @@ func (am *AuthModule) FormSubRequest(p *pb.SubscribeParams, routerID string) (*p
 					Valid:       false,
 				}
 				if docaching {
-					am.bcachemu.Lock()
-					am.bcache[bk] = ci
-					am.bcachemu.Unlock()
+					am.bcache.Put(bk, ci)
 				}
 				return nil, wve.Err(wve.NoProofFound, proofresp.Error.Message)
 			}
@@ -997,9 +1019,7 @@ func (am *AuthModule) FormSubRequest(p *pb.SubscribeParams, routerID string) (*p
 				ci.CacheExpiry = ci.ProofExpiry
 			}
 			if docaching {
-				am.bcachemu.Lock()
-				am.bcache[bk] = ci
-				am.bcachemu.Unlock()
+				am.bcache.Put(bk, ci)
 			}
 
 			expiry = time.Unix(0, proofresp.Result.Expiry*1e6)
@@ -1081,9 +1101,7 @@ func (am *AuthModule) FormQueryRequest(p *pb.QueryParams, routerID string) (*pb.
 		poldigest := policyhash.Sum(nil)
 		copy(bk.PolicyHash[:], poldigest)
 
-		am.bcachemu.RLock()
-		cachedproof, ok := am.bcache[bk]
-		am.bcachemu.RUnlock()
+		cachedproof, ok := am.bcache.Get(bk).(*bcacheItem)
 
 		rebuildproof := true
 		if ok {
@@ -1122,9 +1140,7 @@ func (am *AuthModule) FormQueryRequest(p *pb.QueryParams, routerID string) (*pb.
 					Valid:       false,
 				}
 				if docaching {
-					am.bcachemu.Lock()
-					am.bcache[bk] = ci
-					am.bcachemu.Unlock()
+					am.bcache.Put(bk, ci)
 				}
 				return nil, wve.Err(wve.NoProofFound, proofresp.Error.Message)
 			}
@@ -1139,9 +1155,7 @@ func (am *AuthModule) FormQueryRequest(p *pb.QueryParams, routerID string) (*pb.
 				ci.CacheExpiry = ci.ProofExpiry
 			}
 			if docaching {
-				am.bcachemu.Lock()
-				am.bcache[bk] = ci
-				am.bcachemu.Unlock()
+				am.bcache.Put(bk, ci)
 			}
 			proofder = proofresp.ProofDER
 
@@ -1179,10 +1193,172 @@ func (am *AuthModule) FormQueryRequest(p *pb.QueryParams, routerID string) (*pb.
 		Uri:          p.Uri,
 		Signature:    signresp.Signature,
 		ProofDER:     proofder,
+		Limit:        p.Limit,
+		Cursor:       p.Cursor,
 	}, nil
 
 }
 
+//This checks that an interest request is signed by the router entity and
+//that the entity may follow the interest in the namespace
+func (am *AuthModule) CheckInterest(p *pb.PeerInterestParams) wve.WVE {
+	hash := sha3.New256()
+	hash.Write(p.Namespace)
+	hash.Write([]byte(p.RouterID))
+	digest := hash.Sum(nil)
+
+	resp, err := am.wave.VerifySignature(context.Background(), &eapipb.VerifySignatureParams{
+		Signer:    p.SourceEntity,
+		Signature: p.Signature,
+		Content:   digest,
+	})
+	if err != nil {
+		return wve.ErrW(wve.InvalidSignature, "could not validate signature", err)
+	}
+	if resp.Error != nil {
+		return wve.Err(wve.InvalidSignature, "failed to validate interest signature: "+resp.Error.Message)
+	}
+
+	ick := icacheKey{}
+	copy(ick.Namespace[:], p.Namespace)
+	copy(ick.Entity[:], p.SourceEntity)
+	ick.URI = "*"
+	ick.Permission = WAVEMQInterest
+	ick.ProofLow, ick.ProofHigh = cityhash.Hash128(p.ProofDER)
+
+	entry, ok := am.icache.Get(ick).(*icacheItem)
+	if ok && entry.CacheExpiry.After(time.Now()) {
+		if entry.Valid {
+			return nil
+		}
+		return wve.Err(wve.ProofInvalid, "this proof has been cached as invalid\n")
+	}
+	ctx, cancel := context.WithTimeout(context.Background(), 5*time.Second)
+	presp, err := am.wave.VerifyProof(ctx, &eapipb.VerifyProofParams{
+		ProofDER: p.ProofDER,
+		Subject:  p.SourceEntity,
+		RequiredRTreePolicy: &eapipb.RTreePolicy{
+			Namespace: p.Namespace,
+			Statements: []*eapipb.RTreePolicyStatement{
+				{
+					PermissionSet: []byte(WAVEMQPermissionSet),
+					Permissions:   []string{WAVEMQInterest},
+					Resource:      "*",
+				},
+			},
+		},
+	})
+	cancel()
+	if err != nil {
+		return wve.ErrW(wve.InternalError, "could not validate proof", err)
+	}
+	if presp.Error != nil {
+		entry := &icacheItem{
+			CacheExpiry: time.Now().Add(ValidatedProofMaxCacheTime),
+			Valid:       false,
+		}
+		if docaching {
+			am.cacheValidatedProof(ick, entry)
+		}
+		return wve.Err(wve.ProofInvalid, presp.Error.Message)
+	}
+
+	entry = &icacheItem{
+		CacheExpiry: time.Now().Add(ValidatedProofMaxCacheTime),
+		Valid:       true,
+		ProofExpiry: time.Unix(0, presp.Result.Expiry*1e6),
+		DER:         p.ProofDER,
+	}
+	if docaching {
+		am.cacheValidatedProof(ick, entry)
+	}
+	return nil
+}
+
+//Form a request to follow the interest in a namespace, signed by the router
+//entity
+func (am *AuthModule) FormInterestRequest(namespace []byte, routerID string) (*pb.PeerInterestParams, wve.WVE) {
+	bk := bcacheKey{}
+	copy(bk.Namespace[:], namespace)
+	copy(bk.Target[:], am.perspectiveHash)
+	policyhash := sha3.New256()
+	policyhash.Write([]byte(WAVEMQInterest))
+	policyhash.Write([]byte("onuri=*"))
+	copy(bk.PolicyHash[:], policyhash.Sum(nil))
+
+	var proofder []byte
+	cachedproof, ok := am.bcache.Get(bk).(*bcacheItem)
+	if ok && cachedproof.CacheExpiry.After(time.Now()) {
+		if !cachedproof.Valid {
+			return nil, wve.Err(wve.NoProofFound, "we've cached that there is no proof for this")
+		}
+		proofder = cachedproof.DER
+	} else {
+		proofresp, err := am.wave.BuildRTreeProof(context.Background(), &eapipb.BuildRTreeProofParams{
+			Perspective: am.ourPerspective,
+			Namespace:   namespace,
+			Statements: []*eapipb.RTreePolicyStatement{
+				{
+					PermissionSet: []byte(WAVEMQPermissionSet),
+					Permissions:   []string{WAVEMQInterest},
+					Resource:      "*",
+				},
+			},
+			ResyncFirst: true,
+		})
+		if err != nil {
+			return nil, wve.ErrW(wve.NoProofFound, "failed to build", err)
+		}
+		if proofresp.Error != nil {
+			ci := &bcacheItem{
+				CacheExpiry: time.Now().Add(FailedProofCacheTime),
+				Valid:       false,
+			}
+			if docaching {
+				am.bcache.Put(bk, ci)
+			}
+			return nil, wve.Err(wve.NoProofFound, proofresp.Error.Message)
+		}
+		ci := &bcacheItem{
+			CacheExpiry: time.Now().Add(SuccessfulProofCacheTime),
+			Valid:       true,
+			DER:         proofresp.ProofDER,
+			ProofExpiry: time.Unix(0, proofresp.Result.Expiry*1e6),
+		}
+		if ci.ProofExpiry.Before(ci.CacheExpiry) {
+			ci.CacheExpiry = ci.ProofExpiry
+		}
+		if docaching {
+			am.bcache.Put(bk, ci)
+		}
+		proofder = proofresp.ProofDER
+	}
+
+	hash := sha3.New256()
+	hash.Write(namespace)
+	hash.Write([]byte(routerID))
+	digest := hash.Sum(nil)
+
+	signresp, err := am.wave.Sign(context.Background(), &eapipb.SignParams{
+		Perspective: am.ourPerspective,
+		Content:     digest,
+	})
+	if err != nil {
+		return nil, wve.ErrW(wve.InvalidSignature, "failed to sign", err)
+	}
+	if signresp.Error != nil {
+		return nil, wve.Err(wve.InvalidSignature, signresp.Error.Message)
+	}
+
+	return &pb.PeerInterestParams{
+		Namespace:    namespace,
+		RouterID:     routerID,
+		SourceEntity: am.perspectiveHash,
+		Signature:    signresp.Signature,
+		ProofDER:     proofder,
+	}, nil
+}
+
 func (am *AuthModule) VerifyServerHandshake(nsString string, entityHash []byte, signature []byte, proof []byte, cert []byte) error {
 	//First verify the signature
 	resp, err := am.wave.VerifySignature(context.Background(), &eapipb.VerifySignatureParams{
@@ -9,6 +9,7 @@ import (
 	"github.com/immesys/wave/eapi/pb"
 	"github.com/immesys/wave/waved"
 	"github.com/immesys/wavemq/mqpb"
+	rocksdb "github.com/immesys/wavemq/rockstorage"
 	"github.com/stretchr/testify/require"
 )
 
@@ -23,6 +24,10 @@ func getam() *AuthModule {
 	rv.Storage["default"]["provider"] = "http_v1"
 	rv.Storage["default"]["url"] = "https://standalone.storage.bwave.io/v1"
 	rv.Storage["default"]["version"] = "1"
+	//The auth module restores validated proofs from the database
+	rocksdb.Initialize(rocksdb.StorageConfig{
+		Engine: rocksdb.EngineMemory,
+	})
 	am, err := NewAuthModule(rv)
 	if err != nil {
 		panic(err)
@@ -0,0 +1,172 @@
+package core
+
+import (
+	"context"
+	"encoding/base64"
+	"sync"
+	"time"
+
+	"github.com/creachadair/cityhash"
+	pb "github.com/immesys/wavemq/mqpb"
+	"github.com/prometheus/client_golang/prometheus"
+)
+
+//Local subscriptions to the same URI with the same proof share a single
+//peer subscription to the designated router. Messages received on it are
+//enqueued on every member's queue. The peer subscription lasts until the
+//last member's queue is gone. Its request is formed from the members each
+//time it connects, see upstreamGroup.request
+
+//Some instrumentation
+var pmSharedUpstreamSubscriptions = prometheus.NewGauge(prometheus.GaugeOpts{
+	Subsystem: "route",
+	Name:      "shared_upstream_subscriptions",
+	Help:      "Number of peer subscriptions to designated routers",
+})
+var pmSharedUpstreamMembers = prometheus.NewGauge(prometheus.GaugeOpts{
+	Subsystem: "route",
+	Name:      "shared_upstream_members",
+	Help:      "Number of local subscriptions served by peer subscriptions to designated routers",
+})
+
+func init() {
+	prometheus.MustRegister(pmSharedUpstreamSubscriptions)
+	prometheus.MustRegister(pmSharedUpstreamMembers)
+}
+
+type upstreamGroupKey struct {
+	Namespace string
+	URI       string
+	ProofLow  uint64
+	ProofHigh uint64
+}
+
+type upstreamGroup struct {
+	key upstreamGroupKey
+	//Cancelled when the last member leaves
+	ctx    context.Context
+	cancel context.CancelFunc
+
+	mu      sync.RWMutex
+	members map[*Queue]struct{}
+	//The member whose request the peer subscription uses, and a function
+	//that ends the current peer subscription so that it is formed again
+	owner   *Queue
+	restart context.CancelFunc
+}
+
+func mkUpstreamGroupKey(req *pb.PeerSubscribeParams) upstreamGroupKey {
+	k := upstreamGroupKey{
+		Namespace: base64.URLEncoding.EncodeToString(req.Tbs.Namespace),
+		URI:       req.Tbs.Uri,
+	}
+	k.ProofLow, k.ProofHigh = cityhash.Hash128(req.ProofDER)
+	return k
+}
+
+//Add a local delivery queue to the group for its subscription, creating
+//the group and starting its peer subscription if there is none
+func (t *Terminus) joinUpstreamGroup(q *Queue) {
+	req := q.GetSubRequest()
+	k := mkUpstreamGroupKey(req)
+	t.upstreamGroupsMu.Lock()
+	g, ok := t.upstreamGroups[k]
+	if !ok {
+		ctx, cancel := context.WithCancel(context.Background())
+		g = &upstreamGroup{
+			key:     k,
+			ctx:     ctx,
+			cancel:  cancel,
+			members: make(map[*Queue]struct{}),
+		}
+		t.upstreamGroups[k] = g
+		pmSharedUpstreamSubscriptions.Set(float64(len(t.upstreamGroups)))
+	}
+	g.mu.Lock()
+	g.members[q] = struct{}{}
+	g.mu.Unlock()
+	t.upstreamGroupsMu.Unlock()
+	pmSharedUpstreamMembers.Inc()
+
+	if !ok {
+		go t.upstreamGroupPeering(g)
+	}
+	go func() {
+		<-q.Ctx.Done()
+		t.leaveUpstreamGroup(g, q)
+	}()
+}
+
+//Remove a queue from its group, ending the peer subscription if it was
+//the last member
+func (t *Terminus) leaveUpstreamGroup(g *upstreamGroup, q *Queue) {
+	t.upstreamGroupsMu.Lock()
+	g.mu.Lock()
+	delete(g.members, q)
+	empty := len(g.members) == 0
+	if !empty && g.owner == q && g.restart != nil {
+		//The designated router's queue belongs to this member, move the
+		//peer subscription to one that is still here
+		g.restart()
+	}
+	g.mu.Unlock()
+	if empty {
+		delete(t.upstreamGroups, g.key)
+		pmSharedUpstreamSubscriptions.Set(float64(len(t.upstreamGroups)))
+		g.cancel()
+	}
+	t.upstreamGroupsMu.Unlock()
+	pmSharedUpstreamMembers.Dec()
+}
+
+//Form the request for the peer subscription from the live members. The
+//subscription ID is signed by its member, so the group cannot have its own.
+//It takes the request of the member with the lowest subscription ID, out
+//of those whose requests have not expired. The same members give the same
+//request after a restart, so the designated router's queue is picked up
+//again rather than left to expire. The queue expiry is not signed, the
+//designated router keeps the queue as long as any member asked for
+func (g *upstreamGroup) request() *pb.PeerSubscribeParams {
+	g.mu.Lock()
+	defer g.mu.Unlock()
+	nw := time.Now().UnixNano()
+	var owner *Queue
+	var ownerReq *pb.PeerSubscribeParams
+	var ownerID ID
+	ownerLive := false
+	var expiry int64
+	for q := range g.members {
+		if q.Ctx.Err() != nil {
+			continue
+		}
+		req := q.GetSubRequest()
+		if req.Tbs.Expiry > expiry {
+			expiry = req.Tbs.Expiry
+		}
+		live := req.AbsoluteExpiry == 0 || req.AbsoluteExpiry > nw
+		id := toSubID(req.Tbs.SourceEntity, req.Tbs.Id)
+		if owner == nil || (live && !ownerLive) || (live == ownerLive && id < ownerID) {
+			owner, ownerReq, ownerID, ownerLive = q, req, id, live
+		}
+	}
+	g.owner = owner
+	if owner == nil {
+		return nil
+	}
+	rv := *ownerReq
+	tbs := *ownerReq.Tbs
+	tbs.Expiry = expiry
+	rv.Tbs = &tbs
+	return &rv
+}
+
+//Enqueue messages received on the peer subscription on every member
+func (g *upstreamGroup) deliver(msgs []*pb.Message) {
+	g.mu.RLock()
+	defer g.mu.RUnlock()
+	for q := range g.members {
+		if q.Ctx.Err() == nil {
+			q.EnqueueBatch(msgs)
+		}
+	}
+}
@@ -0,0 +1,30 @@
+package core
+
+import (
+	rocksdb "github.com/immesys/wavemq/rockstorage"
+	"github.com/prometheus/client_golang/prometheus"
+)
+
+//The compression ratio achieved for each column family, computed from the
+//SST file properties when scraped
+func init() {
+	for name, col := range map[string]rocksdb.Column{
+		"queue":   rocksdb.QUEUE,
+		"persist": rocksdb.PERSIST,
+		"proof":   rocksdb.PROOF,
+	} {
+		col := col
+		prometheus.MustRegister(prometheus.NewGaugeFunc(prometheus.GaugeOpts{
+			Subsystem:   "storage",
+			Name:        "compression_ratio",
+			Help:        "Uncompressed size of the stored data divided by its size on disk",
+			ConstLabels: prometheus.Labels{"column": name},
+		}, func() float64 {
+			raw, stored, ok := rocksdb.CompressionStats(col)
+			if !ok || stored == 0 {
+				return 1
+			}
+			return float64(raw) / float64(stored)
+		}))
+	}
+}
@@ -0,0 +1,244 @@
+package core
+
+import (
+	"sync"
+	"sync/atomic"
+
+	"github.com/prometheus/client_golang/prometheus"
+)
+
+//The number of independently locked shards in the publish match cache.
+//Must be a power of two
+const matchCacheShards = 64
+
+//The maximum number of topics whose matching subscriptions are cached.
+//A shard that fills up is cleared
+const MatchCacheMaxEntries = 64 * 1024
+
+//Some instrumentation
+var pmMatchCacheHits = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "matchcache",
+	Name:      "hits",
+	Help:      "Number of published topics whose subscriptions were found in the cache",
+})
+var pmMatchCacheMisses = prometheus.NewCounter(prometheus.CounterOpts{
+	Subsystem: "matchcache",
+	Name:      "misses",
+	Help:      "Number of published topics matched against the subscription tree",
+})
+
+func init() {
+	prometheus.MustRegister(pmMatchCacheHits)
+	prometheus.MustRegister(pmMatchCacheMisses)
+}
+
+//An interned topic token. Subscription tree children are keyed by these so
+//that matching a topic does not hash every token at every level
+type tokenID uint32
+
+const (
+	//A token that does not appear in any subscription, it can only be
+	//matched by wildcards
+	tokenUnknown tokenID = iota
+	tokenPlus
+	tokenStar
+	firstLiteralToken
+)
+
+//Maps topic tokens onto tokenIDs. Tokens are interned when a subscription
+//is added and are never released, so the table is bounded by the number of
+//distinct tokens ever subscribed to
+type tokenTable struct {
+	mu   sync.RWMutex
+	ids  map[string]tokenID
+	next tokenID
+}
+
+func newTokenTable() *tokenTable {
+	return &tokenTable{
+		ids: map[string]tokenID{
+			"+": tokenPlus,
+			"*": tokenStar,
+		},
+		next: firstLiteralToken,
+	}
+}
+
+//Split a subscription topic into tokens, interning any new ones
+func (tt *tokenTable) intern(topic string) []tokenID {
+	rv := make([]tokenID, 0, countTokens(topic))
+	tt.mu.Lock()
+	forEachToken(topic, func(tok string) {
+		id, ok := tt.ids[tok]
+		if !ok {
+			id = tt.next
+			tt.next++
+			tt.ids[tok] = id
+		}
+		rv = append(rv, id)
+	})
+	tt.mu.Unlock()
+	return rv
+}
+
+//Split a published topic into tokens. Tokens that no subscription uses
+//become tokenUnknown rather than growing the table
+func (tt *tokenTable) lookup(topic string) []tokenID {
+	rv := make([]tokenID, 0, countTokens(topic))
+	tt.mu.RLock()
+	forEachToken(topic, func(tok string) {
+		rv = append(rv, tt.ids[tok])
+	})
+	tt.mu.RUnlock()
+	return rv
+}
+
+func countTokens(topic string) int {
+	n := 1
+	for i := 0; i < len(topic); i++ {
+		if topic[i] == '/' {
+			n++
+		}
+	}
+	return n
+}
+
+//Equivalent to ranging over strings.Split(topic, "/") without allocating
+func forEachToken(topic string, visit func(tok string)) {
+	start := 0
+	for i := 0; i < len(topic); i++ {
+		if topic[i] == '/' {
+			visit(topic[start:i])
+			start = i + 1
+		}
+	}
+	visit(topic[start:])
+}
+
+//A node and a token position that has already been matched
+type matchState struct {
+	node *subTreeNode
+	pos  int
+}
+
+type matcher struct {
+	toks []tokenID
+	//Allocated when the first * is entered. A * can reach the same node at
+	//the same position along several paths, this stops us revisiting it
+	//(which would also deliver the message twice)
+	seen map[matchState]struct{}
+	rv   []*subscription
+}
+
+//Return every subscription at or below this node that matches the tokens
+func (s *subTreeNode) matchSubs(toks []tokenID) []*subscription {
+	m := &matcher{toks: toks}
+	m.walk(s, 0)
+	return m.rv
+}
+
+func (m *matcher) walk(s *subTreeNode, pos int) {
+	if m.seen != nil {
+		st := matchState{node: s, pos: pos}
+		if _, ok := m.seen[st]; ok {
+			return
+		}
+		m.seen[st] = struct{}{}
+	}
+	n := s.v.Load().(subTreeNodeValue)
+	if pos == len(m.toks) {
+		for _, sub := range n.subz {
+			m.rv = append(m.rv, sub)
+		}
+		return
+	}
+	tok := m.toks[pos]
+	if tok >= firstLiteralToken {
+		if c, ok := n.children[tok]; ok {
+			m.walk(c, pos+1)
+		}
+	}
+	if c, ok := n.children[tokenPlus]; ok {
+		m.walk(c, pos+1)
+	}
+	if c, ok := n.children[tokenStar]; ok {
+		if m.seen == nil {
+			m.seen = make(map[matchState]struct{})
+		}
+		//* matches zero or more tokens
+		for i := pos; i <= len(m.toks); i++ {
+			m.walk(c, i)
+		}
+	}
+}
+
+//Caches the subscriptions matching a published topic. Entries are tagged
+//with the subscription generation they were computed at and are ignored
+//once any subscription is added or removed
+type matchCache struct {
+	//Incremented after every change to the subscription tree
+	generation uint64
+	shards     [matchCacheShards]matchCacheShard
+}
+
+type matchCacheShard struct {
+	mu      sync.RWMutex
+	entries map[string]matchCacheEntry
+}
+
+type matchCacheEntry struct {
+	generation uint64
+	subs       []*subscription
+}
+
+func newMatchCache() *matchCache {
+	rv := &matchCache{}
+	for i := range rv.shards {
+		rv.shards[i].entries = make(map[string]matchCacheEntry)
+	}
+	return rv
+}
+
+func (c *matchCache) shard(topic string) *matchCacheShard {
+	//FNV-1a, inline to avoid converting the topic to a byte slice
+	h := uint64(14695981039346656037)
+	for i := 0; i < len(topic); i++ {
+		h ^= uint64(topic[i])
+		h *= 1099511628211
+	}
+	return &c.shards[h&(matchCacheShards-1)]
+}
+
+//Invalidate all cached matches, call after the subscription tree changes
+func (c *matchCache) Invalidate() {
+	atomic.AddUint64(&c.generation, 1)
+}
+
+//Return the cached subscriptions for the topic, calling match to compute
+//them if there are none for the current generation. The returned slice is
+//shared and must not be modified
+func (c *matchCache) Get(topic string, match func() []*subscription) []*subscription {
+	//The generation must be loaded before the tree is read so that a
+	//concurrent change leaves us with an entry that is already stale
+	gen := atomic.LoadUint64(&c.generation)
+	s := c.shard(topic)
+	s.mu.RLock()
+	e, ok := s.entries[topic]
+	s.mu.RUnlock()
+	if ok && e.generation == gen {
+		pmMatchCacheHits.Add(1)
+		return e.subs
+	}
+	pmMatchCacheMisses.Add(1)
+	subs := match()
+	s.mu.Lock()
+	if len(s.entries) >= MatchCacheMaxEntries/matchCacheShards {
+		s.entries = make(map[string]matchCacheEntry)
+	}
+	s.entries[topic] = matchCacheEntry{
+		generation: gen,
+		subs:       subs,
+	}
+	s.mu.Unlock()
+	return subs
+}
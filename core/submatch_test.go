@@ -0,0 +1,150 @@
+package core
+
+import (
+	"fmt"
+	"sort"
+	"testing"
+
+	"github.com/stretchr/testify/require"
+)
+
+func mkstree(tt *tokenTable, uris ...string) *subTreeNode {
+	root := newSnode()
+	for _, uri := range uris {
+		root.addSub(tt.intern(uri), &subscription{
+			subid: ID(uri),
+			uri:   uri,
+		})
+	}
+	return root
+}
+
+func matchedURIs(tt *tokenTable, root *subTreeNode, topic string) []string {
+	rv := []string{}
+	for _, s := range root.matchSubs(tt.lookup(topic)) {
+		rv = append(rv, s.uri)
+	}
+	sort.Strings(rv)
+	return rv
+}
+
+func TestMatchSubs(t *testing.T) {
+	tt := newTokenTable()
+	root := mkstree(tt, "ns/a/b", "ns/+/b", "ns/*", "ns/a/*/c", "ns/*/*", "ns/a", "other/a/b")
+	require.Equal(t, []string{"ns/*", "ns/*/*", "ns/+/b", "ns/a/b"}, matchedURIs(tt, root, "ns/a/b"))
+	require.Equal(t, []string{"ns/*", "ns/*/*", "ns/a/*/c"}, matchedURIs(tt, root, "ns/a/x/y/c"))
+	require.Equal(t, []string{"ns/*", "ns/*/*", "ns/a"}, matchedURIs(tt, root, "ns/a"))
+	require.Equal(t, []string{"ns/*", "ns/*/*"}, matchedURIs(tt, root, "ns/never/subscribed"))
+	require.Equal(t, []string{}, matchedURIs(tt, root, "missing/a/b"))
+	//Publishing must not intern tokens
+	_, ok := tt.ids["never"]
+	require.False(t, ok)
+}
+
+func TestMatchCacheInvalidation(t *testing.T) {
+	c := newMatchCache()
+	calls := 0
+	match := func() []*subscription {
+		calls++
+		return nil
+	}
+	c.Get("ns/a/b", match)
+	c.Get("ns/a/b", match)
+	require.Equal(t, 1, calls)
+	c.Invalidate()
+	c.Get("ns/a/b", match)
+	require.Equal(t, 2, calls)
+}
+
+func TestBuildSubTree(t *testing.T) {
+	uris := []string{"ns/a/b", "ns/+/b", "ns/*", "ns/a/*/c", "ns/*/*", "ns/a", "ns/a", "other/a/b"}
+	subs := []*subscription{}
+	for i, uri := range uris {
+		subs = append(subs, &subscription{
+			subid: ID(fmt.Sprintf("sub%d", i)),
+			uri:   uri,
+		})
+	}
+	tt := newTokenTable()
+	root, rstree := buildSubTree(tt, subs)
+	require.Equal(t, len(subs), len(rstree))
+	for _, sub := range subs {
+		require.Equal(t, sub, rstree[sub.subid].v.Load().(subTreeNodeValue).subz[sub.subid])
+	}
+	incremental := mkstree(tt, uris...)
+	for _, topic := range []string{"ns/a/b", "ns/a/x/y/c", "ns/a", "other/a/b", "other/a"} {
+		built := []string{}
+		for _, s := range root.matchSubs(tt.lookup(topic)) {
+			built = append(built, s.uri)
+		}
+		sort.Strings(built)
+		expected := matchedURIs(tt, incremental, topic)
+		if topic == "ns/a" {
+			//There are two subscriptions to ns/a
+			expected = append(expected, "ns/a")
+			sort.Strings(expected)
+		}
+		require.Equal(t, expected, built)
+	}
+	//The built tree can still be added to
+	root.addSub(tt.intern("ns/a/b"), &subscription{subid: "late", uri: "late"})
+	require.Contains(t, matchedURIs(tt, root, "ns/a/b"), "late")
+}
+
+//Returns 1M subscriptions shaped like sensor telemetry,
+//ns/site/building/device/sensor, with a mix of wildcard subscriptions
+func mkBenchSubs() []*subscription {
+	rv := make([]*subscription, 0, 1000000)
+	for i := 0; i < 1000000; i++ {
+		var uri string
+		//r varies fastest in the site, so every site sees every pattern
+		r := i / 20
+		site, bld := r%20, (r/20)%50
+		switch i % 20 {
+		case 0:
+			uri = fmt.Sprintf("ns/site%d/bld%d/+/sensor%d", site, bld, (r/1000)%10)
+		case 1:
+			uri = fmt.Sprintf("ns/site%d/bld%d/*", site, bld)
+		case 2:
+			uri = fmt.Sprintf("ns/site%d/*/sensor%d", site, (r/20)%10)
+		default:
+			uri = fmt.Sprintf("ns/site%d/bld%d/dev%d/sensor%d", site, bld, (r/1000)%100, (r/100000)%10)
+		}
+		rv = append(rv, &subscription{
+			subid: ID(fmt.Sprintf("sub%d", i)),
+			uri:   uri,
+		})
+	}
+	return rv
+}
+
+func BenchmarkBuildSubTree100k(b *testing.B) {
+	subs := mkBenchSubs()[:100000]
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		buildSubTree(newTokenTable(), subs)
+	}
+}
+
+func BenchmarkMatchSubs1M(b *testing.B) {
+	tt := newTokenTable()
+	root, _ := buildSubTree(tt, mkBenchSubs())
+	topics := make([]string, 1024)
+	for i := range topics {
+		topics[i] = fmt.Sprintf("ns/site%d/bld%d/dev%d/sensor%d", i%20, (i*7)%50, (i*13)%100, i%10)
+	}
+	b.Run("tree", func(b *testing.B) {
+		for i := 0; i < b.N; i++ {
+			root.matchSubs(tt.lookup(topics[i&1023]))
+		}
+	})
+	b.Run("cached", func(b *testing.B) {
+		c := newMatchCache()
+		for i := 0; i < b.N; i++ {
+			topic := topics[i&1023]
+			c.Get(topic, func() []*subscription {
+				return root.matchSubs(tt.lookup(topic))
+			})
+		}
+	})
+}
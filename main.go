@@ -110,5 +110,6 @@ func main() {
 	signal.Notify(sigchan, os.Interrupt, syscall.SIGTERM, syscall.SIGINT)
 	<-sigchan
 	fmt.Printf("SHUTTING DOWN\n")
+	tm.Shutdown()
 	qm.Shutdown()
 }
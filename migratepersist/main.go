@@ -0,0 +1,37 @@
+package main
+
+import (
+	"fmt"
+	"os"
+
+	"github.com/BurntSushi/toml"
+	"github.com/immesys/wavemq/core"
+	rocksdb "github.com/immesys/wavemq/rockstorage"
+)
+
+//Convert the persisted messages of a store written by an older version of
+//wavemq so that each message is only stored once. It takes the same
+//configuration file as the router and can be run before starting it
+type Configuration struct {
+	StorageConfig rocksdb.StorageConfig
+}
+
+func main() {
+	if len(os.Args) != 2 {
+		fmt.Printf("usage: migratepersist config.toml\n")
+		os.Exit(1)
+	}
+	var conf Configuration
+	if _, err := toml.DecodeFile(os.Args[1], &conf); err != nil {
+		fmt.Printf("failed to load configuration: %v\n", err)
+		os.Exit(1)
+	}
+	rocksdb.Initialize(conf.StorageConfig)
+	migrated, err := core.MigratePersistedMessages()
+	rocksdb.Close()
+	if err != nil {
+		fmt.Printf("migration failed after %d messages: %v\n", migrated, err)
+		os.Exit(1)
+	}
+	fmt.Printf("migrated %d persisted messages\n", migrated)
+}
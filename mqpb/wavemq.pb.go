@@ -31,6 +31,8 @@ It has these top-level messages:
 	Payload
 	SubscribeParams
 	SubscriptionMessage
+	PeerInterestParams
+	InterestUpdate
 	CompactProofParams
 	CompactProofResponse
 	RevokeParams
@@ -153,6 +155,11 @@ type QueryParams struct {
 	Uri         string       `protobuf:"bytes,3,opt,name=uri" json:"uri,omitempty"`
 	// If specified, this proof will be used instead of building one
 	CustomProofDER []byte `protobuf:"bytes,4,opt,name=customProofDER,proto3" json:"customProofDER,omitempty"`
+	// If greater than zero, at most this many messages are returned
+	Limit int32 `protobuf:"varint,5,opt,name=limit" json:"limit,omitempty"`
+	// If specified, the query continues from the end of the page this cursor
+	// was returned with
+	Cursor []byte `protobuf:"bytes,6,opt,name=cursor,proto3" json:"cursor,omitempty"`
 }
 
 func (m *QueryParams) Reset()                    { *m = QueryParams{} }
@@ -188,9 +195,26 @@ func (m *QueryParams) GetCustomProofDER() []byte {
 	return nil
 }
 
+func (m *QueryParams) GetLimit() int32 {
+	if m != nil {
+		return m.Limit
+	}
+	return 0
+}
+
+func (m *QueryParams) GetCursor() []byte {
+	if m != nil {
+		return m.Cursor
+	}
+	return nil
+}
+
 type QueryMessage struct {
 	Error   *Error   `protobuf:"bytes,1,opt,name=error" json:"error,omitempty"`
 	Message *Message `protobuf:"bytes,2,opt,name=message" json:"message,omitempty"`
+	// If there are more results, a page ends with a message that carries
+	// only this. Pass it in QueryParams.cursor to get the next page
+	Cursor []byte `protobuf:"bytes,3,opt,name=cursor,proto3" json:"cursor,omitempty"`
 }
 
 func (m *QueryMessage) Reset()                    { *m = QueryMessage{} }
@@ -212,12 +236,22 @@ func (m *QueryMessage) GetMessage() *Message {
 	return nil
 }
 
+func (m *QueryMessage) GetCursor() []byte {
+	if m != nil {
+		return m.Cursor
+	}
+	return nil
+}
+
 type PeerQueryParams struct {
 	SourceEntity []byte `protobuf:"bytes,1,opt,name=sourceEntity,proto3" json:"sourceEntity,omitempty"`
 	Namespace    []byte `protobuf:"bytes,2,opt,name=namespace,proto3" json:"namespace,omitempty"`
 	Uri          string `protobuf:"bytes,3,opt,name=uri" json:"uri,omitempty"`
 	Signature    []byte `protobuf:"bytes,4,opt,name=signature,proto3" json:"signature,omitempty"`
 	ProofDER     []byte `protobuf:"bytes,5,opt,name=proofDER,proto3" json:"proofDER,omitempty"`
+	// As in QueryParams
+	Limit  int32  `protobuf:"varint,6,opt,name=limit" json:"limit,omitempty"`
+	Cursor []byte `protobuf:"bytes,7,opt,name=cursor,proto3" json:"cursor,omitempty"`
 }
 
 func (m *PeerQueryParams) Reset()                    { *m = PeerQueryParams{} }
@@ -260,6 +294,20 @@ func (m *PeerQueryParams) GetProofDER() []byte {
 	return nil
 }
 
+func (m *PeerQueryParams) GetLimit() int32 {
+	if m != nil {
+		return m.Limit
+	}
+	return 0
+}
+
+func (m *PeerQueryParams) GetCursor() []byte {
+	if m != nil {
+		return m.Cursor
+	}
+	return nil
+}
+
 type PeerUnsubscribeParams struct {
 	SourceEntity []byte `protobuf:"bytes,1,opt,name=sourceEntity,proto3" json:"sourceEntity,omitempty"`
 	Id           string `protobuf:"bytes,2,opt,name=id" json:"id,omitempty"`
@@ -399,6 +447,10 @@ type PeerSubscribeParams struct {
 	// This is a unix timestamp in nanoseconds that this subscription should
 	// expire at
 	AbsoluteExpiry int64 `protobuf:"varint,4,opt,name=absoluteExpiry" json:"absoluteExpiry,omitempty"`
+	// If greater than one, the peer may pack up to this many messages into
+	// the messages field of a single SubscriptionMessage. Zero means the
+	// subscriber only understands the message field
+	MaxBatchMessages int32 `protobuf:"varint,5,opt,name=maxBatchMessages" json:"maxBatchMessages,omitempty"`
 }
 
 func (m *PeerSubscribeParams) Reset()                    { *m = PeerSubscribeParams{} }
@@ -434,6 +486,13 @@ func (m *PeerSubscribeParams) GetAbsoluteExpiry() int64 {
 	return 0
 }
 
+func (m *PeerSubscribeParams) GetMaxBatchMessages() int32 {
+	if m != nil {
+		return m.MaxBatchMessages
+	}
+	return 0
+}
+
 type PublishParams struct {
 	Perspective *Perspective     `protobuf:"bytes,1,opt,name=perspective" json:"perspective,omitempty"`
 	Namespace   []byte           `protobuf:"bytes,2,opt,name=namespace,proto3" json:"namespace,omitempty"`
@@ -745,6 +804,10 @@ type SubscribeParams struct {
 	// What absolute time (nanoseconds UTC) should this subscription expire at
 	// This is not normally used
 	AbsoluteExpiry int64 `protobuf:"varint,7,opt,name=absoluteExpiry" json:"absoluteExpiry,omitempty"`
+	// If greater than one, the router may pack up to this many messages into
+	// the messages field of a single SubscriptionMessage. Zero means the
+	// client only understands the message field
+	MaxBatchMessages int32 `protobuf:"varint,8,opt,name=maxBatchMessages" json:"maxBatchMessages,omitempty"`
 }
 
 func (m *SubscribeParams) Reset()                    { *m = SubscribeParams{} }
@@ -801,9 +864,19 @@ func (m *SubscribeParams) GetAbsoluteExpiry() int64 {
 	return 0
 }
 
+func (m *SubscribeParams) GetMaxBatchMessages() int32 {
+	if m != nil {
+		return m.MaxBatchMessages
+	}
+	return 0
+}
+
 type SubscriptionMessage struct {
 	Error   *Error   `protobuf:"bytes,1,opt,name=error" json:"error,omitempty"`
 	Message *Message `protobuf:"bytes,2,opt,name=message" json:"message,omitempty"`
+	// Only populated if the subscriber asked for batches. These are in queue
+	// order and come after message, if that is also set
+	Messages []*Message `protobuf:"bytes,3,rep,name=messages" json:"messages,omitempty"`
 }
 
 func (m *SubscriptionMessage) Reset()                    { *m = SubscriptionMessage{} }
@@ -825,6 +898,117 @@ func (m *SubscriptionMessage) GetMessage() *Message {
 	return nil
 }
 
+func (m *SubscriptionMessage) GetMessages() []*Message {
+	if m != nil {
+		return m.Messages
+	}
+	return nil
+}
+
+type PeerInterestParams struct {
+	Namespace []byte `protobuf:"bytes,1,opt,name=namespace,proto3" json:"namespace,omitempty"`
+	// Subscriptions that deliver to this router are not reported back to it
+	RouterID string `protobuf:"bytes,2,opt,name=routerID" json:"routerID,omitempty"`
+	// The router entity, which must be granted the interest permission on the
+	// namespace. It signs the namespace and routerID
+	SourceEntity []byte `protobuf:"bytes,3,opt,name=sourceEntity,proto3" json:"sourceEntity,omitempty"`
+	Signature    []byte `protobuf:"bytes,4,opt,name=signature,proto3" json:"signature,omitempty"`
+	ProofDER     []byte `protobuf:"bytes,5,opt,name=proofDER,proto3" json:"proofDER,omitempty"`
+}
+
+func (m *PeerInterestParams) Reset()                    { *m = PeerInterestParams{} }
+func (m *PeerInterestParams) String() string            { return proto.CompactTextString(m) }
+func (*PeerInterestParams) ProtoMessage()               {}
+func (*PeerInterestParams) Descriptor() ([]byte, []int) { return fileDescriptor0, []int{20} }
+
+func (m *PeerInterestParams) GetNamespace() []byte {
+	if m != nil {
+		return m.Namespace
+	}
+	return nil
+}
+
+func (m *PeerInterestParams) GetRouterID() string {
+	if m != nil {
+		return m.RouterID
+	}
+	return ""
+}
+
+func (m *PeerInterestParams) GetSourceEntity() []byte {
+	if m != nil {
+		return m.SourceEntity
+	}
+	return nil
+}
+
+func (m *PeerInterestParams) GetSignature() []byte {
+	if m != nil {
+		return m.Signature
+	}
+	return nil
+}
+
+func (m *PeerInterestParams) GetProofDER() []byte {
+	if m != nil {
+		return m.ProofDER
+	}
+	return nil
+}
+
+type InterestUpdate struct {
+	Error *Error `protobuf:"bytes,1,opt,name=error" json:"error,omitempty"`
+	// If true, forget all previously reported patterns before applying this
+	// update
+	Reset_ bool `protobuf:"varint,2,opt,name=reset" json:"reset,omitempty"`
+	// Subscribed URI patterns (without the namespace) that gained interest
+	Added []string `protobuf:"bytes,3,rep,name=added" json:"added,omitempty"`
+	// URI patterns that no longer have any interest
+	Removed []string `protobuf:"bytes,4,rep,name=removed" json:"removed,omitempty"`
+	// If true, more of the initial set of patterns follows in later updates
+	More bool `protobuf:"varint,5,opt,name=more" json:"more,omitempty"`
+}
+
+func (m *InterestUpdate) Reset()                    { *m = InterestUpdate{} }
+func (m *InterestUpdate) String() string            { return proto.CompactTextString(m) }
+func (*InterestUpdate) ProtoMessage()               {}
+func (*InterestUpdate) Descriptor() ([]byte, []int) { return fileDescriptor0, []int{21} }
+
+func (m *InterestUpdate) GetError() *Error {
+	if m != nil {
+		return m.Error
+	}
+	return nil
+}
+
+func (m *InterestUpdate) GetReset_() bool {
+	if m != nil {
+		return m.Reset_
+	}
+	return false
+}
+
+func (m *InterestUpdate) GetAdded() []string {
+	if m != nil {
+		return m.Added
+	}
+	return nil
+}
+
+func (m *InterestUpdate) GetRemoved() []string {
+	if m != nil {
+		return m.Removed
+	}
+	return nil
+}
+
+func (m *InterestUpdate) GetMore() bool {
+	if m != nil {
+		return m.More
+	}
+	return false
+}
+
 func init() {
 	proto.RegisterType((*ConnectionStatusParams)(nil), "mqpb.ConnectionStatusParams")
 	proto.RegisterType((*ConnectionStatusResponse)(nil), "mqpb.ConnectionStatusResponse")
@@ -846,6 +1030,8 @@ func init() {
 	proto.RegisterType((*Payload)(nil), "mqpb.Payload")
 	proto.RegisterType((*SubscribeParams)(nil), "mqpb.SubscribeParams")
 	proto.RegisterType((*SubscriptionMessage)(nil), "mqpb.SubscriptionMessage")
+	proto.RegisterType((*PeerInterestParams)(nil), "mqpb.PeerInterestParams")
+	proto.RegisterType((*InterestUpdate)(nil), "mqpb.InterestUpdate")
 }
 
 // Reference imports to suppress errors if they are not otherwise used.
@@ -1081,6 +1267,7 @@ type WAVEMQPeeringClient interface {
 	PeerSubscribe(ctx context.Context, in *PeerSubscribeParams, opts ...grpc.CallOption) (WAVEMQPeering_PeerSubscribeClient, error)
 	PeerUnsubscribe(ctx context.Context, in *PeerUnsubscribeParams, opts ...grpc.CallOption) (*PeerUnsubscribeResponse, error)
 	PeerQueryRequest(ctx context.Context, in *PeerQueryParams, opts ...grpc.CallOption) (WAVEMQPeering_PeerQueryRequestClient, error)
+	PeerInterest(ctx context.Context, in *PeerInterestParams, opts ...grpc.CallOption) (WAVEMQPeering_PeerInterestClient, error)
 }
 
 type wAVEMQPeeringClient struct {
@@ -1173,6 +1360,38 @@ func (x *wAVEMQPeeringPeerQueryRequestClient) Recv() (*QueryMessage, error) {
 	return m, nil
 }
 
+func (c *wAVEMQPeeringClient) PeerInterest(ctx context.Context, in *PeerInterestParams, opts ...grpc.CallOption) (WAVEMQPeering_PeerInterestClient, error) {
+	stream, err := grpc.NewClientStream(ctx, &_WAVEMQPeering_serviceDesc.Streams[2], c.cc, "/mqpb.WAVEMQPeering/PeerInterest", opts...)
+	if err != nil {
+		return nil, err
+	}
+	x := &wAVEMQPeeringPeerInterestClient{stream}
+	if err := x.ClientStream.SendMsg(in); err != nil {
+		return nil, err
+	}
+	if err := x.ClientStream.CloseSend(); err != nil {
+		return nil, err
+	}
+	return x, nil
+}
+
+type WAVEMQPeering_PeerInterestClient interface {
+	Recv() (*InterestUpdate, error)
+	grpc.ClientStream
+}
+
+type wAVEMQPeeringPeerInterestClient struct {
+	grpc.ClientStream
+}
+
+func (x *wAVEMQPeeringPeerInterestClient) Recv() (*InterestUpdate, error) {
+	m := new(InterestUpdate)
+	if err := x.ClientStream.RecvMsg(m); err != nil {
+		return nil, err
+	}
+	return m, nil
+}
+
 // Server API for WAVEMQPeering service
 
 type WAVEMQPeeringServer interface {
@@ -1180,6 +1399,7 @@ type WAVEMQPeeringServer interface {
 	PeerSubscribe(*PeerSubscribeParams, WAVEMQPeering_PeerSubscribeServer) error
 	PeerUnsubscribe(context.Context, *PeerUnsubscribeParams) (*PeerUnsubscribeResponse, error)
 	PeerQueryRequest(*PeerQueryParams, WAVEMQPeering_PeerQueryRequestServer) error
+	PeerInterest(*PeerInterestParams, WAVEMQPeering_PeerInterestServer) error
 }
 
 func RegisterWAVEMQPeeringServer(s *grpc.Server, srv WAVEMQPeeringServer) {
@@ -1264,6 +1484,27 @@ func (x *wAVEMQPeeringPeerQueryRequestServer) Send(m *QueryMessage) error {
 	return x.ServerStream.SendMsg(m)
 }
 
+func _WAVEMQPeering_PeerInterest_Handler(srv interface{}, stream grpc.ServerStream) error {
+	m := new(PeerInterestParams)
+	if err := stream.RecvMsg(m); err != nil {
+		return err
+	}
+	return srv.(WAVEMQPeeringServer).PeerInterest(m, &wAVEMQPeeringPeerInterestServer{stream})
+}
+
+type WAVEMQPeering_PeerInterestServer interface {
+	Send(*InterestUpdate) error
+	grpc.ServerStream
+}
+
+type wAVEMQPeeringPeerInterestServer struct {
+	grpc.ServerStream
+}
+
+func (x *wAVEMQPeeringPeerInterestServer) Send(m *InterestUpdate) error {
+	return x.ServerStream.SendMsg(m)
+}
+
 var _WAVEMQPeering_serviceDesc = grpc.ServiceDesc{
 	ServiceName: "mqpb.WAVEMQPeering",
 	HandlerType: (*WAVEMQPeeringServer)(nil),
@@ -1288,6 +1529,11 @@ var _WAVEMQPeering_serviceDesc = grpc.ServiceDesc{
 			Handler:       _WAVEMQPeering_PeerQueryRequest_Handler,
 			ServerStreams: true,
 		},
+		{
+			StreamName:    "PeerInterest",
+			Handler:       _WAVEMQPeering_PeerInterest_Handler,
+			ServerStreams: true,
+		},
 	},
 	Metadata: "wavemq.proto",
 }
@@ -1295,70 +1541,81 @@ var _WAVEMQPeering_serviceDesc = grpc.ServiceDesc{
 func init() { proto.RegisterFile("wavemq.proto", fileDescriptor0) }
 
 var fileDescriptor0 = []byte{
-	// 1032 bytes of a gzipped FileDescriptorProto
-	0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0xff, 0xcc, 0x57, 0x5f, 0x6f, 0x1b, 0x45,
-	0x10, 0x97, 0xef, 0xec, 0xd8, 0x37, 0x76, 0xfe, 0x74, 0x43, 0xdb, 0x8b, 0x09, 0xc5, 0xdc, 0x03,
-	0x58, 0x20, 0xa2, 0xc8, 0x2d, 0x52, 0x91, 0x90, 0x50, 0x20, 0x16, 0x04, 0x88, 0x70, 0x37, 0x94,
-	0x4a, 0xbc, 0xad, 0xcf, 0xdb, 0x64, 0xab, 0xdc, 0xed, 0x65, 0x77, 0xaf, 0xe0, 0x77, 0x3e, 0x45,
-	0x5f, 0x78, 0xe1, 0x09, 0xc4, 0x87, 0xe0, 0x8b, 0x21, 0xb4, 0xbb, 0x77, 0xe7, 0xbb, 0xf3, 0x05,
-	0x1a, 0xa4, 0xa2, 0xbe, 0x79, 0x7f, 0x33, 0xbb, 0x3b, 0xfb, 0xfb, 0xcd, 0xcc, 0x8d, 0x61, 0xf0,
-	0x23, 0x79, 0x4e, 0xa3, 0xab, 0x83, 0x44, 0x70, 0xc5, 0x51, 0x3b, 0xba, 0x4a, 0xe6, 0x43, 0xa0,
-	0x24, 0x61, 0x16, 0x09, 0x7c, 0xb8, 0xf3, 0x39, 0x8f, 0x63, 0x1a, 0x2a, 0xc6, 0xe3, 0x33, 0x45,
-	0x54, 0x2a, 0x67, 0x44, 0x90, 0x48, 0x06, 0x73, 0xf0, 0xeb, 0x16, 0x4c, 0x65, 0xc2, 0x63, 0x49,
-	0xd1, 0x3d, 0x00, 0xc5, 0x15, 0xb9, 0x9c, 0x51, 0x2a, 0xa4, 0xdf, 0x1a, 0xb5, 0xc6, 0x1d, 0x5c,
-	0x42, 0xd0, 0xbb, 0xb0, 0x15, 0xda, 0xbd, 0x74, 0x61, 0x7d, 0x1c, 0xe3, 0x53, 0x43, 0x83, 0x17,
-	0x2d, 0xe8, 0x3f, 0x4a, 0xa9, 0x58, 0xda, 0x3b, 0xd1, 0x7d, 0xe8, 0x27, 0x54, 0xc8, 0x44, 0x5f,
-	0xfa, 0x9c, 0x9a, 0x83, 0xfb, 0x93, 0x5b, 0x07, 0x3a, 0xea, 0x83, 0xd9, 0xca, 0x80, 0xcb, 0x5e,
-	0x68, 0x1f, 0xbc, 0x98, 0x44, 0x54, 0x26, 0x24, 0xa4, 0xe6, 0x9e, 0x01, 0x5e, 0x01, 0x68, 0x07,
-	0xdc, 0x54, 0x30, 0xdf, 0x1d, 0xb5, 0xc6, 0x1e, 0xd6, 0x3f, 0x4d, 0x70, 0xa9, 0x54, 0x3c, 0x9a,
-	0x09, 0xce, 0x9f, 0x1e, 0x4f, 0xb1, 0xdf, 0x36, 0x9b, 0x6a, 0x68, 0xf0, 0x03, 0x0c, 0x4c, 0x6c,
-	0xa7, 0x54, 0x4a, 0x72, 0x4e, 0xd1, 0x3b, 0xd0, 0xa1, 0x42, 0x70, 0x91, 0x85, 0xd5, 0xb7, 0x61,
-	0x4d, 0x35, 0x84, 0xad, 0x05, 0xbd, 0x07, 0xdd, 0xc8, 0x7a, 0x9b, 0x40, 0xfa, 0x93, 0x4d, 0xeb,
-	0x94, 0x1d, 0x81, 0x73, 0x6b, 0xf0, 0x4b, 0x0b, 0xb6, 0x35, 0x05, 0xe5, 0xc7, 0x07, 0x30, 0x90,
-	0x3c, 0x15, 0x21, 0x9d, 0xc6, 0x8a, 0xa9, 0xa5, 0xb9, 0x66, 0x80, 0x2b, 0xd8, 0x8d, 0xdf, 0xba,
-	0x0f, 0x9e, 0x64, 0xe7, 0x31, 0x51, 0xa9, 0xa0, 0xd9, 0x33, 0x57, 0x00, 0x1a, 0x42, 0x2f, 0xc9,
-	0x39, 0xe8, 0x18, 0x63, 0xb1, 0x0e, 0xbe, 0x86, 0xdb, 0x3a, 0xc0, 0xc7, 0xb1, 0x4c, 0xe7, 0x32,
-	0x14, 0x6c, 0x4e, 0x6f, 0x10, 0xe6, 0x16, 0x38, 0x6c, 0x61, 0xe2, 0xf3, 0xb0, 0xc3, 0x16, 0xc1,
-	0x27, 0x70, 0xb7, 0x76, 0x58, 0x91, 0x4a, 0xff, 0xce, 0x6a, 0xf0, 0x00, 0x6e, 0xe9, 0xdd, 0xb3,
-	0x74, 0x7e, 0xc9, 0xe4, 0x45, 0x16, 0xc6, 0xdb, 0xe0, 0x46, 0xf2, 0x3c, 0xdb, 0x55, 0xa3, 0x59,
-	0x5b, 0x82, 0x87, 0xb0, 0x5b, 0xda, 0x75, 0x93, 0xfb, 0xfe, 0x68, 0xd9, 0xad, 0x67, 0x36, 0xd8,
-	0x44, 0x17, 0xc0, 0x77, 0x9f, 0x9d, 0xbd, 0x12, 0x81, 0x2c, 0x53, 0xed, 0x9c, 0x29, 0x2d, 0x89,
-	0xe0, 0xa9, 0xa2, 0xe2, 0xe4, 0xd8, 0x48, 0xe2, 0xe1, 0x62, 0x8d, 0xee, 0xc0, 0x06, 0xfd, 0x29,
-	0x61, 0x62, 0xe9, 0x6f, 0x8c, 0x5a, 0x63, 0x17, 0x67, 0xab, 0xe0, 0xd7, 0x6a, 0xbc, 0x85, 0x52,
-	0x1f, 0x80, 0xab, 0xe6, 0x32, 0x7b, 0xe8, 0x5e, 0x5e, 0x45, 0x6b, 0xef, 0xc2, 0xda, 0xab, 0x9a,
-	0x29, 0xce, 0x3f, 0x65, 0x8a, 0x5b, 0xcd, 0x14, 0x5d, 0x4f, 0x64, 0x2e, 0xf9, 0x65, 0xaa, 0xe8,
-	0xd4, 0x86, 0xd7, 0x36, 0xe1, 0xd5, 0xd0, 0xe0, 0x4f, 0x07, 0x36, 0xab, 0x1a, 0xfe, 0x2f, 0xe5,
-	0xfe, 0x21, 0x74, 0x43, 0x1e, 0x2b, 0x1a, 0x2b, 0xbf, 0x3d, 0x72, 0xc7, 0xfd, 0xc9, 0x6e, 0x76,
-	0x01, 0x59, 0x5e, 0x72, 0xb2, 0xf8, 0x76, 0xfe, 0x8c, 0x86, 0x0a, 0xe7, 0x3e, 0xe8, 0x10, 0x76,
-	0x69, 0x1c, 0x8a, 0xa5, 0x61, 0x67, 0x46, 0x84, 0x62, 0xfa, 0x87, 0xdf, 0x19, 0xb9, 0xe3, 0x01,
-	0x6e, 0x32, 0x21, 0x1f, 0xba, 0x3a, 0x3e, 0x26, 0x95, 0xd1, 0xa5, 0x87, 0xf3, 0x65, 0x43, 0xa7,
-	0xe9, 0x36, 0x75, 0x1a, 0x34, 0x86, 0xed, 0xec, 0xe0, 0x27, 0x4c, 0x5d, 0x7c, 0x35, 0x3d, 0x3e,
-	0xf1, 0x7b, 0xe6, 0xa4, 0x3a, 0x1c, 0x3c, 0x80, 0xed, 0xff, 0x90, 0xd0, 0x2f, 0x1c, 0x80, 0xac,
-	0x36, 0x5e, 0x36, 0x8f, 0x3f, 0x86, 0x2d, 0xbb, 0xfe, 0x86, 0x87, 0xc4, 0x30, 0xe0, 0x94, 0xd5,
-	0xc9, 0xd1, 0xc7, 0xf8, 0x04, 0xd7, 0x1c, 0xab, 0x02, 0xb9, 0xd7, 0x08, 0xd4, 0xae, 0x08, 0x94,
-	0x58, 0x2d, 0x0c, 0xcb, 0xd7, 0x09, 0x94, 0xf9, 0xe8, 0xe8, 0xb9, 0x60, 0xe7, 0x2c, 0xc6, 0xa6,
-	0x2e, 0x0c, 0xe7, 0x1e, 0xae, 0x60, 0xe8, 0x7d, 0xe8, 0x3d, 0xa3, 0x0b, 0x76, 0x4c, 0x14, 0x31,
-	0x94, 0xf7, 0x27, 0x5b, 0xf6, 0x4c, 0x4d, 0xa2, 0x46, 0x71, 0x61, 0x0f, 0x7e, 0x73, 0xa0, 0x5b,
-	0x6a, 0xf1, 0x26, 0xad, 0xab, 0x5c, 0x1a, 0x9d, 0xb0, 0xb5, 0x54, 0x2a, 0xc1, 0xa9, 0x55, 0x42,
-	0x60, 0x0b, 0xce, 0x35, 0x9b, 0x77, 0x2a, 0x3d, 0xa9, 0xb9, 0xce, 0xd6, 0x3a, 0xf2, 0xcd, 0xb3,
-	0x4f, 0x7f, 0x8a, 0x59, 0x44, 0xa5, 0x22, 0x51, 0x22, 0xfd, 0x8d, 0x91, 0x3b, 0x76, 0x71, 0x09,
-	0x41, 0x6f, 0x40, 0x67, 0x21, 0x78, 0x22, 0xfd, 0xae, 0x31, 0xd9, 0x45, 0x39, 0x67, 0x7b, 0xd5,
-	0x9c, 0xdd, 0x07, 0xcf, 0xbc, 0xe7, 0x4b, 0x22, 0x2f, 0x7c, 0xcf, 0xc6, 0x57, 0x00, 0xc1, 0x11,
-	0x6c, 0x56, 0x64, 0xd1, 0x3d, 0x49, 0x86, 0x17, 0x34, 0x22, 0x86, 0x32, 0x0f, 0x67, 0x2b, 0x7d,
-	0x41, 0x5e, 0x75, 0x96, 0xa5, 0x7c, 0x19, 0x8c, 0xa1, 0x97, 0xab, 0xa0, 0x2f, 0x2b, 0x42, 0x35,
-	0x07, 0xb8, 0x78, 0x05, 0x04, 0x0f, 0xa1, 0x9b, 0x5d, 0xa6, 0x73, 0x84, 0x9b, 0x0b, 0x75, 0x3b,
-	0xbb, 0x3e, 0x47, 0x32, 0x9f, 0xe0, 0xaf, 0x16, 0x6c, 0xd7, 0xbb, 0xe1, 0xeb, 0x34, 0x5b, 0x68,
-	0xd5, 0xd8, 0x82, 0xc6, 0x8a, 0x3d, 0x65, 0x54, 0x64, 0x8d, 0xbe, 0x84, 0x5c, 0xd7, 0xea, 0x1b,
-	0x7a, 0x6d, 0xb7, 0xb1, 0xd7, 0x12, 0xd8, 0x2d, 0x77, 0xf9, 0x57, 0x30, 0xc2, 0x4c, 0x7e, 0x76,
-	0x60, 0xe3, 0xc9, 0xd1, 0xf7, 0xd3, 0xd3, 0x47, 0xe8, 0x23, 0xe8, 0x66, 0x5d, 0x09, 0xe5, 0xba,
-	0x94, 0xfb, 0xfc, 0xf0, 0x76, 0x05, 0x2c, 0x3a, 0xd7, 0xa7, 0xe0, 0x15, 0x22, 0xa1, 0xcc, 0xa7,
-	0xa6, 0xda, 0x70, 0xaf, 0x02, 0x97, 0x1f, 0x73, 0xd8, 0x42, 0x87, 0xd0, 0x31, 0x03, 0x14, 0xca,
-	0x64, 0x2c, 0x4d, 0x53, 0x43, 0x54, 0x82, 0x56, 0x3b, 0x66, 0xb0, 0x53, 0x1f, 0x6a, 0xd1, 0xbe,
-	0xf5, 0x6c, 0x1e, 0x83, 0x87, 0xf7, 0x9a, 0xad, 0xf9, 0x23, 0x26, 0xbf, 0x3b, 0xb0, 0x69, 0x69,
-	0xd0, 0x9f, 0x56, 0x16, 0x9f, 0xa3, 0x23, 0xe8, 0x97, 0x06, 0x0f, 0x74, 0x77, 0xf5, 0xe1, 0xad,
-	0xb2, 0xb2, 0xb7, 0x66, 0x28, 0x98, 0xf9, 0x02, 0x36, 0x2b, 0x1f, 0x74, 0xb4, 0xfe, 0xf5, 0x7e,
-	0x39, 0x86, 0x4e, 0xed, 0x98, 0x59, 0x1a, 0xbc, 0xd0, 0x9b, 0xab, 0xa3, 0xd6, 0x86, 0xbb, 0xe1,
-	0x5b, 0x8d, 0xc6, 0x92, 0x62, 0x3b, 0xc5, 0xd4, 0x8a, 0xe9, 0x55, 0x4a, 0xa5, 0xca, 0x85, 0xab,
-	0x4d, 0xb3, 0xcd, 0xfc, 0xcf, 0x37, 0xcc, 0xbf, 0x8e, 0xfb, 0x7f, 0x07, 0x00, 0x00, 0xff, 0xff,
-	0xb5, 0x84, 0xa5, 0xb3, 0x97, 0x0c, 0x00, 0x00,
+	// 1202 bytes of a gzipped FileDescriptorProto
+	0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0xff, 0xcd, 0x57, 0x5b, 0x6f, 0x1b, 0x45,
+	0x14, 0x96, 0xbd, 0xbe, 0x1e, 0xbb, 0x4e, 0x3a, 0xe9, 0x65, 0x63, 0x4a, 0x81, 0x7d, 0x80, 0x00,
+	0x22, 0x8a, 0x52, 0x90, 0x40, 0x42, 0x82, 0x94, 0x58, 0x10, 0x20, 0xaa, 0x3b, 0x21, 0xf4, 0x79,
+	0xec, 0x9d, 0xc6, 0x53, 0x79, 0x2f, 0x99, 0xd9, 0x0d, 0xcd, 0x3b, 0x8f, 0xf0, 0x07, 0xf8, 0x09,
+	0x08, 0x7e, 0x04, 0x6f, 0xbc, 0x20, 0xf1, 0x47, 0xf8, 0x0f, 0xcc, 0x65, 0x77, 0x3d, 0xbb, 0xb6,
+	0x21, 0xa9, 0x54, 0xc4, 0xdb, 0xce, 0x39, 0x67, 0xe6, 0x9c, 0xf9, 0xbe, 0x73, 0x99, 0x85, 0xfe,
+	0x77, 0xe4, 0x82, 0x06, 0xe7, 0xbb, 0x31, 0x8f, 0x92, 0x08, 0x35, 0x82, 0xf3, 0x78, 0x32, 0x04,
+	0x4a, 0x62, 0x66, 0x24, 0x9e, 0x0b, 0x77, 0x3e, 0x8b, 0xc2, 0x90, 0x4e, 0x13, 0x16, 0x85, 0x27,
+	0x09, 0x49, 0x52, 0x31, 0x26, 0x9c, 0x04, 0xc2, 0x9b, 0x80, 0x5b, 0xd5, 0x60, 0x2a, 0xe2, 0x28,
+	0x14, 0x14, 0xdd, 0x07, 0x48, 0xa2, 0x84, 0xcc, 0xc7, 0x94, 0x72, 0xe1, 0xd6, 0x5e, 0xaf, 0xed,
+	0x34, 0xb1, 0x25, 0x41, 0x6f, 0xc2, 0x60, 0x6a, 0xf6, 0x52, 0xdf, 0xd8, 0xd4, 0xb5, 0x4d, 0x45,
+	0xea, 0xfd, 0x5e, 0x83, 0xde, 0xe3, 0x94, 0xf2, 0x4b, 0xe3, 0x13, 0x3d, 0x80, 0x5e, 0x2c, 0xe5,
+	0xb1, 0x72, 0x7a, 0x41, 0xf5, 0xc1, 0xbd, 0xfd, 0x9b, 0xbb, 0x2a, 0xea, 0xdd, 0xf1, 0x42, 0x81,
+	0x6d, 0x2b, 0x74, 0x0f, 0xba, 0x21, 0x09, 0x64, 0x68, 0x64, 0x4a, 0xb5, 0x9f, 0x3e, 0x5e, 0x08,
+	0xd0, 0x26, 0x38, 0x29, 0x67, 0xae, 0x23, 0xe5, 0x5d, 0xac, 0x3e, 0x75, 0x70, 0xa9, 0x48, 0xa2,
+	0x60, 0xcc, 0xa3, 0xe8, 0xe9, 0xe1, 0x08, 0xbb, 0x0d, 0xbd, 0xa9, 0x22, 0x45, 0xb7, 0xa0, 0x39,
+	0x67, 0x01, 0x4b, 0xdc, 0xa6, 0x8e, 0xdd, 0x2c, 0xd0, 0x1d, 0x68, 0x4d, 0x53, 0x2e, 0x22, 0xee,
+	0xb6, 0xf4, 0xae, 0x6c, 0xe5, 0x71, 0xe8, 0xeb, 0x9b, 0x1c, 0x53, 0x21, 0xc8, 0x19, 0x45, 0x6f,
+	0x40, 0x93, 0x72, 0x2e, 0xcd, 0xcc, 0x25, 0x7a, 0xe6, 0x12, 0x23, 0x25, 0xc2, 0x46, 0x83, 0xde,
+	0x82, 0x76, 0x60, 0xac, 0x75, 0xd8, 0xbd, 0xfd, 0x1b, 0xc6, 0x28, 0x3b, 0x02, 0xe7, 0x5a, 0xcb,
+	0xa7, 0x53, 0xf2, 0xf9, 0x47, 0x0d, 0x36, 0x14, 0x90, 0x36, 0x84, 0x1e, 0xf4, 0x45, 0x94, 0xf2,
+	0x29, 0x1d, 0x85, 0x09, 0x4b, 0x2e, 0xb5, 0xfb, 0x3e, 0x2e, 0xc9, 0xae, 0x8d, 0x98, 0xb4, 0x17,
+	0xec, 0x2c, 0x94, 0x29, 0xc0, 0x69, 0x06, 0xd6, 0x42, 0x80, 0x86, 0xd0, 0x89, 0x73, 0x24, 0x9b,
+	0x5a, 0x59, 0xac, 0x17, 0x18, 0xb6, 0x56, 0x63, 0xd8, 0x2e, 0xdd, 0xe7, 0x2b, 0xb8, 0xad, 0xae,
+	0x73, 0x1a, 0x8a, 0x74, 0x22, 0xa6, 0x9c, 0x4d, 0xe8, 0x35, 0x2e, 0x35, 0x80, 0x3a, 0xf3, 0xf5,
+	0x6d, 0xba, 0x58, 0x7e, 0x79, 0x1f, 0xc3, 0xdd, 0xca, 0x61, 0x45, 0xfa, 0xfe, 0x3b, 0x37, 0xde,
+	0xfb, 0x70, 0x53, 0xed, 0x1e, 0xa7, 0x93, 0x39, 0x13, 0xb3, 0x2c, 0x8c, 0xd7, 0xc0, 0x09, 0xc4,
+	0x59, 0xb6, 0xab, 0x42, 0x96, 0xd2, 0x78, 0x1f, 0xc2, 0x96, 0xb5, 0xeb, 0x3a, 0xfe, 0x7e, 0xad,
+	0x99, 0xad, 0x27, 0x26, 0xd8, 0x58, 0x15, 0xdd, 0x37, 0x0f, 0x4f, 0x5e, 0x0a, 0x9d, 0x06, 0xa9,
+	0x46, 0x8e, 0x94, 0x22, 0x90, 0x47, 0x69, 0x42, 0xf9, 0xd1, 0xa1, 0x26, 0xb0, 0x8b, 0x8b, 0xb5,
+	0xa2, 0x8a, 0x3e, 0x8f, 0x19, 0xbf, 0xd4, 0x0c, 0x3a, 0x38, 0x5b, 0x79, 0x7f, 0x96, 0xe3, 0x2d,
+	0x98, 0x7a, 0x17, 0x9c, 0x64, 0x22, 0xb2, 0x8b, 0x6e, 0xe7, 0x95, 0xbb, 0x74, 0x2f, 0xac, 0xac,
+	0xca, 0x79, 0x55, 0xff, 0xa7, 0xbc, 0x72, 0x2a, 0x79, 0x25, 0x6b, 0x98, 0x4c, 0x44, 0x34, 0x97,
+	0x51, 0x8e, 0x4c, 0x78, 0x0d, 0x1d, 0x5e, 0x45, 0x8a, 0xde, 0x81, 0xcd, 0x80, 0x3c, 0x7f, 0x48,
+	0x92, 0xe9, 0x2c, 0x23, 0x4a, 0x64, 0xe5, 0xbc, 0x24, 0xf7, 0x7e, 0xab, 0xc3, 0x8d, 0x32, 0xdf,
+	0xff, 0x49, 0x3b, 0x7a, 0x0f, 0xda, 0xb2, 0x2b, 0x26, 0x34, 0x4c, 0xe4, 0x1d, 0x1c, 0xe9, 0x60,
+	0x2b, 0x73, 0x40, 0x2e, 0xe7, 0x11, 0xf1, 0x1f, 0x4d, 0x9e, 0xc9, 0x83, 0x71, 0x6e, 0x83, 0xf6,
+	0x60, 0x8b, 0x86, 0x53, 0x7e, 0xa9, 0x91, 0x94, 0x71, 0xca, 0x0c, 0x90, 0x1f, 0xf2, 0x52, 0x8e,
+	0x74, 0xb4, 0x4a, 0x85, 0x5c, 0x68, 0xab, 0xf8, 0x98, 0x30, 0x55, 0xd8, 0xc1, 0xf9, 0x72, 0x45,
+	0x27, 0x6c, 0xaf, 0xec, 0x84, 0x3b, 0xb0, 0x91, 0x1d, 0xfc, 0x84, 0x25, 0xb3, 0x2f, 0x47, 0x87,
+	0x47, 0x6e, 0x47, 0x9f, 0x54, 0x15, 0xcb, 0xb2, 0xd9, 0x78, 0x81, 0xe4, 0xff, 0xa9, 0x0e, 0x90,
+	0xd1, 0x70, 0xd5, 0x9c, 0xff, 0x08, 0x06, 0x66, 0xfd, 0x75, 0x34, 0x25, 0x1a, 0x81, 0xba, 0xcd,
+	0x4e, 0x2e, 0x3d, 0xc5, 0x47, 0xb8, 0x62, 0x58, 0x26, 0xc8, 0x59, 0x43, 0x50, 0xa3, 0x44, 0x50,
+	0x6c, 0xb8, 0xd0, 0x28, 0xaf, 0x23, 0x28, 0xb3, 0x51, 0xd1, 0x47, 0x9c, 0x9d, 0xb1, 0x10, 0xeb,
+	0x1a, 0xd2, 0x98, 0x77, 0x71, 0x49, 0x26, 0xd3, 0xb2, 0xf3, 0x8c, 0xfa, 0xec, 0x90, 0x24, 0x44,
+	0x43, 0xde, 0xdb, 0x1f, 0x98, 0x33, 0x15, 0x88, 0x4a, 0x8a, 0x0b, 0xbd, 0xf7, 0x73, 0x1d, 0xda,
+	0xd6, 0x50, 0xd1, 0x25, 0x50, 0xc6, 0x52, 0xf3, 0x84, 0x8d, 0xa6, 0x54, 0x35, 0xf5, 0x4a, 0xd5,
+	0x78, 0xa6, 0x38, 0x1d, 0xbd, 0x79, 0xb3, 0xd4, 0xbf, 0x56, 0xd7, 0xe4, 0x52, 0xaf, 0xbf, 0x7e,
+	0xf6, 0xa9, 0xa7, 0x02, 0x93, 0xe0, 0x26, 0x24, 0x88, 0x85, 0x04, 0xc3, 0x91, 0x55, 0x6a, 0x49,
+	0xd4, 0x84, 0xf0, 0x79, 0x24, 0x55, 0x6d, 0xad, 0x32, 0x0b, 0x3b, 0x67, 0x3b, 0xe5, 0x9c, 0x95,
+	0xf1, 0xe9, 0xfb, 0x7c, 0x41, 0xc4, 0xcc, 0xed, 0x9a, 0xf8, 0x0a, 0x81, 0x77, 0x20, 0x4b, 0xd8,
+	0xa6, 0x45, 0xf5, 0x2f, 0x31, 0x9d, 0xd1, 0x80, 0x68, 0xc8, 0xba, 0x38, 0x5b, 0x29, 0x07, 0x79,
+	0xd5, 0x19, 0x94, 0xf2, 0xa5, 0xb7, 0x03, 0x9d, 0x9c, 0x05, 0xe5, 0xac, 0x08, 0x55, 0x1f, 0xe0,
+	0xe0, 0x85, 0x40, 0x76, 0xfb, 0x76, 0xe6, 0x4c, 0xe5, 0x48, 0xa4, 0x1d, 0xaa, 0xd6, 0xb7, 0x3e,
+	0x47, 0x32, 0x1b, 0xc5, 0xe9, 0x46, 0xb5, 0x73, 0xfe, 0xaf, 0xde, 0x3e, 0x92, 0x35, 0xe6, 0x4b,
+	0x34, 0xd8, 0x53, 0x26, 0x53, 0xd8, 0x0c, 0x05, 0x4b, 0xb2, 0x6e, 0x2c, 0xac, 0xe8, 0xcb, 0xed,
+	0x2b, 0xf7, 0xe5, 0xce, 0x9a, 0xbe, 0xfc, 0x83, 0x1c, 0x35, 0xf6, 0xf8, 0x78, 0x19, 0x2f, 0xac,
+	0xb7, 0xa1, 0x13, 0xe4, 0x71, 0x38, 0x9a, 0xc0, 0x8a, 0x65, 0xa1, 0xf6, 0x7e, 0xa9, 0x01, 0x52,
+	0x13, 0xed, 0x48, 0xa6, 0x0b, 0x97, 0x99, 0x90, 0xd1, 0x57, 0x62, 0xa2, 0x56, 0x65, 0xc2, 0x1e,
+	0xb1, 0xf5, 0xca, 0x88, 0xad, 0xb6, 0x3b, 0x67, 0xf5, 0x88, 0x7f, 0xb1, 0x17, 0x98, 0xf7, 0x63,
+	0x0d, 0x06, 0x79, 0xa8, 0xa7, 0xb1, 0x4f, 0x92, 0x2b, 0x01, 0x27, 0xab, 0x52, 0x6e, 0xa0, 0xa6,
+	0x38, 0x3a, 0xd8, 0x2c, 0x94, 0x94, 0xf8, 0x3e, 0xf5, 0x35, 0x44, 0x5d, 0x6c, 0x16, 0xaa, 0x94,
+	0x38, 0x0d, 0xa2, 0x0b, 0xea, 0xeb, 0x01, 0xd6, 0xc5, 0xf9, 0x12, 0x21, 0x68, 0x04, 0x91, 0x0c,
+	0xb8, 0xa9, 0x0f, 0xd1, 0xdf, 0xfb, 0xdf, 0xd7, 0xa1, 0xf5, 0xe4, 0xe0, 0xdb, 0xd1, 0xf1, 0x63,
+	0xf4, 0x81, 0xac, 0x1f, 0x33, 0x2c, 0x50, 0x5e, 0x2e, 0xf6, 0xf8, 0x1d, 0xde, 0x2e, 0x09, 0x8b,
+	0x81, 0xf2, 0x09, 0x74, 0x8b, 0xda, 0x41, 0x99, 0x4d, 0xa5, 0x98, 0x86, 0xdb, 0x25, 0xb1, 0x9d,
+	0x36, 0x7b, 0x35, 0xd9, 0xc4, 0x9a, 0xfa, 0xc5, 0x8c, 0xb2, 0xea, 0xb2, 0x9e, 0xcf, 0x43, 0x64,
+	0x89, 0x16, 0x3b, 0xc6, 0xb0, 0x59, 0xfd, 0x17, 0x42, 0xf7, 0x8c, 0xe5, 0xea, 0xbf, 0xa7, 0xe1,
+	0xfd, 0xd5, 0xda, 0xfc, 0x12, 0xfb, 0x7f, 0xc9, 0xc7, 0x86, 0x81, 0x41, 0xe5, 0x12, 0x0b, 0xcf,
+	0xd0, 0x01, 0xf4, 0xac, 0xb7, 0x23, 0xba, 0xbb, 0x78, 0x3b, 0x95, 0x51, 0xd9, 0x5e, 0x52, 0x14,
+	0xc8, 0x7c, 0x2e, 0xbb, 0x9f, 0xfd, 0x26, 0x43, 0xcb, 0x0f, 0xb0, 0xab, 0x21, 0x74, 0x6c, 0xfe,
+	0x2b, 0xac, 0xb7, 0x33, 0x7a, 0x65, 0x71, 0xd4, 0xd2, 0xfb, 0x7c, 0xf8, 0xea, 0x4a, 0xa5, 0xc5,
+	0xd8, 0x66, 0xf1, 0x9b, 0x82, 0xe9, 0x79, 0x2a, 0x53, 0x31, 0x27, 0xae, 0xf2, 0xfb, 0xb2, 0x06,
+	0xff, 0x4f, 0xa1, 0x6f, 0x97, 0x1c, 0x72, 0x17, 0x9b, 0xcb, 0x65, 0x38, 0xbc, 0x65, 0x34, 0xe5,
+	0x8c, 0xdf, 0xab, 0x4d, 0x5a, 0xfa, 0x77, 0xf7, 0xc1, 0xdf, 0x1c, 0x0b, 0xd1, 0x11, 0x10, 0x0f,
+	0x00, 0x00,
 }
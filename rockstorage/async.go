@@ -0,0 +1,188 @@
+// +build !norocksdb
+
+package rocksdb
+
+// #include "iface.h"
+import "C"
+import (
+	"errors"
+	"sync"
+	"unsafe"
+)
+
+//When StorageConfig.AsyncWorkers is set, gets, sets and deletes go through
+//a submission queue served by that many C++ threads instead of a blocking
+//cgo call each. Callers wait on a channel, so a storage stall parks
+//goroutines rather than pinning an OS thread for each of them. Operations
+//submitted at the same time are passed to C in one call, and only the
+//goroutine reaping completions blocks in C
+
+//The maximum number of operations passed to C in one call
+const AsyncMaxSubmit = 256
+
+//The maximum number of operations in flight, further callers wait in Go
+const AsyncMaxInFlight = 4096
+
+//Returned for operations after the storage engine has been closed
+var ErrAsyncStopped = errors.New("Storage engine is closed")
+
+type asyncResult struct {
+	value []byte
+	err   error
+}
+
+type asyncReq struct {
+	op    int
+	col   Column
+	key   []byte
+	value []byte
+	done  chan asyncResult
+}
+
+type asyncQueue struct {
+	//Held for reading while submitting, so that subq is not closed under a
+	//sender
+	smu      sync.RWMutex
+	closed   bool
+	subq     chan *asyncReq
+	inflight chan struct{}
+
+	mu      sync.Mutex
+	nextID  uint64
+	pending map[uint64]chan asyncResult
+
+	//Closed once everything in subq has been passed to C
+	submitted chan struct{}
+	stopped   chan struct{}
+}
+
+func startAsync(threads int) *asyncQueue {
+	a := &asyncQueue{
+		subq:     make(chan *asyncReq, AsyncMaxSubmit),
+		inflight: make(chan struct{}, AsyncMaxInFlight),
+		pending:  make(map[uint64]chan asyncResult),
+
+		submitted: make(chan struct{}),
+		stopped:   make(chan struct{}),
+	}
+	C.db_async_start(C.size_t(threads))
+	go a.submitLoop()
+	go a.reapLoop()
+	return a
+}
+
+//Execute an operation and wait for its result. Returns ErrAsyncStopped
+//once stop has been called
+func (a *asyncQueue) do(op int, col Column, key, value []byte) ([]byte, error) {
+	req := &asyncReq{
+		op:    op,
+		col:   col,
+		key:   key,
+		value: value,
+		done:  make(chan asyncResult, 1),
+	}
+	a.smu.RLock()
+	if a.closed {
+		a.smu.RUnlock()
+		return nil, ErrAsyncStopped
+	}
+	a.inflight <- struct{}{}
+	a.subq <- req
+	a.smu.RUnlock()
+	r := <-req.done
+	return r.value, r.err
+}
+
+func (a *asyncQueue) submitLoop() {
+	defer close(a.submitted)
+	batch := make([]*asyncReq, 0, AsyncMaxSubmit)
+	for req := range a.subq {
+		batch = append(batch[:0], req)
+	drain:
+		for len(batch) < AsyncMaxSubmit {
+			select {
+			case req, ok := <-a.subq:
+				if !ok {
+					break drain
+				}
+				batch = append(batch, req)
+			default:
+				break drain
+			}
+		}
+		a.submit(batch)
+	}
+}
+
+//Pass a batch of operations to C. The keys and values are packed into
+//one buffer that C copies from, so no Go pointers are retained
+func (a *asyncQueue) submit(batch []*asyncReq) {
+	ops := make([]C.db_op, len(batch))
+	size := 1
+	for _, req := range batch {
+		size += len(req.key) + len(req.value)
+	}
+	data := make([]byte, 0, size)
+	a.mu.Lock()
+	for i, req := range batch {
+		a.nextID++
+		a.pending[a.nextID] = req.done
+		ops[i].id = C.uint64_t(a.nextID)
+		ops[i].op = C.int32_t(req.op)
+		ops[i].col = C.int32_t(req.col)
+		ops[i].keyoff = C.size_t(len(data))
+		ops[i].keylen = C.size_t(len(req.key))
+		data = append(data, req.key...)
+		ops[i].valueoff = C.size_t(len(data))
+		ops[i].valuelen = C.size_t(len(req.value))
+		data = append(data, req.value...)
+	}
+	a.mu.Unlock()
+	//The buffer must not be empty so that we can take its address
+	data = append(data, 0)
+	C.db_async_submit(&ops[0], C.size_t(len(ops)), (*C.char)(unsafe.Pointer(&data[0])))
+}
+
+func (a *asyncQueue) reapLoop() {
+	defer close(a.stopped)
+	comps := make([]C.db_completion, AsyncMaxSubmit)
+	for {
+		n := int(C.db_async_reap(&comps[0], C.size_t(len(comps))))
+		if n == 0 {
+			return
+		}
+		for i := 0; i < n; i++ {
+			c := &comps[i]
+			r := asyncResult{}
+			if c.errlen > 0 {
+				r.err = getError(c.err, c.errlen)
+			} else if c.notfound != 0 {
+				r.err = ErrObjNotFound
+			} else if c.value != nil {
+				r.value = C.GoBytes(unsafe.Pointer(c.value), C.int(c.valuelen))
+				C.free(unsafe.Pointer(c.value))
+			}
+			a.mu.Lock()
+			done := a.pending[uint64(c.id)]
+			delete(a.pending, uint64(c.id))
+			a.mu.Unlock()
+			done <- r
+			<-a.inflight
+		}
+	}
+}
+
+//Wait for the submitted operations to finish and stop the worker threads.
+//Operations that were waiting to be submitted are passed to C first, so
+//that their callers get a result
+func (a *asyncQueue) stop() {
+	a.smu.Lock()
+	if !a.closed {
+		a.closed = true
+		close(a.subq)
+	}
+	a.smu.Unlock()
+	<-a.submitted
+	C.db_async_stop()
+	<-a.stopped
+}
@@ -0,0 +1,538 @@
+package rocksdb
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"hash/crc32"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"runtime"
+	"sync"
+	"time"
+)
+
+//If StorageConfig.BlobDataStore is set, values in the queue and persist
+//columns of at least BlobMinSize bytes are appended to blob files and the
+//engine stores a pointer to them instead. Large payloads are then written
+//once, rather than again by every compaction. Blob files are immutable
+//once they are full. A periodic pass finds the live pointers into each
+//one, and files where less than BlobGCMinLiveRatio of the bytes are still
+//live have their live values copied to the current file and are removed
+
+//The default minimum size of a value stored in a blob file
+const DefaultBlobMinSize = 4096
+
+//The size at which a new blob file is started
+const BlobFileMaxSize = 256 * 1024 * 1024
+
+//How often blob files are checked for garbage
+const BlobGCInterval = 10 * time.Minute
+
+//Blob files with a smaller fraction of live bytes are rewritten
+const BlobGCMinLiveRatio = 0.5
+
+//A pointer is the magic followed by the file number, the offset of the
+//record and the length of the value. Stored values in these columns never
+//start with a zero byte followed by 'B' and have this length
+var blobPointerMagic = [2]byte{0, 'B'}
+
+const blobPointerLength = 2 + 8 + 8 + 4
+
+//Each record is the CRC32C of the value followed by the value
+const blobRecordHeader = 4
+
+var blobCRCTable = crc32.MakeTable(crc32.Castagnoli)
+
+//The number of pointers the GC replaces while holding off writers
+const blobGCSwapBatch = 256
+
+type blobPointer struct {
+	file   uint64
+	offset int64
+	length int
+}
+
+func (p blobPointer) encode() []byte {
+	rv := make([]byte, blobPointerLength)
+	copy(rv[0:2], blobPointerMagic[:])
+	binary.BigEndian.PutUint64(rv[2:10], p.file)
+	binary.BigEndian.PutUint64(rv[10:18], uint64(p.offset))
+	binary.BigEndian.PutUint32(rv[18:22], uint32(p.length))
+	return rv
+}
+
+func parseBlobPointer(v []byte) (blobPointer, bool) {
+	if len(v) != blobPointerLength || v[0] != blobPointerMagic[0] || v[1] != blobPointerMagic[1] {
+		return blobPointer{}, false
+	}
+	return blobPointer{
+		file:   binary.BigEndian.Uint64(v[2:10]),
+		offset: int64(binary.BigEndian.Uint64(v[10:18])),
+		length: int(binary.BigEndian.Uint32(v[18:22])),
+	}, true
+}
+
+type blobFile struct {
+	num uint64
+	f   *os.File
+	//The bytes allocated to records
+	size int64
+	//Readers currently using the file, protected by blobEngine.mu
+	refs int
+	//Values written to the file whose pointers are not yet stored, also
+	//protected by blobEngine.mu. The GC cannot see these pointers, so it
+	//leaves the file alone
+	pending int
+	//Set once the GC has moved the live values elsewhere, the file is
+	//removed on the following pass
+	obsolete bool
+}
+
+//An Engine that separates large values from the wrapped engine
+type blobEngine struct {
+	Engine
+	dir     string
+	minSize int
+
+	mu     sync.Mutex
+	files  map[uint64]*blobFile
+	active *blobFile
+	next   uint64
+
+	//Held for reading by writes to the blob columns, and for writing while
+	//the GC replaces pointers, so that it cannot undo a concurrent write
+	gcmu sync.RWMutex
+
+	stop chan struct{}
+	done chan struct{}
+}
+
+func newBlobEngine(inner Engine, conf StorageConfig) Engine {
+	if err := os.MkdirAll(conf.BlobDataStore, 0700); err != nil {
+		panic(err)
+	}
+	e := &blobEngine{
+		Engine:  inner,
+		dir:     conf.BlobDataStore,
+		minSize: conf.BlobMinSize,
+		files:   make(map[uint64]*blobFile),
+		next:    1,
+		stop:    make(chan struct{}),
+		done:    make(chan struct{}),
+	}
+	if e.minSize <= 0 {
+		e.minSize = DefaultBlobMinSize
+	}
+	names, err := ioutil.ReadDir(e.dir)
+	if err != nil {
+		panic(err)
+	}
+	for _, fi := range names {
+		var num uint64
+		if _, err := fmt.Sscanf(fi.Name(), "%016x.blob", &num); err != nil {
+			continue
+		}
+		f, err := os.OpenFile(filepath.Join(e.dir, fi.Name()), os.O_RDWR, 0600)
+		if err != nil {
+			panic(err)
+		}
+		e.files[num] = &blobFile{num: num, f: f, size: fi.Size()}
+		if num >= e.next {
+			e.next = num + 1
+		}
+	}
+	go e.gcLoop()
+	return e
+}
+
+func blobColumn(col Column) bool {
+	return col == QUEUE || col == PERSIST
+}
+
+//Append a value to the active blob file and return the file and the
+//pointer to it. The write is pending until settle is called, once the
+//pointer has been stored or never will be
+func (e *blobEngine) write(value []byte) (*blobFile, []byte) {
+	reclen := int64(blobRecordHeader + len(value))
+	e.mu.Lock()
+	f := e.active
+	if f == nil || f.size+reclen > BlobFileMaxSize {
+		nf, err := os.OpenFile(filepath.Join(e.dir, fmt.Sprintf("%016x.blob", e.next)), os.O_RDWR|os.O_CREATE|os.O_EXCL, 0600)
+		if err != nil {
+			e.mu.Unlock()
+			panic(err)
+		}
+		f = &blobFile{num: e.next, f: nf}
+		e.files[f.num] = f
+		e.active = f
+		e.next++
+	}
+	offset := f.size
+	f.size += reclen
+	f.refs++
+	f.pending++
+	e.mu.Unlock()
+	rec := make([]byte, reclen)
+	binary.BigEndian.PutUint32(rec[0:4], crc32.Checksum(value, blobCRCTable))
+	copy(rec[blobRecordHeader:], value)
+	_, err := f.f.WriteAt(rec, offset)
+	e.release(f)
+	if err != nil {
+		panic(err)
+	}
+	return f, blobPointer{file: f.num, offset: offset, length: len(value)}.encode()
+}
+
+//Make the writes to the given files durable. A pointer must not be stored
+//before the record it refers to is
+func (e *blobEngine) sync(files []*blobFile) error {
+	synced := make(map[*blobFile]bool)
+	for _, f := range files {
+		if !synced[f] {
+			if err := f.f.Sync(); err != nil {
+				return err
+			}
+			synced[f] = true
+		}
+	}
+	return nil
+}
+
+//Finish pending writes to the given files
+func (e *blobEngine) settle(files []*blobFile) {
+	e.mu.Lock()
+	for _, f := range files {
+		f.pending--
+	}
+	e.mu.Unlock()
+}
+
+//Return the value a pointer refers to
+func (e *blobEngine) read(p blobPointer) ([]byte, error) {
+	e.mu.Lock()
+	f, ok := e.files[p.file]
+	if ok {
+		f.refs++
+	}
+	e.mu.Unlock()
+	if !ok {
+		return nil, fmt.Errorf("blob file %016x is missing", p.file)
+	}
+	defer e.release(f)
+	rec := make([]byte, blobRecordHeader+p.length)
+	if _, err := f.f.ReadAt(rec, p.offset); err != nil {
+		return nil, err
+	}
+	if binary.BigEndian.Uint32(rec[0:4]) != crc32.Checksum(rec[blobRecordHeader:], blobCRCTable) {
+		return nil, fmt.Errorf("corrupt blob at %016x:%d", p.file, p.offset)
+	}
+	return rec[blobRecordHeader:], nil
+}
+
+func (e *blobEngine) release(f *blobFile) {
+	e.mu.Lock()
+	f.refs--
+	e.mu.Unlock()
+}
+
+//Replace a stored pointer with the value it refers to
+func (e *blobEngine) resolve(col Column, v []byte) ([]byte, error) {
+	if !blobColumn(col) {
+		return v, nil
+	}
+	p, ok := parseBlobPointer(v)
+	if !ok {
+		return v, nil
+	}
+	return e.read(p)
+}
+
+//Return what to store in the wrapped engine for a value, and the blob file
+//with a pending write if it went to one
+func (e *blobEngine) stored(col Column, value []byte) ([]byte, *blobFile) {
+	if !blobColumn(col) || len(value) < e.minSize {
+		return value, nil
+	}
+	f, ptr := e.write(value)
+	return ptr, f
+}
+
+func (e *blobEngine) Get(col Column, key []byte) ([]byte, error) {
+	v, err := e.Engine.Get(col, key)
+	if err != nil {
+		return nil, err
+	}
+	return e.resolve(col, v)
+}
+
+func (e *blobEngine) Set(col Column, key, value []byte) error {
+	value, f := e.stored(col, value)
+	if f != nil {
+		if err := f.f.Sync(); err != nil {
+			e.settle([]*blobFile{f})
+			return err
+		}
+	}
+	e.gcmu.RLock()
+	err := e.Engine.Set(col, key, value)
+	e.gcmu.RUnlock()
+	if f != nil {
+		e.settle([]*blobFile{f})
+	}
+	return err
+}
+
+func (e *blobEngine) Delete(col Column, key []byte) error {
+	e.gcmu.RLock()
+	defer e.gcmu.RUnlock()
+	return e.Engine.Delete(col, key)
+}
+
+func (e *blobEngine) DeletePrefix(col Column, pfx []byte) int {
+	e.gcmu.RLock()
+	defer e.gcmu.RUnlock()
+	return e.Engine.DeletePrefix(col, pfx)
+}
+
+type blobIterator struct {
+	Iterator
+	e   *blobEngine
+	col Column
+	err error
+}
+
+func (e *blobEngine) NewIterator(col Column, prefix []byte) Iterator {
+	return &blobIterator{
+		Iterator: e.Engine.NewIterator(col, prefix),
+		e:        e,
+		col:      col,
+	}
+}
+
+//A pointer whose record is missing or corrupt, after a crash or a disk
+//error, is reported by Err rather than stopping the iteration
+func (it *blobIterator) Value() []byte {
+	var v []byte
+	v, it.err = it.e.resolve(it.col, it.Iterator.Value())
+	if it.err != nil {
+		return nil
+	}
+	return v
+}
+
+func (it *blobIterator) Err() error {
+	return it.err
+}
+
+type blobWriteBatch struct {
+	WriteBatch
+	e   *blobEngine
+	col Column
+	//The blob files with pending writes from this batch
+	files []*blobFile
+}
+
+func (e *blobEngine) NewWriteBatch(col Column) WriteBatch {
+	wb := &blobWriteBatch{
+		WriteBatch: e.Engine.NewWriteBatch(col),
+		e:          e,
+		col:        col,
+	}
+	//A batch that is dropped without being committed must not keep its
+	//files from being collected
+	runtime.SetFinalizer(wb, func(wb *blobWriteBatch) {
+		wb.e.settle(wb.files)
+	})
+	return wb
+}
+
+//The value is written to its blob file immediately. If the batch is never
+//committed it is garbage that the GC will remove
+func (wb *blobWriteBatch) Set(key, value []byte) {
+	value, f := wb.e.stored(wb.col, value)
+	if f != nil {
+		wb.files = append(wb.files, f)
+	}
+	wb.WriteBatch.Set(key, value)
+}
+
+func (wb *blobWriteBatch) Commit() error {
+	if err := wb.e.sync(wb.files); err != nil {
+		wb.e.settle(wb.files)
+		wb.files = nil
+		return err
+	}
+	wb.e.gcmu.RLock()
+	err := wb.WriteBatch.Commit()
+	wb.e.gcmu.RUnlock()
+	wb.e.settle(wb.files)
+	wb.files = nil
+	return err
+}
+
+func (e *blobEngine) Query(uri string, limit int, cursor []byte, handle func(uri string, value []byte) bool) ([]byte, error) {
+	qr, ok := e.Engine.(Querier)
+	if !ok {
+		return nil, ErrQueryUnsupported
+	}
+	var rerr error
+	next, err := qr.Query(uri, limit, cursor, func(uri string, value []byte) bool {
+		value, rerr = e.resolve(PERSIST, value)
+		if rerr != nil {
+			return false
+		}
+		return handle(uri, value)
+	})
+	if rerr != nil {
+		return nil, rerr
+	}
+	return next, err
+}
+
+func (e *blobEngine) Close() {
+	close(e.stop)
+	<-e.done
+	e.Engine.Close()
+	e.mu.Lock()
+	for _, f := range e.files {
+		f.f.Close()
+	}
+	e.mu.Unlock()
+}
+
+func (e *blobEngine) gcLoop() {
+	defer close(e.done)
+	for {
+		select {
+		case <-e.stop:
+			return
+		case <-time.After(BlobGCInterval):
+		}
+		if err := e.gc(); err != nil {
+			fmt.Printf("blob file garbage collection failed: %v\n", err)
+		}
+	}
+}
+
+type blobRef struct {
+	col Column
+	key []byte
+	ptr []byte
+}
+
+//Remove the files made obsolete by the previous pass, then rewrite the
+//files that are mostly garbage
+func (e *blobEngine) gc() error {
+	//Only full files are collected. Newer files are not written to by
+	//anything but the active file and the GC itself
+	e.mu.Lock()
+	for num, f := range e.files {
+		if f.obsolete && f.refs == 0 {
+			f.f.Close()
+			os.Remove(f.f.Name())
+			delete(e.files, num)
+		}
+	}
+	var limit uint64
+	if e.active != nil {
+		limit = e.active.num
+	} else {
+		limit = e.next
+	}
+	//The pointers of pending writes may be stored after the scan below
+	//has passed them
+	busy := make(map[uint64]bool)
+	for num, f := range e.files {
+		if f.pending > 0 {
+			busy[num] = true
+		}
+	}
+	e.mu.Unlock()
+
+	live := make(map[uint64]int64)
+	refs := make(map[uint64][]blobRef)
+	for _, col := range []Column{QUEUE, PERSIST} {
+		it := e.Engine.NewIterator(col, nil)
+		for ; it.HasNext(); it.Next() {
+			v := it.Value()
+			p, ok := parseBlobPointer(v)
+			if !ok || p.file >= limit {
+				continue
+			}
+			live[p.file] += int64(blobRecordHeader + p.length)
+			refs[p.file] = append(refs[p.file], blobRef{col: col, key: it.Key(), ptr: v})
+		}
+	}
+
+	e.mu.Lock()
+	victims := []*blobFile{}
+	for num, f := range e.files {
+		if num >= limit || f.obsolete || busy[num] || f.pending > 0 {
+			continue
+		}
+		if f.size == 0 || float64(live[num])/float64(f.size) < BlobGCMinLiveRatio {
+			victims = append(victims, f)
+		}
+	}
+	e.mu.Unlock()
+
+	for _, f := range victims {
+		frefs := refs[f.num]
+		for len(frefs) > 0 {
+			n := len(frefs)
+			if n > blobGCSwapBatch {
+				n = blobGCSwapBatch
+			}
+			if err := e.relocate(frefs[:n]); err != nil {
+				return err
+			}
+			frefs = frefs[n:]
+		}
+		e.mu.Lock()
+		f.obsolete = true
+		e.mu.Unlock()
+		fmt.Printf("rewrote blob file %016x, %d of %d bytes were live\n", f.num, live[f.num], f.size)
+	}
+	return nil
+}
+
+//Copy the values to the active file and point the keys at the copies,
+//unless they were changed in the meantime
+func (e *blobEngine) relocate(refs []blobRef) error {
+	moved := make([][]byte, len(refs))
+	files := make([]*blobFile, 0, len(refs))
+	defer func() {
+		e.settle(files)
+	}()
+	for i, r := range refs {
+		p, _ := parseBlobPointer(r.ptr)
+		v, err := e.read(p)
+		if err != nil {
+			return err
+		}
+		var f *blobFile
+		f, moved[i] = e.write(v)
+		files = append(files, f)
+	}
+	//The copies must be durable before the old file can be removed
+	if err := e.sync(files); err != nil {
+		return err
+	}
+	e.gcmu.Lock()
+	defer e.gcmu.Unlock()
+	for i, r := range refs {
+		cur, err := e.Engine.Get(r.col, r.key)
+		if err == ErrObjNotFound || (err == nil && !bytes.Equal(cur, r.ptr)) {
+			continue
+		}
+		if err == nil {
+			err = e.Engine.Set(r.col, r.key, moved[i])
+		}
+		if err != nil {
+			return err
+		}
+	}
+	return nil
+}
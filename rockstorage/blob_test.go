@@ -0,0 +1,122 @@
+package rocksdb
+
+import (
+	"bytes"
+	"io/ioutil"
+	"os"
+	"testing"
+
+	"github.com/stretchr/testify/require"
+)
+
+func TestBlobEngine(t *testing.T) {
+	require := require.New(t)
+	dir, err := ioutil.TempDir("", "blobtest")
+	require.NoError(err)
+	defer os.RemoveAll(dir)
+	inner := NewMemoryEngine()
+	e := newBlobEngine(inner, StorageConfig{BlobDataStore: dir, BlobMinSize: 100}).(*blobEngine)
+	defer e.Close()
+
+	big := func(b byte) []byte { return bytes.Repeat([]byte{b}, 1000) }
+	require.NoError(e.Set(QUEUE, []byte("k/small"), []byte("small")))
+	for i := byte(0); i < 10; i++ {
+		require.NoError(e.Set(QUEUE, []byte{'k', '/', i}, big(i)))
+	}
+	wb := e.NewWriteBatch(PERSIST)
+	wb.Set([]byte("p"), big(20))
+	require.NoError(wb.Commit())
+	//Small values and other columns are stored as they are
+	v, err := inner.Get(QUEUE, []byte("k/small"))
+	require.NoError(err)
+	require.Equal([]byte("small"), v)
+	require.NoError(e.Set(PROOF, []byte("proof"), big(30)))
+	v, err = inner.Get(PROOF, []byte("proof"))
+	require.NoError(err)
+	require.Equal(big(30), v)
+	v, err = inner.Get(PERSIST, []byte("p"))
+	require.NoError(err)
+	require.Len(v, blobPointerLength)
+
+	v, err = e.Get(PERSIST, []byte("p"))
+	require.NoError(err)
+	require.Equal(big(20), v)
+	values := [][]byte{}
+	for it := e.NewIterator(QUEUE, []byte("k/")); it.HasNext(); it.Next() {
+		values = append(values, it.Value())
+	}
+	require.Len(values, 11)
+	require.Equal(big(3), values[3])
+
+	//Make most of the first file garbage and start a new one
+	for i := byte(0); i < 8; i++ {
+		require.NoError(e.Delete(QUEUE, []byte{'k', '/', i}))
+	}
+	e.active = nil
+	require.NoError(e.gc())
+	require.True(e.files[1].obsolete)
+	for i := byte(8); i < 10; i++ {
+		v, err = e.Get(QUEUE, []byte{'k', '/', i})
+		require.NoError(err)
+		require.Equal(big(i), v)
+	}
+	v, err = e.Get(PERSIST, []byte("p"))
+	require.NoError(err)
+	require.Equal(big(20), v)
+	//The obsolete file is removed on the next pass
+	require.NoError(e.gc())
+	_, ok := e.files[1]
+	require.False(ok)
+	v, err = e.Get(QUEUE, []byte{'k', '/', 9})
+	require.NoError(err)
+	require.Equal(big(9), v)
+}
+
+func TestBlobUncommittedBatch(t *testing.T) {
+	require := require.New(t)
+	dir, err := ioutil.TempDir("", "blobtest")
+	require.NoError(err)
+	defer os.RemoveAll(dir)
+	e := newBlobEngine(NewMemoryEngine(), StorageConfig{BlobDataStore: dir, BlobMinSize: 100}).(*blobEngine)
+	defer e.Close()
+
+	big := bytes.Repeat([]byte{1}, 1000)
+	wb := e.NewWriteBatch(PERSIST)
+	wb.Set([]byte("p"), big)
+	//The file fills up and the GC runs before the batch is committed. The
+	//file looks like it holds no live values
+	e.active = nil
+	require.NoError(e.gc())
+	require.False(e.files[1].obsolete)
+	require.NoError(wb.Commit())
+	require.NoError(e.gc())
+	require.NoError(e.gc())
+	v, err := e.Get(PERSIST, []byte("p"))
+	require.NoError(err)
+	require.Equal(big, v)
+}
+
+func TestBlobLostRecord(t *testing.T) {
+	require := require.New(t)
+	dir, err := ioutil.TempDir("", "blobtest")
+	require.NoError(err)
+	defer os.RemoveAll(dir)
+	e := newBlobEngine(NewMemoryEngine(), StorageConfig{BlobDataStore: dir, BlobMinSize: 100}).(*blobEngine)
+	defer e.Close()
+
+	require.NoError(e.Set(QUEUE, []byte("q/1"), bytes.Repeat([]byte{1}, 1000)))
+	require.NoError(e.Set(QUEUE, []byte("q/2"), bytes.Repeat([]byte{2}, 1000)))
+	//The second record did not survive a crash
+	require.NoError(e.files[1].f.Truncate(blobRecordHeader + 1000))
+	values := [][]byte{}
+	errs := []error{}
+	for it := e.NewIterator(QUEUE, []byte("q/")); it.HasNext(); it.Next() {
+		values = append(values, it.Value())
+		errs = append(errs, it.Err())
+	}
+	require.Equal([][]byte{bytes.Repeat([]byte{1}, 1000), nil}, values)
+	require.NoError(errs[0])
+	require.Error(errs[1])
+	_, err = e.Get(QUEUE, []byte("q/2"))
+	require.Error(err)
+}
@@ -1,3 +1,5 @@
+// +build !norocksdb
+
 #include <cstdio>
 #include <string>
 #include <iostream>
@@ -8,6 +10,17 @@
 #include "rocksdb/utilities/optimistic_transaction_db.h"
 
 #include <stdlib.h>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+
+extern "C" {
+    #include "iface.h"
+}
 
 using namespace rocksdb;
 using std::cerr;
@@ -21,23 +34,474 @@ static ReadOptions read_opts;
 //TransactionOptions txn_opts;
 static std::vector<ColumnFamilyHandle*> handles;
 
+//The asynchronous API. Go pushes operations onto the submission queue in
+//batches, a fixed pool of worker threads executes them and pushes the
+//results onto the completion queue, where a single Go goroutine reaps them.
+//Only that goroutine blocks in C, so storage stalls do not pin an OS thread
+//per waiting goroutine
+struct async_op {
+    uint64_t id;
+    int op;
+    int col;
+    std::string key;
+    std::string value;
+};
+
+//Workers take up to this many operations at once. The writes among them
+//are applied as one write batch
+static const size_t async_worker_batch = 64;
+
+static std::mutex sub_mu;
+static std::condition_variable sub_cv;
+static std::deque<async_op> subq;
+static std::mutex comp_mu;
+static std::condition_variable comp_cv;
+static std::deque<db_completion> compq;
+static std::vector<std::thread> async_workers;
+static std::atomic<bool> async_stopping(false);
+//Set once the workers have exited, protected by comp_mu. Until then more
+//completions may arrive even though async_stopping is set
+static bool async_drained = false;
+
 TableFactory *makeSpinningMetalTableFactory() {
     auto block_opts = BlockBasedTableOptions{};
     block_opts.cache_index_and_filter_blocks = true;
     return NewBlockBasedTableFactory(block_opts);
 }
 
+//The wildcard query engine for the persisted messages. It implements the
+//same matching as getMatchingMessage in core/persistdb.go, but with an
+//explicit stack instead of a goroutine per child, on a single snapshot and
+//with a single iterator that is re-seeked when a scan resumes. Results are
+//produced as the caller asks for them, so memory stays bounded. A query
+//with a limit stops at the first match past it, and returns a cursor that
+//the next page resumes at. A read error ends the query and is returned.
+//
+//The persist column holds two trees, see core/persistdb.go. Keys are the
+//tree byte, the number of URI levels and the URI. Only the normal tree
+//holds message bodies
+static const char persist_tree_interlaced = 1;
+static const char persist_tree_normal = 2;
+static const int persist_col = 2;
+
+typedef std::vector<std::string> uriparts;
+
+static uriparts split_uri(const std::string& s) {
+    uriparts rv;
+    size_t start = 0;
+    while (true) {
+        size_t idx = s.find('/', start);
+        if (idx == std::string::npos) {
+            rv.push_back(s.substr(start));
+            return rv;
+        }
+        rv.push_back(s.substr(start, idx - start));
+        start = idx + 1;
+    }
+}
+
+static std::string join_uri(const uriparts& uri, size_t n) {
+    std::string rv;
+    for (size_t i = 0; i < n; i++) {
+        if (i > 0) rv += '/';
+        rv += uri[i];
+    }
+    return rv;
+}
+
+static std::string persist_key(char tree, const uriparts& uri, size_t n, size_t levels) {
+    std::string rv;
+    rv += tree;
+    rv += (char) levels;
+    rv += join_uri(uri, n);
+    return rv;
+}
+
+static uriparts uninterlace_uri(const uriparts& rv) {
+    uriparts uri(rv.size());
+    for (size_t i = 0; i < uri.size(); i += 2) {
+        uri[i/2] = rv[i];
+        if (i + 1 < uri.size()) {
+            uri[(uri.size()-1)-i/2] = rv[i+1];
+        }
+    }
+    return uri;
+}
+
+static uriparts interlace_uri(const uriparts& uri) {
+    uriparts rv(uri.size());
+    for (size_t i = 0; i < uri.size(); i += 2) {
+        rv[i] = uri[i/2];
+        if (i + 1 < uri.size()) {
+            rv[i+1] = uri[(uri.size()-1)-i/2];
+        }
+    }
+    return rv;
+}
+
+//Uninterlace the first n elements of rv and put the remaining *D in the
+//middle
+static uriparts advanced_uninterlace_uri(const uriparts& rv, size_t n, const uriparts& frontD, const uriparts& backD) {
+    uriparts uri(n + frontD.size() + backD.size());
+    size_t fidx = 0;
+    size_t bidx = uri.size() - 1;
+    for (size_t i = 0; i < n; i++) {
+        if ((i & 1) == 0) {
+            uri[fidx++] = rv[i];
+        } else {
+            uri[bidx--] = rv[i];
+        }
+    }
+    for (auto& v : frontD) {
+        uri[fidx++] = v;
+    }
+    for (auto& v : backD) {
+        uri[bidx--] = v;
+    }
+    return uri;
+}
+
+static bool is_wild(const std::string& s) {
+    return s == "*" || s == "+";
+}
+
+static bool is_dummy(const std::string& v) {
+    return v.size() == 1 && v[0] == 0;
+}
+
+//A pending call of getMatchingMessage
+struct query_frame {
+    bool interlaced;
+    uriparts uri;
+    size_t prefix;
+    uriparts frontD;
+    uriparts backD;
+    bool skipbase;
+
+    //Set once the frame is scanning the children at level nprefix
+    bool scanning;
+    size_t nprefix;
+    std::string pfx;
+    std::string lastkey;
+
+    //Set if the frame is on the path to the end of the previous page
+    bool resuming;
+    //Set if the scan resumes at lastkey rather than after it
+    bool resume_at;
+};
+
+struct query_result {
+    std::string uri;
+    std::string value;
+};
+
+struct query_state {
+    const Snapshot* snap;
+    ReadOptions ro;
+    Iterator* it;
+    //The frame the iterator is positioned for, or -1
+    long it_frame;
+    std::vector<query_frame> stack;
+    std::deque<query_result> out;
+    size_t limit;
+    size_t emitted;
+    //Candidate matches that have not been looked up yet
+    std::vector<uriparts> pending;
+
+    //A page ends after the match found under the scan keys of the frames
+    //below it. The keys of the candidates are kept if there is a limit,
+    //and the query resumes at the keys of the previous page if any
+    std::vector<std::vector<std::string>> pending_paths;
+    std::vector<std::string> resume;
+    std::vector<std::string> cursor;
+    bool has_cursor;
+    //The first read error, which ends the query
+    Status status;
+};
+
+//The number of candidate matches looked up with one MultiGet
+static const size_t query_multiget_batch = 64;
+
+static void query_resolve(query_state* q) {
+    std::vector<std::string> keys;
+    std::vector<Slice> slices;
+    keys.reserve(q->pending.size());
+    for (auto& uri : q->pending) {
+        keys.push_back(persist_key(persist_tree_normal, uri, uri.size(), uri.size()));
+    }
+    for (auto& k : keys) {
+        slices.push_back(Slice(k));
+    }
+    std::vector<ColumnFamilyHandle*> cfs(keys.size(), handles[persist_col]);
+    std::vector<std::string> values;
+    std::vector<Status> st = db->MultiGet(q->ro, cfs, slices, &values);
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (st[i].IsNotFound()) {
+            continue;
+        }
+        if (!st[i].ok()) {
+            q->status = st[i];
+            break;
+        }
+        if (is_dummy(values[i])) {
+            continue;
+        }
+        if (q->limit > 0 && q->emitted >= q->limit) {
+            //A match after the end of the page, so there is a next one
+            q->has_cursor = true;
+            break;
+        }
+        q->emitted++;
+        auto& uri = q->pending[i];
+        q->out.push_back(query_result{join_uri(uri, uri.size()), std::move(values[i])});
+        if (q->limit > 0 && q->emitted == q->limit) {
+            q->cursor = std::move(q->pending_paths[i]);
+        }
+    }
+    q->pending.clear();
+    q->pending_paths.clear();
+}
+
+static void query_push(query_state* q, bool interlaced, const uriparts& uri, size_t prefix,
+        const uriparts& frontD, const uriparts& backD, bool skipbase) {
+    query_frame f;
+    f.interlaced = interlaced;
+    f.uri = uri;
+    f.prefix = prefix;
+    f.frontD = frontD;
+    f.backD = backD;
+    f.skipbase = skipbase;
+    f.scanning = false;
+    f.nprefix = 0;
+    f.resuming = false;
+    f.resume_at = false;
+    q->stack.push_back(std::move(f));
+}
+
+static void query_pop(query_state* q) {
+    q->stack.pop_back();
+    if (q->it_frame >= (long) q->stack.size()) {
+        q->it_frame = -1;
+    }
+}
+
+//Queue a lookup of a candidate match. Messages are only stored in the
+//normal tree, the interlaced tree just references them, so candidates are
+//always looked up by their normal key. They are resolved in batches, or
+//one at a time once the page is full and we only look for whether there
+//is another match
+static void query_get(query_state* q, const uriparts& uri) {
+    q->pending.push_back(uri);
+    if (q->limit > 0) {
+        std::vector<std::string> path;
+        for (size_t i = 0; i + 1 < q->stack.size(); i++) {
+            path.push_back(q->stack[i].lastkey);
+        }
+        q->pending_paths.push_back(std::move(path));
+    }
+    if (q->pending.size() >= query_multiget_batch || (q->limit > 0 && q->emitted >= q->limit)) {
+        query_resolve(q);
+    }
+}
+
+//Evaluate the top frame up to its scan
+static void query_eval(query_state* q) {
+    query_frame& f = q->stack.back();
+    char tree = f.interlaced ? persist_tree_interlaced : persist_tree_normal;
+    //Extend our prefix until the next wildcard
+    size_t np = f.prefix;
+    for (; np < f.uri.size() && !is_wild(f.uri[np]); np++) {
+    }
+    //If there is no next wildcard, it is the end. When resuming, the
+    //candidates of the frames on the path came before the end of the
+    //previous page
+    if (np == f.uri.size()) {
+        if (!f.resuming) {
+            query_get(q, f.interlaced ? uninterlace_uri(f.uri) : f.uri);
+        }
+        query_pop(q);
+        return;
+    }
+    //If the next wildcard is a star, the base case is it being omitted
+    if (f.uri[np] == "*" && !f.skipbase && !f.resuming) {
+        uriparts direct;
+        if (f.interlaced) {
+            direct = advanced_uninterlace_uri(f.uri, np, f.frontD, f.backD);
+        } else {
+            direct.assign(f.uri.begin(), f.uri.begin() + np);
+            for (auto it = f.backD.rbegin(); it != f.backD.rend(); ++it) {
+                direct.push_back(*it);
+            }
+        }
+        query_get(q, direct);
+    }
+    //If the next wildcard is a star, we can skip the scan when the level
+    //can be populated from *D
+    if (f.uri[np] == "*" && f.interlaced) {
+        uriparts* d = NULL;
+        if (np % 2 == 0 && !f.frontD.empty()) {
+            d = &f.frontD;
+        } else if (np % 2 == 1 && !f.backD.empty()) {
+            d = &f.backD;
+        }
+        if (d != NULL) {
+            f.uri.resize(np + 2);
+            f.uri[np] = d->front();
+            f.uri[np+1] = "*";
+            d->erase(d->begin());
+            //Don't advance the prefix because the element may be a +
+            f.prefix = np;
+            f.skipbase = true;
+            return;
+        }
+    }
+    f.scanning = true;
+    f.nprefix = np;
+    f.pfx = persist_key(tree, f.uri, np, np + 1);
+    if (np > 0) {
+        f.pfx += '/';
+    }
+    //If the previous page ended below this frame, resume at the child it
+    //ended in, otherwise it ended at this frame and all children follow
+    size_t depth = q->stack.size() - 1;
+    if (f.resuming && depth < q->resume.size() && Slice(q->resume[depth]).starts_with(Slice(f.pfx))) {
+        f.lastkey = q->resume[depth];
+        f.resume_at = true;
+    }
+    f.resuming = false;
+}
+
+//Advance the scan of the top frame by one child
+static void query_scan(query_state* q) {
+    long idx = (long) q->stack.size() - 1;
+    query_frame& f = q->stack.back();
+    Iterator* it = q->it;
+    bool resuming = false;
+    if (q->it_frame == idx) {
+        it->Next();
+    } else if (f.lastkey.empty()) {
+        it->Seek(f.pfx);
+    } else {
+        it->Seek(f.lastkey);
+        bool at = it->Valid() && it->key() == Slice(f.lastkey);
+        if (f.resume_at) {
+            //The child the previous page ended in is resumed, unless it
+            //has been removed since
+            resuming = at;
+            f.resume_at = false;
+        } else if (at) {
+            it->Next();
+        }
+    }
+    q->it_frame = idx;
+    if (!it->Valid() && !it->status().ok()) {
+        q->status = it->status();
+        return;
+    }
+    if (!it->Valid() || !it->key().starts_with(Slice(f.pfx))) {
+        query_pop(q);
+        return;
+    }
+    f.lastkey = it->key().ToString();
+    uriparts actual = split_uri(f.lastkey.substr(2));
+    uriparts child;
+    if (f.uri[f.nprefix] == "+") {
+        child = f.uri;
+        std::copy(actual.begin(), actual.end(), child.begin());
+    } else {
+        //The child must include the star
+        child = actual;
+        child.insert(child.end(), f.uri.begin() + f.nprefix, f.uri.end());
+    }
+    //Copy these out as pushing may move the frame
+    uriparts frontD = f.frontD;
+    uriparts backD = f.backD;
+    query_push(q, f.interlaced, child, f.nprefix, frontD, backD, false);
+    q->stack.back().resuming = resuming;
+}
+
+//A cursor is the version followed by the scan keys, each with a big
+//endian 32 bit length
+static const char query_cursor_version = 1;
+
+static std::string query_encode_cursor(const std::vector<std::string>& keys) {
+    std::string rv;
+    rv += query_cursor_version;
+    for (auto& k : keys) {
+        uint32_t ln = k.size();
+        rv += (char)(ln >> 24);
+        rv += (char)(ln >> 16);
+        rv += (char)(ln >> 8);
+        rv += (char)ln;
+        rv += k;
+    }
+    return rv;
+}
+
+static bool query_decode_cursor(const char* c, size_t len, std::vector<std::string>* keys) {
+    if (len < 1 || c[0] != query_cursor_version) {
+        return false;
+    }
+    size_t i = 1;
+    while (i < len) {
+        if (len - i < 4) {
+            return false;
+        }
+        const unsigned char* u = (const unsigned char*)(c + i);
+        size_t ln = ((size_t)u[0] << 24) | ((size_t)u[1] << 16) | ((size_t)u[2] << 8) | u[3];
+        i += 4;
+        if (len - i < ln) {
+            return false;
+        }
+        keys->push_back(std::string(c + i, ln));
+        i += ln;
+    }
+    return true;
+}
+
+static CompressionType compression_type(int32_t t) {
+    switch (t) {
+    case DB_COMPRESSION_SNAPPY:
+        return kSnappyCompression;
+    case DB_COMPRESSION_LZ4:
+        return kLZ4Compression;
+    case DB_COMPRESSION_ZSTD:
+        return kZSTD;
+    default:
+        return kNoCompression;
+    }
+}
+
+//Small protobufs compress poorly block by block, so the bottommost level,
+//where most of the data ends up, is compressed with a dictionary sampled or
+//trained from each SST file. The upper levels are flushed and rewritten
+//often, so they do without, as building a dictionary buffers the whole file
+static void set_compression(ColumnFamilyOptions& cf, const db_compression& c) {
+    cf.compression = compression_type(c.type);
+    cf.bottommost_compression = compression_type(c.bottommost_type);
+    if (c.level != 0) {
+        cf.bottommost_compression_opts.level = c.level;
+    }
+    cf.bottommost_compression_opts.max_dict_bytes = c.max_dict_bytes;
+    cf.bottommost_compression_opts.zstd_max_train_bytes = c.zstd_max_train_bytes;
+    cf.bottommost_compression_opts.enabled = true;
+}
+
 extern "C" {
-    #include "iface.h"
 
-    void init(std::string dbname, size_t spinning_metal) {
+    void init(std::string dbname, size_t spinning_metal, const db_compression* compression) {
         std::vector<ColumnFamilyDescriptor> cfs;
 
         Options opts;
         opts.create_if_missing = true;
         opts.create_missing_column_families = true;
         opts.OptimizeLevelStyleCompaction();
-        //opts.enable_pipelined_write=true;
+        //The queue flush commits several write batches at once, let them
+        //insert into the memtable concurrently and overlap the WAL write of
+        //one group with the memtable write of the previous one
+        opts.allow_concurrent_memtable_write = true;
+        opts.enable_write_thread_adaptive_yield = true;
+        opts.enable_pipelined_write = true;
 
         ColumnFamilyOptions cf_options;
 
@@ -56,9 +520,12 @@ extern "C" {
             opts.IncreaseParallelism();
         }
 
-        cfs.push_back(ColumnFamilyDescriptor(kDefaultColumnFamilyName, cf_options));
-        cfs.push_back(ColumnFamilyDescriptor("CF_QUEUE", cf_options));
-        cfs.push_back(ColumnFamilyDescriptor("CF_PERSIST", cf_options));
+        const char* names[] = {kDefaultColumnFamilyName.c_str(), "CF_QUEUE", "CF_PERSIST", "CF_PROOF"};
+        for (int col = 0; col < 4; col++) {
+            ColumnFamilyOptions col_options = cf_options;
+            set_compression(col_options, compression[col]);
+            cfs.push_back(ColumnFamilyDescriptor(names[col], col_options));
+        }
 
         Status s = OptimisticTransactionDB::Open(opts, dbname, cfs, &handles, &db);//cfs, &handles, &db);
         cerr << 4;
@@ -208,6 +675,11 @@ extern "C" {
         batch->Put(handles[col], Slice(key, keylen), Slice(value, valuelen));
     }
 
+    void db_wb_delete(int col, void* state, const char *key, size_t keylen) {
+        WriteBatch* batch = (WriteBatch*) state;
+        batch->Delete(handles[col], Slice(key, keylen));
+    }
+
     void db_wb_commit(int col, void* state, char** error, size_t* errorlen) {
         WriteBatch* batch = (WriteBatch*) state;
         Status s = db->Write(write_opts, batch);
@@ -224,9 +696,296 @@ extern "C" {
         return;
     }
 
-    void c_init(const char* name, size_t namelen, size_t spinning_metal) {
+    static void copy_error(const Status& s, char** error, size_t* errorlen) {
+        auto e = s.ToString();
+        *error = (char*) malloc(e.size());
+        *errorlen = e.size();
+        memcpy(*error, e.data(), e.size());
+    }
+
+    static void async_worker() {
+        std::vector<async_op> ops;
+        std::vector<db_completion> done;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lk(sub_mu);
+                sub_cv.wait(lk, []{ return !subq.empty() || async_stopping; });
+                if (subq.empty()) {
+                    return;
+                }
+                while (!subq.empty() && ops.size() < async_worker_batch) {
+                    ops.push_back(std::move(subq.front()));
+                    subq.pop_front();
+                }
+            }
+            WriteBatch batch;
+            for (auto& op : ops) {
+                db_completion c;
+                memset(&c, 0, sizeof(c));
+                c.id = op.id;
+                switch (op.op) {
+                case DB_OP_GET: {
+                    std::string value;
+                    Status s = db->Get(read_opts, handles[op.col], op.key, &value);
+                    if (s.IsNotFound()) {
+                        c.notfound = 1;
+                    } else if (!s.ok()) {
+                        copy_error(s, &c.err, &c.errlen);
+                    } else {
+                        //malloc(0) may return NULL, which would read as no value
+                        c.value = (char*) malloc(value.size() + 1);
+                        c.valuelen = value.size();
+                        memcpy(c.value, value.data(), value.size());
+                    }
+                    break;
+                }
+                case DB_OP_SET:
+                    batch.Put(handles[op.col], op.key, op.value);
+                    break;
+                case DB_OP_DELETE:
+                    batch.Delete(handles[op.col], op.key);
+                    break;
+                }
+                done.push_back(c);
+            }
+            if (batch.Count() > 0) {
+                Status s = db->Write(write_opts, &batch);
+                if (!s.ok()) {
+                    cerr << "async write: " << s.ToString() << endl;
+                    for (size_t i = 0; i < ops.size(); i++) {
+                        if (ops[i].op != DB_OP_GET) {
+                            copy_error(s, &done[i].err, &done[i].errlen);
+                        }
+                    }
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lk(comp_mu);
+                compq.insert(compq.end(), done.begin(), done.end());
+            }
+            comp_cv.notify_one();
+            ops.clear();
+            done.clear();
+        }
+    }
+
+    void db_async_start(size_t threads) {
+        async_stopping = false;
+        {
+            std::lock_guard<std::mutex> lk(comp_mu);
+            async_drained = false;
+        }
+        for (size_t i = 0; i < threads; i++) {
+            async_workers.push_back(std::thread(async_worker));
+        }
+    }
+
+    void db_async_submit(const db_op* ops, size_t n, const char* data) {
+        {
+            std::lock_guard<std::mutex> lk(sub_mu);
+            for (size_t i = 0; i < n; i++) {
+                async_op op;
+                op.id = ops[i].id;
+                op.op = ops[i].op;
+                op.col = ops[i].col;
+                op.key.assign(data + ops[i].keyoff, ops[i].keylen);
+                op.value.assign(data + ops[i].valueoff, ops[i].valuelen);
+                subq.push_back(std::move(op));
+            }
+        }
+        if (n == 1) {
+            sub_cv.notify_one();
+        } else {
+            sub_cv.notify_all();
+        }
+    }
+
+    size_t db_async_reap(db_completion* out, size_t max) {
+        std::unique_lock<std::mutex> lk(comp_mu);
+        comp_cv.wait(lk, []{ return !compq.empty() || async_drained; });
+        size_t n = 0;
+        while (!compq.empty() && n < max) {
+            out[n++] = compq.front();
+            compq.pop_front();
+        }
+        return n;
+    }
+
+    void db_async_stop() {
+        {
+            std::lock_guard<std::mutex> lk(sub_mu);
+            async_stopping = true;
+        }
+        sub_cv.notify_all();
+        //Workers finish the submitted operations before they exit
+        for (auto& t : async_workers) {
+            t.join();
+        }
+        async_workers.clear();
+        {
+            std::lock_guard<std::mutex> lk(comp_mu);
+            async_drained = true;
+        }
+        comp_cv.notify_all();
+    }
+
+    //Begin a query. If cursor is not NULL, it is the cursor returned by
+    //db_query_cursor for the previous page of the same query. Returns NULL
+    //if the cursor is malformed
+    void* db_query_start(const char* uri, size_t urilen, size_t limit, const char* cursor, size_t cursorlen) {
+        std::vector<std::string> resume;
+        bool resuming = cursor != NULL;
+        if (resuming && !query_decode_cursor(cursor, cursorlen, &resume)) {
+            return NULL;
+        }
+        query_state* q = new query_state();
+        q->snap = db->GetSnapshot();
+        q->ro.snapshot = q->snap;
+        q->it = db->NewIterator(q->ro, handles[persist_col]);
+        q->it_frame = -1;
+        q->limit = limit;
+        q->emitted = 0;
+        q->resume = std::move(resume);
+        q->has_cursor = false;
+
+        uriparts parts = split_uri(std::string(uri, urilen));
+        long staridx = -1;
+        for (size_t i = 0; i < parts.size(); i++) {
+            if (parts[i] == "*") {
+                staridx = i;
+            }
+        }
+        if (staridx == -1) {
+            query_push(q, false, parts, 0, uriparts(), uriparts(), false);
+            q->stack.back().resuming = resuming;
+            return q;
+        }
+        //Pick the tree that lets us use the longer of the prefix and the
+        //suffix around the star
+        size_t pfxlen = staridx;
+        size_t sfxlen = parts.size() - staridx - 1;
+        if ((long) pfxlen - (long) sfxlen > (long) sfxlen) {
+            uriparts u(parts.begin(), parts.begin() + pfxlen + 1);
+            uriparts backD;
+            for (size_t i = 0; i < sfxlen; i++) {
+                backD.push_back(parts[parts.size()-1-i]);
+            }
+            query_push(q, false, u, 0, uriparts(), backD, false);
+            q->stack.back().resuming = resuming;
+            return q;
+        }
+        size_t common = std::min(pfxlen, sfxlen);
+        uriparts u = interlace_uri(parts);
+        u.resize(common*2 + 1);
+        u[common*2] = "*";
+        uriparts frontD(parts.begin() + common, parts.begin() + pfxlen);
+        uriparts backD;
+        for (size_t i = 0; i < sfxlen - common; i++) {
+            backD.push_back(parts[parts.size()-1-i-common]);
+        }
+        query_push(q, true, u, 0, frontD, backD, false);
+        q->stack.back().resuming = resuming;
+        return q;
+    }
+
+    //Fill buf with results, each the URI length, the URI, the value length
+    //and the value, with big endian 32 bit lengths. Returns the number of
+    //bytes written. If the next result does not fit in an empty buffer,
+    //need is set to its size. done is set once there are no more results,
+    //or with error set if the query failed
+    size_t db_query_next(void* state, char* buf, size_t bufcap, size_t* need, int* done, char** error, size_t* errorlen) {
+        query_state* q = (query_state*) state;
+        size_t n = 0;
+        *need = 0;
+        *done = 0;
+        *errorlen = 0;
+        while (true) {
+            if (!q->status.ok()) {
+                copy_error(q->status, error, errorlen);
+                *done = 1;
+                return 0;
+            }
+            while (!q->out.empty()) {
+                query_result& r = q->out.front();
+                size_t sz = 8 + r.uri.size() + r.value.size();
+                if (n + sz > bufcap) {
+                    if (n == 0) {
+                        *need = sz;
+                    }
+                    return n;
+                }
+                for (auto& field : {std::cref(r.uri), std::cref(r.value)}) {
+                    uint32_t ln = field.get().size();
+                    buf[n++] = (char)(ln >> 24);
+                    buf[n++] = (char)(ln >> 16);
+                    buf[n++] = (char)(ln >> 8);
+                    buf[n++] = (char)ln;
+                    memcpy(buf + n, field.get().data(), ln);
+                    n += ln;
+                }
+                q->out.pop_front();
+            }
+            if (q->has_cursor) {
+                *done = 1;
+                return n;
+            }
+            if (q->stack.empty()) {
+                if (q->pending.empty()) {
+                    *done = 1;
+                    return n;
+                }
+                query_resolve(q);
+                continue;
+            }
+            if (q->stack.back().scanning) {
+                query_scan(q);
+            } else {
+                query_eval(q);
+            }
+        }
+    }
+
+    //Once db_query_next is done, write the cursor of the next page to buf
+    //if there is one. Returns its size, or 0 if there is none. If the
+    //size is larger than bufcap, nothing is written
+    size_t db_query_cursor(void* state, char* buf, size_t bufcap) {
+        query_state* q = (query_state*) state;
+        if (!q->has_cursor) {
+            return 0;
+        }
+        std::string c = query_encode_cursor(q->cursor);
+        if (c.size() <= bufcap) {
+            memcpy(buf, c.data(), c.size());
+        }
+        return c.size();
+    }
+
+    void db_query_end(void* state) {
+        query_state* q = (query_state*) state;
+        delete q->it;
+        db->ReleaseSnapshot(q->snap);
+        delete q;
+    }
+
+    void c_init(const char* name, size_t namelen, size_t spinning_metal, const db_compression* compression) {
         std::string dbname = std::string(name, namelen);
-        init(dbname, spinning_metal);
+        init(dbname, spinning_metal, compression);
+    }
+
+    //Sum the uncompressed and stored sizes of the data blocks of the SST
+    //files of a column family
+    void db_compression_stats(int col, uint64_t* raw, uint64_t* stored) {
+        *raw = 0;
+        *stored = 0;
+        TablePropertiesCollection props;
+        Status s = db->GetPropertiesOfAllTables(handles[col], &props);
+        if (!s.ok()) {
+            return;
+        }
+        for (auto& p : props) {
+            *raw += p.second->raw_key_size + p.second->raw_value_size;
+            *stored += p.second->data_size;
+        }
     }
 
     void close_db() {
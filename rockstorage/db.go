@@ -1,3 +1,5 @@
+// +build !norocksdb
+
 package rocksdb
 
 // #cgo CXXFLAGS: -I./include/ -std=gnu++11
@@ -5,23 +7,16 @@ package rocksdb
 // #include "iface.h"
 import "C"
 import (
-	"errors"
 	"fmt"
 	"runtime"
-	"sync"
 	"unsafe"
 )
 
-type Column int
-
-const (
-	QUEUE   Column = 1
-	PERSIST Column = 2
-)
-
-var initOnce sync.Once
-
-var ErrObjNotFound = errors.New("Object Not Found")
+//The engine backed by the RocksDB shim in db.cc. There can only be one
+type rocksEngine struct {
+	//Nil unless StorageConfig.AsyncWorkers is set, see async.go
+	async *asyncQueue
+}
 
 type RocksdbErr struct {
 	message string
@@ -46,23 +41,92 @@ func getError(errstr *C.char, errlen C.size_t) error {
 	return nil
 }
 
-func Initialize(conf StorageConfig) {
-	initOnce.Do(func() {
-		dbname := conf.DataStore
-		spinning_metal := conf.OptimizeForSpinningMetal
-		opt_for_spin := 0
-		if spinning_metal {
-			opt_for_spin = 1
-		}
-		name := []byte(dbname)
-		C.c_init((*C.char)(unsafe.Pointer(&name[0])), (C.size_t)(len(name)), (C.size_t)(opt_for_spin))
-	})
+func newRocksEngine(conf StorageConfig) Engine {
+	dbname := conf.DataStore
+	spinning_metal := conf.OptimizeForSpinningMetal
+	opt_for_spin := 0
+	if spinning_metal {
+		opt_for_spin = 1
+	}
+	name := []byte(dbname)
+	var compression [4]C.db_compression
+	compression[0] = cCompression(DefaultCompression)
+	compression[QUEUE] = cCompression(conf.QueueCompression.orDefault())
+	compression[PERSIST] = cCompression(conf.PersistCompression.orDefault())
+	compression[PROOF] = cCompression(conf.ProofCompression.orDefault())
+	C.c_init((*C.char)(unsafe.Pointer(&name[0])), (C.size_t)(len(name)), (C.size_t)(opt_for_spin), &compression[0])
+	rv := &rocksEngine{}
+	if conf.AsyncWorkers > 0 {
+		rv.async = startAsync(conf.AsyncWorkers)
+	}
+	return rv
+}
+
+func cCompressionType(t string) C.int32_t {
+	switch t {
+	case CompressionNone:
+		return C.DB_COMPRESSION_NONE
+	case CompressionSnappy:
+		return C.DB_COMPRESSION_SNAPPY
+	case CompressionLZ4:
+		return C.DB_COMPRESSION_LZ4
+	case CompressionZSTD:
+		return C.DB_COMPRESSION_ZSTD
+	default:
+		panic(fmt.Sprintf("unknown compression %q", t))
+	}
 }
 
-func Close() {
+func cCompression(c CompressionConfig) C.db_compression {
+	return C.db_compression{
+		_type:                cCompressionType(c.Type),
+		bottommost_type:      cCompressionType(c.BottommostType),
+		level:                C.int32_t(c.Level),
+		max_dict_bytes:       C.uint32_t(c.MaxDictBytes),
+		zstd_max_train_bytes: C.uint32_t(c.ZstdMaxTrainBytes),
+	}
+}
+
+func (e *rocksEngine) CompressionStats(col Column) (raw uint64, stored uint64) {
+	var craw, cstored C.uint64_t
+	C.db_compression_stats(C.int(col), &craw, &cstored)
+	return uint64(craw), uint64(cstored)
+}
+
+func (e *rocksEngine) Close() {
+	if e.async != nil {
+		e.async.stop()
+	}
 	C.close_db()
 }
 
+func (e *rocksEngine) Get(col Column, key []byte) ([]byte, error) {
+	if e.async != nil {
+		return e.async.do(C.DB_OP_GET, col, key, nil)
+	}
+	return db_get(col, key)
+}
+
+func (e *rocksEngine) Set(col Column, key, value []byte) error {
+	if e.async != nil {
+		_, err := e.async.do(C.DB_OP_SET, col, key, value)
+		return err
+	}
+	return db_set(col, key, value)
+}
+
+func (e *rocksEngine) Delete(col Column, key []byte) error {
+	if e.async != nil {
+		_, err := e.async.do(C.DB_OP_DELETE, col, key, nil)
+		return err
+	}
+	return db_delete(col, key)
+}
+
+func (e *rocksEngine) DeletePrefix(col Column, pfx []byte) int {
+	return db_delete_prefix(col, pfx)
+}
+
 func db_get(col Column, key []byte) ([]byte, error) {
 	var ln C.size_t
 	val := C.db_get(C.int(col), (*C.char)(unsafe.Pointer(&key[0])),
@@ -98,39 +162,15 @@ func db_delete_prefix(col Column, pfx []byte) int {
 	return int(val)
 }
 
-func QueueGet(key []byte) ([]byte, error) {
-	return db_get(QUEUE, key)
-}
-
-func PersistGet(key []byte) ([]byte, error) {
-	return db_get(PERSIST, key)
-}
-
-func QueueSet(key, value []byte) error {
-	return db_set(QUEUE, key, value)
-}
-
-func PersistSet(key, value []byte) error {
-	return db_set(PERSIST, key, value)
-}
-
-func QueueDelete(key []byte) error {
-	return db_delete(QUEUE, key)
-}
-
-func PersistDelete(key []byte) error {
-	return db_delete(PERSIST, key)
-}
-
-func QueueDeletePrefix(key []byte) int {
-	return db_delete_prefix(QUEUE, key)
-}
-
-func PersistDeletePrefix(key []byte) int {
-	return db_delete_prefix(QUEUE, key)
+//Return a pointer to the bytes for C, which may be empty
+func cbytes(b []byte) *C.char {
+	if len(b) == 0 {
+		return nil
+	}
+	return (*C.char)(unsafe.Pointer(&b[0]))
 }
 
-type Iterator struct {
+type rocksIterator struct {
 	state         unsafe.Pointer
 	prefix        []byte
 	current_value []byte
@@ -138,16 +178,16 @@ type Iterator struct {
 	valid         bool
 }
 
-func NewIterator(col Column, prefix []byte) *Iterator {
+func (e *rocksEngine) NewIterator(col Column, prefix []byte) Iterator {
 	var (
 		key      *C.char
 		keylen   C.size_t
 		value    *C.char
 		valuelen C.size_t
 	)
-	it := Iterator{prefix: prefix}
-	C.db_it_start(C.int(col), &it.state, (*C.char)(unsafe.Pointer(&prefix[0])), (C.size_t)(len(prefix)), &key, &keylen, &value, &valuelen)
-	runtime.SetFinalizer(&it, func(it *Iterator) {
+	it := rocksIterator{prefix: prefix}
+	C.db_it_start(C.int(col), &it.state, cbytes(prefix), (C.size_t)(len(prefix)), &key, &keylen, &value, &valuelen)
+	runtime.SetFinalizer(&it, func(it *rocksIterator) {
 		// from bw2 rocks
 		//I have no idea how long rocks will take to do this. I suspect
 		//it involves deleting a snapshot. Lets not block the finalizer
@@ -169,14 +209,14 @@ func NewIterator(col Column, prefix []byte) *Iterator {
 	return &it
 }
 
-func (it *Iterator) Next() {
+func (it *rocksIterator) Next() {
 	var (
 		key      *C.char
 		keylen   C.size_t
 		value    *C.char
 		valuelen C.size_t
 	)
-	C.db_it_next(it.state, (*C.char)(unsafe.Pointer(&it.prefix[0])), (C.size_t)(len(it.prefix)), &key, &keylen, &value, &valuelen)
+	C.db_it_next(it.state, cbytes(it.prefix), (C.size_t)(len(it.prefix)), &key, &keylen, &value, &valuelen)
 	if keylen == 0 && valuelen == 0 {
 		it.valid = false
 		return
@@ -189,42 +229,51 @@ func (it *Iterator) Next() {
 	it.valid = true
 }
 
-func (it *Iterator) HasNext() bool {
+func (it *rocksIterator) HasNext() bool {
 	return it.valid
 }
 
-func (it *Iterator) Key() []byte {
+func (it *rocksIterator) Key() []byte {
 	return it.current_key
 }
-func (it *Iterator) Value() []byte {
+func (it *rocksIterator) Value() []byte {
 	return it.current_value
 }
-
-type StorageConfig struct {
-	// if true, optimize rocksdb for spinning metal
-	OptimizeForSpinningMetal bool
-	// file path of rocksdb for queue and persist
-	DataStore string
+func (it *rocksIterator) Err() error {
+	return nil
 }
 
-type WriteBatch struct {
+type rocksWriteBatch struct {
 	state unsafe.Pointer
 	col   Column
+	//Approximate number of bytes of keys and values in the batch
+	size int
 }
 
-func NewWriteBatch(col Column) *WriteBatch {
-	wb := &WriteBatch{
+func (e *rocksEngine) NewWriteBatch(col Column) WriteBatch {
+	wb := &rocksWriteBatch{
 		col: col,
 	}
 	C.db_wb(&wb.state)
 	return wb
 }
 
-func (wb *WriteBatch) Set(key, value []byte) {
+func (wb *rocksWriteBatch) Set(key, value []byte) {
 	C.db_wb_set(C.int(wb.col), wb.state, (*C.char)(unsafe.Pointer(&key[0])), (C.size_t)(len(key)), (*C.char)(unsafe.Pointer(&value[0])), (C.size_t)(len(value)))
+	wb.size += len(key) + len(value)
+}
+
+func (wb *rocksWriteBatch) Delete(key []byte) {
+	C.db_wb_delete(C.int(wb.col), wb.state, (*C.char)(unsafe.Pointer(&key[0])), (C.size_t)(len(key)))
+	wb.size += len(key)
+}
+
+//Size returns the approximate number of bytes in the batch
+func (wb *rocksWriteBatch) Size() int {
+	return wb.size
 }
 
-func (wb *WriteBatch) Commit() error {
+func (wb *rocksWriteBatch) Commit() error {
 	var errstr *C.char
 	var errlen C.size_t
 	C.db_wb_commit(C.int(wb.col), wb.state, &errstr, &errlen)
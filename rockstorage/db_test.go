@@ -1,9 +1,16 @@
+// +build !norocksdb
+
 package rocksdb
 
 import (
 	"encoding/binary"
+	"fmt"
 	"github.com/stretchr/testify/require"
+	"sort"
+	"strings"
+	"sync"
 	"testing"
+	"time"
 )
 
 var cfg = StorageConfig{
@@ -100,3 +107,162 @@ func BenchmarkSet(b *testing.B) {
 		QueueSet(key, []byte("random bytes"))
 	}
 }
+
+func TestAsyncWorkers(t *testing.T) {
+	require := require.New(t)
+	Initialize(cfg)
+	//There is only one database, so the queue is started on it directly
+	//rather than with StorageConfig.AsyncWorkers
+	e := &rocksEngine{async: startAsync(4)}
+	errs := make(chan error, 64)
+	wg := sync.WaitGroup{}
+	for i := 0; i < 64; i++ {
+		wg.Add(1)
+		go func(i int) {
+			defer wg.Done()
+			k := []byte(fmt.Sprintf("async/%d", i))
+			if err := e.Set(QUEUE, k, k); err != nil {
+				errs <- err
+				return
+			}
+			if v, err := e.Get(QUEUE, k); err != nil || string(v) != string(k) {
+				errs <- fmt.Errorf("get %s: %q %v", k, v, err)
+				return
+			}
+			if err := e.Delete(QUEUE, k); err != nil {
+				errs <- err
+				return
+			}
+			if _, err := e.Get(QUEUE, k); err != ErrObjNotFound {
+				errs <- fmt.Errorf("get deleted %s: %v", k, err)
+			}
+		}(i)
+	}
+	wg.Wait()
+	close(errs)
+	for err := range errs {
+		require.NoError(err)
+	}
+
+	//Operations racing with stop either complete or fail, none is lost
+	results := make(chan error, 1000)
+	for i := 0; i < 1000; i++ {
+		go func(i int) {
+			results <- e.Set(QUEUE, []byte(fmt.Sprintf("async/%d", i)), []byte("v"))
+		}(i)
+	}
+	e.async.stop()
+	timeout := time.After(10 * time.Second)
+	for i := 0; i < 1000; i++ {
+		select {
+		case err := <-results:
+			if err != nil {
+				require.Equal(ErrAsyncStopped, err)
+			}
+		case <-timeout:
+			t.Fatal("an operation did not finish when the queue stopped")
+		}
+	}
+	_, err := e.Get(QUEUE, []byte("async/0"))
+	require.Equal(ErrAsyncStopped, err)
+	QueueDeletePrefix([]byte("async/"))
+}
+
+func TestQueryPages(t *testing.T) {
+	require := require.New(t)
+	Initialize(cfg)
+	//The normal tree of the persisted messages, see core/persistdb.go
+	PersistSet([]byte("\x02\x01p"), []byte{0})
+	for _, c := range []string{"a", "b", "c", "d", "e"} {
+		PersistSet([]byte("\x02\x02p/"+c), []byte(c))
+	}
+	var cursor []byte
+	pages := [][]string{}
+	for {
+		page := []string{}
+		next, err := PersistQuery("p/+", 2, cursor, func(uri string, value []byte) bool {
+			page = append(page, uri+"="+string(value))
+			return true
+		})
+		require.NoError(err)
+		pages = append(pages, page)
+		if next == nil {
+			break
+		}
+		cursor = next
+	}
+	require.Equal([][]string{{"p/a=a", "p/b=b"}, {"p/c=c", "p/d=d"}, {"p/e=e"}}, pages)
+	//A page that ends with the last match has no cursor
+	count := 0
+	next, err := PersistQuery("p/+", 5, nil, func(uri string, value []byte) bool {
+		count++
+		return true
+	})
+	require.NoError(err)
+	require.Equal(5, count)
+	require.Nil(next)
+	_, err = PersistQuery("p/+", 2, []byte{0xff}, func(uri string, value []byte) bool {
+		return true
+	})
+	require.Equal(ErrBadCursor, err)
+}
+
+//Store a persisted message the way core/persistdb.go does. The message is
+//in the normal tree, the interlaced tree holds a reference to it, and the
+//missing parents in both trees are dummies
+func persistMessage(uri string, value []byte) {
+	parts := strings.Split(uri, "/")
+	interlaced := make([]string, len(parts))
+	for i := 0; i < len(parts); i += 2 {
+		interlaced[i] = parts[i/2]
+		if i+1 < len(parts) {
+			interlaced[i+1] = parts[(len(parts)-1)-i/2]
+		}
+	}
+	key := func(tree byte, parts []string) []byte {
+		return append([]byte{tree, byte(len(parts))}, strings.Join(parts, "/")...)
+	}
+	PersistSet(key(2, parts), value)
+	PersistSet(key(1, interlaced), []byte{0, 1})
+	for _, tree := range []struct {
+		b     byte
+		parts []string
+	}{{2, parts}, {1, interlaced}} {
+		for i := 1; i < len(tree.parts); i++ {
+			k := key(tree.b, tree.parts[:i])
+			if _, err := PersistGet(k); err == ErrObjNotFound {
+				PersistSet(k, []byte{0})
+			}
+		}
+	}
+}
+
+func TestQueryWildcards(t *testing.T) {
+	require := require.New(t)
+	Initialize(cfg)
+	for _, uri := range []string{"q/a/b", "q/a/bc/d", "q/a/b/d", "q/x/y/z/d", "q/x"} {
+		persistMessage(uri, []byte(uri[2:]))
+	}
+	matching := func(pattern string) []string {
+		rv := []string{}
+		_, err := PersistQuery(pattern, 0, nil, func(uri string, value []byte) bool {
+			rv = append(rv, uri+"="+string(value))
+			return true
+		})
+		require.NoError(err)
+		sort.Strings(rv)
+		return rv
+	}
+	//The same results as TestPersistWildcardQuery in core
+	require.Equal([]string{"q/a/b=a/b"}, matching("q/a/b"))
+	require.Equal([]string{"q/a/b/d=a/b/d", "q/a/bc/d=a/bc/d"}, matching("q/a/+/d"))
+	require.Equal([]string{"q/a/b/d=a/b/d"}, matching("q/a/b/+"))
+	require.Equal([]string{"q/a/b/d=a/b/d", "q/a/b=a/b", "q/a/bc/d=a/bc/d", "q/x/y/z/d=x/y/z/d", "q/x=x"}, matching("q/*"))
+	require.Equal([]string{"q/a/b/d=a/b/d", "q/a/bc/d=a/bc/d", "q/x/y/z/d=x/y/z/d"}, matching("q/*/d"))
+	require.Equal([]string{"q/a/b/d=a/b/d", "q/a/b=a/b"}, matching("q/a/b/*"))
+	require.Equal([]string{"q/a/b/d=a/b/d", "q/a/bc/d=a/bc/d", "q/x/y/z/d=x/y/z/d"}, matching("+/+/*/d"))
+	require.Equal([]string{"q/x/y/z/d=x/y/z/d"}, matching("q/+/y/*"))
+	all := matching("*")
+	require.Contains(all, "q/a/b=a/b")
+	require.Contains(all, "q/x/y/z/d=x/y/z/d")
+}
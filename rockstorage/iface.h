@@ -2,8 +2,52 @@
 #include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 
-void c_init(const char* name, size_t namelen, size_t spinning_metal);
+#define DB_OP_GET 1
+#define DB_OP_SET 2
+#define DB_OP_DELETE 3
+
+//An operation for the asynchronous API. The key and value are at the given
+//offsets in the data buffer passed alongside
+typedef struct {
+    uint64_t id;
+    int32_t op;
+    int32_t col;
+    size_t keyoff;
+    size_t keylen;
+    size_t valueoff;
+    size_t valuelen;
+} db_op;
+
+//The result of an asynchronous operation. value and err are malloced and
+//must be freed by the caller
+typedef struct {
+    uint64_t id;
+    char* value;
+    size_t valuelen;
+    int32_t notfound;
+    char* err;
+    size_t errlen;
+} db_completion;
+
+#define DB_COMPRESSION_NONE 0
+#define DB_COMPRESSION_SNAPPY 1
+#define DB_COMPRESSION_LZ4 2
+#define DB_COMPRESSION_ZSTD 3
+
+//The compression settings of a column family. The dictionary settings only
+//apply to the bottommost level
+typedef struct {
+    int32_t type;
+    int32_t bottommost_type;
+    int32_t level;
+    uint32_t max_dict_bytes;
+    uint32_t zstd_max_train_bytes;
+} db_compression;
+
+//compression has an entry for each column family, indexed by column
+void c_init(const char* name, size_t namelen, size_t spinning_metal, const db_compression* compression);
 void close_db();
 char* db_get(int col, const char *key, size_t keylen, size_t *valuelen);
 void db_delete(int col, const char *key, size_t keylen, char** err, size_t* errlen);
@@ -15,8 +59,21 @@ size_t db_delete_prefix(int col, const char *pfx, size_t pfxlen);
 
 void db_wb(void** state);
 void db_wb_set(int col, void* state, const char *key, size_t keylen, const char *value, size_t valuelen);
+void db_wb_delete(int col, void* state, const char *key, size_t keylen);
 void db_wb_commit(int col, void* state, char** error, size_t* errorlen);
 
+void db_async_start(size_t threads);
+void db_async_submit(const db_op* ops, size_t n, const char* data);
+size_t db_async_reap(db_completion* out, size_t max);
+void db_async_stop();
+
+void* db_query_start(const char* uri, size_t urilen, size_t limit, const char* cursor, size_t cursorlen);
+size_t db_query_next(void* state, char* buf, size_t bufcap, size_t* need, int* done, char** error, size_t* errorlen);
+size_t db_query_cursor(void* state, char* buf, size_t bufcap);
+void db_query_end(void* state);
+
+void db_compression_stats(int col, uint64_t* raw, uint64_t* stored);
+
 //void queue_wb_start(void** state);
 //void queue_wb_set(void* state, char* key, size_t keylen, char* value, size_t valuelen);
 //void queue_wb_done(void* state);
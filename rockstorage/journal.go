@@ -0,0 +1,341 @@
+package rocksdb
+
+import (
+	"bufio"
+	"encoding/binary"
+	"fmt"
+	"hash/crc32"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+	"syscall"
+	"time"
+)
+
+//A Journal is an append-only log of records, shared by all the queues. It
+//is written to a sequence of segment files. Appends are buffered and a
+//background goroutine writes and fsyncs them every JournalSyncInterval, so
+//many appends share one fsync. Each record can be live, in which case the
+//caller must Release it once it no longer needs it. A segment file is
+//deleted once it and every older segment hold no live records, so
+//records written after a live record (for example a record cancelling it)
+//are never lost before it
+
+//A new segment is started once the current one reaches this size
+const JournalSegmentSize = 64 * 1024 * 1024
+
+//The longest time an appended record waits before it is fsynced
+const JournalSyncInterval = 2 * time.Millisecond
+
+//The buffer in front of the current segment file
+const journalBufferSize = 1024 * 1024
+
+//Each record is preceded by its length and its CRC
+const journalRecordHeader = 8
+
+var journalCRCTable = crc32.MakeTable(crc32.Castagnoli)
+
+//A reference to a live record, the zero value refers to nothing
+type JournalRef struct {
+	seg uint64
+}
+
+type journalSegment struct {
+	id   uint64
+	path string
+	//Only set while the segment is being written
+	f *os.File
+	w *bufio.Writer
+	//The number of bytes appended, including buffered ones
+	size int64
+	//The number of records not yet released
+	live int64
+	//True once every record in the segment is on disk
+	durable bool
+}
+
+type Journal struct {
+	dir string
+
+	mu sync.Mutex
+	//Oldest first, the last one is the one being written
+	segs []*journalSegment
+	//Sealed segments that have not been fsynced yet
+	tosync []*journalSegment
+	//Closed once the records appended so far are durable
+	synced chan struct{}
+	//True if there is buffered data in the current segment
+	pending bool
+	err     error
+
+	wake   chan struct{}
+	done   chan struct{}
+	closed bool
+}
+
+func segmentName(id uint64) string {
+	return fmt.Sprintf("%016x.seg", id)
+}
+
+//OpenJournal opens the journal in the given directory, creating it if
+//required. Every record from a previous run is passed to replay in the
+//order it was appended. The slice is only valid for the duration of the
+//call. If replay returns true the record stays live under the given
+//reference, otherwise it is released immediately
+func OpenJournal(dir string, replay func(ref JournalRef, rec []byte) bool) (*Journal, error) {
+	if err := os.MkdirAll(dir, 0700); err != nil {
+		return nil, err
+	}
+	files, err := ioutil.ReadDir(dir)
+	if err != nil {
+		return nil, err
+	}
+	j := &Journal{
+		dir:    dir,
+		synced: make(chan struct{}),
+		wake:   make(chan struct{}, 1),
+		done:   make(chan struct{}),
+	}
+	ids := []uint64{}
+	for _, fi := range files {
+		if !strings.HasSuffix(fi.Name(), ".seg") {
+			continue
+		}
+		id, err := strconv.ParseUint(strings.TrimSuffix(fi.Name(), ".seg"), 16, 64)
+		if err != nil {
+			continue
+		}
+		ids = append(ids, id)
+	}
+	sort.Slice(ids, func(a, b int) bool { return ids[a] < ids[b] })
+	var nextID uint64 = 1
+	for _, id := range ids {
+		seg := &journalSegment{
+			id:      id,
+			path:    filepath.Join(dir, segmentName(id)),
+			durable: true,
+		}
+		if err := seg.replay(replay); err != nil {
+			return nil, err
+		}
+		j.segs = append(j.segs, seg)
+		nextID = id + 1
+	}
+	if err := j.startSegment(nextID); err != nil {
+		return nil, err
+	}
+	j.collect()
+	go j.syncLoop()
+	return j, nil
+}
+
+//Read the records of a segment file. A torn or corrupt record ends the
+//segment, it can only be the tail of a write that was never acknowledged
+func (seg *journalSegment) replay(replay func(ref JournalRef, rec []byte) bool) error {
+	f, err := os.Open(seg.path)
+	if err != nil {
+		return err
+	}
+	defer f.Close()
+	fi, err := f.Stat()
+	if err != nil {
+		return err
+	}
+	if fi.Size() == 0 {
+		return nil
+	}
+	data, err := syscall.Mmap(int(f.Fd()), 0, int(fi.Size()), syscall.PROT_READ, syscall.MAP_SHARED)
+	if err != nil {
+		return err
+	}
+	defer syscall.Munmap(data)
+	ref := JournalRef{seg: seg.id}
+	for len(data) >= journalRecordHeader {
+		ln := binary.BigEndian.Uint32(data[0:4])
+		crc := binary.BigEndian.Uint32(data[4:8])
+		if ln == 0 || uint64(ln) > uint64(len(data)-journalRecordHeader) {
+			break
+		}
+		rec := data[journalRecordHeader : journalRecordHeader+int(ln)]
+		if crc32.Checksum(rec, journalCRCTable) != crc {
+			break
+		}
+		if replay(ref, rec) {
+			seg.live++
+		}
+		data = data[journalRecordHeader+int(ln):]
+	}
+	return nil
+}
+
+//Start a new segment file, the mutex must be held
+func (j *Journal) startSegment(id uint64) error {
+	path := filepath.Join(j.dir, segmentName(id))
+	f, err := os.OpenFile(path, os.O_CREATE|os.O_EXCL|os.O_WRONLY, 0600)
+	if err != nil {
+		return err
+	}
+	j.segs = append(j.segs, &journalSegment{
+		id:   id,
+		path: path,
+		f:    f,
+		w:    bufio.NewWriterSize(f, journalBufferSize),
+	})
+	return nil
+}
+
+//Append adds a record to the journal. If live is true, the returned
+//reference must be released when the record is no longer needed. The
+//returned channel is closed once the record is durable
+func (j *Journal) Append(rec []byte, live bool) (JournalRef, <-chan struct{}) {
+	var hdr [journalRecordHeader]byte
+	binary.BigEndian.PutUint32(hdr[0:4], uint32(len(rec)))
+	binary.BigEndian.PutUint32(hdr[4:8], crc32.Checksum(rec, journalCRCTable))
+
+	j.mu.Lock()
+	defer j.mu.Unlock()
+	if j.err != nil {
+		panic(j.err)
+	}
+	cur := j.segs[len(j.segs)-1]
+	if cur.size > 0 && cur.size+int64(len(rec)+journalRecordHeader) > JournalSegmentSize {
+		if err := cur.w.Flush(); err != nil {
+			panic(err)
+		}
+		cur.w = nil
+		j.tosync = append(j.tosync, cur)
+		if err := j.startSegment(cur.id + 1); err != nil {
+			panic(err)
+		}
+		cur = j.segs[len(j.segs)-1]
+	}
+	cur.w.Write(hdr[:])
+	cur.w.Write(rec)
+	cur.size += int64(len(rec) + journalRecordHeader)
+	ref := JournalRef{}
+	if live {
+		cur.live++
+		ref.seg = cur.id
+	}
+	if !j.pending {
+		j.pending = true
+		select {
+		case j.wake <- struct{}{}:
+		default:
+		}
+	}
+	return ref, j.synced
+}
+
+//Release marks a live record as no longer needed
+func (j *Journal) Release(ref JournalRef) {
+	if ref.seg == 0 {
+		return
+	}
+	j.mu.Lock()
+	defer j.mu.Unlock()
+	for _, seg := range j.segs {
+		if seg.id == ref.seg {
+			seg.live--
+			break
+		}
+	}
+	j.collect()
+}
+
+//Delete the oldest segments while they have no live records, the mutex
+//must be held
+func (j *Journal) collect() {
+	for len(j.segs) > 1 && j.segs[0].live == 0 && j.segs[0].durable {
+		if err := os.Remove(j.segs[0].path); err != nil {
+			fmt.Printf("could not remove journal segment: %v\n", err)
+		}
+		j.segs = j.segs[1:]
+	}
+}
+
+//Segments returns the number of segment files in the journal
+func (j *Journal) Segments() int {
+	j.mu.Lock()
+	defer j.mu.Unlock()
+	return len(j.segs)
+}
+
+func (j *Journal) syncLoop() {
+	defer close(j.done)
+	for {
+		select {
+		case <-j.wake:
+		case <-time.After(time.Second):
+		}
+		//Wait a little so that appends made at the same time share the
+		//fsync
+		time.Sleep(JournalSyncInterval)
+		if !j.sync() {
+			return
+		}
+	}
+}
+
+//Write out and fsync everything appended so far. Returns false once the
+//journal is closed
+func (j *Journal) sync() bool {
+	j.mu.Lock()
+	closed := j.closed
+	if !j.pending && len(j.tosync) == 0 {
+		j.mu.Unlock()
+		return !closed
+	}
+	cur := j.segs[len(j.segs)-1]
+	if err := cur.w.Flush(); err != nil {
+		j.err = err
+	}
+	tosync := append(j.tosync, cur)
+	j.tosync = nil
+	synced := j.synced
+	j.synced = make(chan struct{})
+	j.pending = false
+	j.mu.Unlock()
+
+	for _, seg := range tosync {
+		if err := seg.f.Sync(); err != nil {
+			j.mu.Lock()
+			j.err = err
+			j.mu.Unlock()
+		}
+	}
+
+	j.mu.Lock()
+	for _, seg := range tosync[:len(tosync)-1] {
+		seg.f.Close()
+		seg.f = nil
+		seg.durable = true
+	}
+	j.collect()
+	j.mu.Unlock()
+	close(synced)
+	return !closed
+}
+
+//Close makes everything appended durable and closes the journal
+func (j *Journal) Close() error {
+	j.mu.Lock()
+	j.closed = true
+	j.mu.Unlock()
+	select {
+	case j.wake <- struct{}{}:
+	default:
+	}
+	<-j.done
+	j.mu.Lock()
+	defer j.mu.Unlock()
+	cur := j.segs[len(j.segs)-1]
+	if err := cur.f.Close(); err != nil && j.err == nil {
+		j.err = err
+	}
+	return j.err
+}
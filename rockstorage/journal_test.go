@@ -0,0 +1,53 @@
+package rocksdb
+
+import (
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"testing"
+
+	"github.com/stretchr/testify/require"
+)
+
+func TestJournalReplay(t *testing.T) {
+	require := require.New(t)
+	dir, err := ioutil.TempDir("", "journal")
+	require.NoError(err)
+	defer os.RemoveAll(dir)
+
+	j, err := OpenJournal(dir, func(ref JournalRef, rec []byte) bool {
+		t.Fatal("new journal has records")
+		return false
+	})
+	require.NoError(err)
+	ref1, _ := j.Append([]byte("one"), true)
+	j.Append([]byte("two"), false)
+	_, synced := j.Append([]byte("three"), true)
+	<-synced
+	j.Release(ref1)
+	require.NoError(j.Close())
+
+	//A torn write at the end of the segment is ignored
+	segs, err := filepath.Glob(filepath.Join(dir, "*.seg"))
+	require.NoError(err)
+	require.Len(segs, 1)
+	f, err := os.OpenFile(segs[0], os.O_APPEND|os.O_WRONLY, 0600)
+	require.NoError(err)
+	f.Write([]byte{0, 0, 0, 9, 1, 2})
+	f.Close()
+
+	recs := []string{}
+	var keep JournalRef
+	j, err = OpenJournal(dir, func(ref JournalRef, rec []byte) bool {
+		recs = append(recs, string(rec))
+		keep = ref
+		return string(rec) == "three"
+	})
+	require.NoError(err)
+	require.Equal([]string{"one", "two", "three"}, recs)
+	//The old segment is kept for the live record
+	require.Equal(2, j.Segments())
+	j.Release(keep)
+	require.Equal(1, j.Segments())
+	require.NoError(j.Close())
+}
@@ -0,0 +1,200 @@
+package rocksdb
+
+import (
+	"sort"
+	"strings"
+	"sync"
+)
+
+//An Engine that keeps everything in memory. Each column is a map with a
+//sorted key index that is rebuilt lazily when an iterator needs it, so
+//point operations stay O(1) and a run of inserts costs one sort
+type memEngine struct {
+	cols map[Column]*memColumn
+}
+
+type memColumn struct {
+	mu   sync.RWMutex
+	data map[string][]byte
+	//Sorted keys, only valid if sorted is true
+	keys   []string
+	sorted bool
+}
+
+func NewMemoryEngine() Engine {
+	return &memEngine{
+		cols: map[Column]*memColumn{
+			QUEUE:   newMemColumn(),
+			PERSIST: newMemColumn(),
+			PROOF:   newMemColumn(),
+		},
+	}
+}
+
+func newMemColumn() *memColumn {
+	return &memColumn{
+		data:   make(map[string][]byte),
+		sorted: true,
+	}
+}
+
+func (e *memEngine) Close() {}
+
+func (e *memEngine) Get(col Column, key []byte) ([]byte, error) {
+	c := e.cols[col]
+	c.mu.RLock()
+	defer c.mu.RUnlock()
+	v, ok := c.data[string(key)]
+	if !ok {
+		return nil, ErrObjNotFound
+	}
+	return append([]byte{}, v...), nil
+}
+
+func (e *memEngine) Set(col Column, key, value []byte) error {
+	c := e.cols[col]
+	c.mu.Lock()
+	c.set(string(key), value)
+	c.mu.Unlock()
+	return nil
+}
+
+func (e *memEngine) Delete(col Column, key []byte) error {
+	c := e.cols[col]
+	c.mu.Lock()
+	c.delete(string(key))
+	c.mu.Unlock()
+	return nil
+}
+
+func (e *memEngine) DeletePrefix(col Column, pfx []byte) int {
+	c := e.cols[col]
+	c.mu.Lock()
+	defer c.mu.Unlock()
+	keys := c.prefixKeys(string(pfx))
+	for _, k := range keys {
+		c.delete(k)
+	}
+	return len(keys)
+}
+
+//The mutex must be held for writing
+func (c *memColumn) set(key string, value []byte) {
+	if _, ok := c.data[key]; !ok {
+		c.sorted = false
+	}
+	c.data[key] = append([]byte{}, value...)
+}
+
+//The mutex must be held for writing. Deleted keys stay in the key index
+//until it is next rebuilt
+func (c *memColumn) delete(key string) {
+	delete(c.data, key)
+}
+
+//Return the keys with the prefix in order, the mutex must be held for
+//writing
+func (c *memColumn) prefixKeys(pfx string) []string {
+	if !c.sorted {
+		c.keys = c.keys[:0]
+		for k := range c.data {
+			c.keys = append(c.keys, k)
+		}
+		sort.Strings(c.keys)
+		c.sorted = true
+	}
+	i := sort.SearchStrings(c.keys, pfx)
+	rv := []string{}
+	for ; i < len(c.keys) && strings.HasPrefix(c.keys[i], pfx); i++ {
+		if _, ok := c.data[c.keys[i]]; ok {
+			rv = append(rv, c.keys[i])
+		}
+	}
+	return rv
+}
+
+type memIterator struct {
+	keys   []string
+	values [][]byte
+	pos    int
+}
+
+func (e *memEngine) NewIterator(col Column, prefix []byte) Iterator {
+	c := e.cols[col]
+	c.mu.Lock()
+	defer c.mu.Unlock()
+	it := &memIterator{
+		keys: c.prefixKeys(string(prefix)),
+	}
+	//Values are never modified in place, so sharing them gives the
+	//iterator a snapshot
+	it.values = make([][]byte, len(it.keys))
+	for i, k := range it.keys {
+		it.values[i] = c.data[k]
+	}
+	return it
+}
+
+func (it *memIterator) HasNext() bool {
+	return it.pos < len(it.keys)
+}
+
+func (it *memIterator) Next() {
+	it.pos++
+}
+
+func (it *memIterator) Key() []byte {
+	return []byte(it.keys[it.pos])
+}
+
+func (it *memIterator) Value() []byte {
+	return append([]byte{}, it.values[it.pos]...)
+}
+
+func (it *memIterator) Err() error {
+	return nil
+}
+
+type memWriteBatch struct {
+	c    *memColumn
+	ops  []memOp
+	size int
+}
+
+type memOp struct {
+	key   string
+	value []byte
+	del   bool
+}
+
+func (e *memEngine) NewWriteBatch(col Column) WriteBatch {
+	return &memWriteBatch{c: e.cols[col]}
+}
+
+func (wb *memWriteBatch) Set(key, value []byte) {
+	wb.ops = append(wb.ops, memOp{key: string(key), value: append([]byte{}, value...)})
+	wb.size += len(key) + len(value)
+}
+
+func (wb *memWriteBatch) Delete(key []byte) {
+	wb.ops = append(wb.ops, memOp{key: string(key), del: true})
+	wb.size += len(key)
+}
+
+func (wb *memWriteBatch) Size() int {
+	return wb.size
+}
+
+func (wb *memWriteBatch) Commit() error {
+	wb.c.mu.Lock()
+	defer wb.c.mu.Unlock()
+	for _, op := range wb.ops {
+		if op.del {
+			wb.c.delete(op.key)
+		} else {
+			wb.c.set(op.key, op.value)
+		}
+	}
+	wb.ops = nil
+	return nil
+}
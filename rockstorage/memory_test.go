@@ -0,0 +1,49 @@
+package rocksdb
+
+import (
+	"testing"
+
+	"github.com/stretchr/testify/require"
+)
+
+func TestMemoryEngine(t *testing.T) {
+	require := require.New(t)
+	e := NewMemoryEngine()
+	e.Set(QUEUE, []byte("a/2"), []byte("v2"))
+	e.Set(QUEUE, []byte("a/1"), []byte("v1"))
+	e.Set(QUEUE, []byte("b/1"), []byte("v3"))
+	e.Set(PERSIST, []byte("a/3"), []byte("other column"))
+	v, err := e.Get(QUEUE, []byte("a/1"))
+	require.NoError(err)
+	require.Equal([]byte("v1"), v)
+	_, err = e.Get(QUEUE, []byte("a/3"))
+	require.Equal(ErrObjNotFound, err)
+
+	it := e.NewIterator(QUEUE, []byte("a/"))
+	//Changes after the iterator is created are not seen by it
+	e.Delete(QUEUE, []byte("a/2"))
+	e.Set(QUEUE, []byte("a/0"), []byte("v0"))
+	keys := []string{}
+	for ; it.HasNext(); it.Next() {
+		keys = append(keys, string(it.Key()))
+	}
+	require.Equal([]string{"a/1", "a/2"}, keys)
+
+	wb := e.NewWriteBatch(QUEUE)
+	wb.Set([]byte("a/5"), []byte("v5"))
+	wb.Delete([]byte("a/1"))
+	_, err = e.Get(QUEUE, []byte("a/5"))
+	require.Equal(ErrObjNotFound, err)
+	require.NoError(wb.Commit())
+	keys = []string{}
+	for it := e.NewIterator(QUEUE, []byte("a/")); it.HasNext(); it.Next() {
+		keys = append(keys, string(it.Key()))
+	}
+	require.Equal([]string{"a/0", "a/5"}, keys)
+
+	require.Equal(2, e.DeletePrefix(QUEUE, []byte("a/")))
+	require.False(e.NewIterator(QUEUE, []byte("a/")).HasNext())
+	v, err = e.Get(QUEUE, []byte("b/1"))
+	require.NoError(err)
+	require.Equal([]byte("v3"), v)
+}
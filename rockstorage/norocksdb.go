@@ -0,0 +1,7 @@
+// +build norocksdb
+
+package rocksdb
+
+func newRocksEngine(conf StorageConfig) Engine {
+	panic("built without rocksdb, use the memory storage engine")
+}
@@ -0,0 +1,65 @@
+// +build !norocksdb
+
+package rocksdb
+
+// #include "iface.h"
+import "C"
+import (
+	"encoding/binary"
+	"unsafe"
+)
+
+//The buffer results are copied into from C. A result larger than this
+//gets a buffer of its own
+const queryBufferSize = 64 * 1024
+
+//Run a wildcard query over the persisted messages in C++, on a snapshot
+//of the database. handle is called for each match in turn and can return
+//false to stop early. If limit is nonzero, at most that many matches are
+//returned, and if there are more the cursor of the next page is
+//returned. A read error ends the query and is returned
+func (e *rocksEngine) Query(uri string, limit int, cursor []byte, handle func(uri string, value []byte) bool) ([]byte, error) {
+	curi := C.CString(uri)
+	state := C.db_query_start(curi, C.size_t(len(uri)), C.size_t(limit), cbytes(cursor), C.size_t(len(cursor)))
+	C.free(unsafe.Pointer(curi))
+	if state == nil {
+		return nil, ErrBadCursor
+	}
+	defer C.db_query_end(state)
+	buf := make([]byte, queryBufferSize)
+	for {
+		var need C.size_t
+		var done C.int
+		var errstr *C.char
+		var errlen C.size_t
+		n := int(C.db_query_next(state, (*C.char)(unsafe.Pointer(&buf[0])), C.size_t(len(buf)), &need, &done, &errstr, &errlen))
+		if err := getError(errstr, errlen); err != nil {
+			return nil, err
+		}
+		if need > 0 {
+			buf = make([]byte, int(need))
+			continue
+		}
+		for rec := buf[:n]; len(rec) > 0; {
+			ln := binary.BigEndian.Uint32(rec)
+			ruri := string(rec[4 : 4+ln])
+			rec = rec[4+ln:]
+			ln = binary.BigEndian.Uint32(rec)
+			value := append([]byte{}, rec[4:4+ln]...)
+			rec = rec[4+ln:]
+			if !handle(ruri, value) {
+				return nil, nil
+			}
+		}
+		if done != 0 {
+			break
+		}
+	}
+	n := C.db_query_cursor(state, nil, 0)
+	if n == 0 {
+		return nil, nil
+	}
+	next := make([]byte, int(n))
+	C.db_query_cursor(state, (*C.char)(unsafe.Pointer(&next[0])), n)
+	return next, nil
+}
@@ -0,0 +1,248 @@
+package rocksdb
+
+import (
+	"errors"
+	"fmt"
+	"sync"
+)
+
+//The storage used by the queues, persisted messages and proofs is an
+//Engine. The RocksDB shim is the normal one, the in-memory engine lets
+//tests and benchmarks run without I/O or the native library (build with
+//the norocksdb tag to leave it out entirely)
+
+type Column int
+
+const (
+	QUEUE   Column = 1
+	PERSIST Column = 2
+	PROOF   Column = 3
+)
+
+var ErrObjNotFound = errors.New("Object Not Found")
+
+//Returned by PersistQuery if the engine cannot run queries itself
+var ErrQueryUnsupported = errors.New("Query not supported by storage engine")
+
+//Returned by PersistQuery if the cursor was not returned by the engine
+var ErrBadCursor = errors.New("Malformed query cursor")
+
+//A storage engine. Get returns ErrObjNotFound for keys that do not exist
+type Engine interface {
+	Get(col Column, key []byte) ([]byte, error)
+	Set(col Column, key, value []byte) error
+	Delete(col Column, key []byte) error
+	//Delete every key with the prefix, returning how many there were
+	DeletePrefix(col Column, pfx []byte) int
+	//Iterate over the keys with the prefix in order, as of when the
+	//iterator was created. An empty prefix iterates over the whole column
+	NewIterator(col Column, prefix []byte) Iterator
+	//A set of changes applied atomically on Commit
+	NewWriteBatch(col Column) WriteBatch
+	Close()
+}
+
+//An engine that can evaluate wildcard queries over the persisted messages
+//itself, see PersistQuery
+type Querier interface {
+	Query(uri string, limit int, cursor []byte, handle func(uri string, value []byte) bool) (next []byte, err error)
+}
+
+type Iterator interface {
+	HasNext() bool
+	Next()
+	Key() []byte
+	Value() []byte
+	//The error of the last call to Value if the value could not be read,
+	//in which case Value returned nil
+	Err() error
+}
+
+type WriteBatch interface {
+	Set(key, value []byte)
+	Delete(key []byte)
+	//Size returns the approximate number of bytes in the batch
+	Size() int
+	Commit() error
+}
+
+//The engine names accepted in StorageConfig
+const (
+	EngineRocksDB = "rocksdb"
+	EngineMemory  = "memory"
+)
+
+type StorageConfig struct {
+	// if true, optimize rocksdb for spinning metal
+	OptimizeForSpinningMetal bool
+	// file path of rocksdb for queue and persist
+	DataStore string
+	// the storage engine, rocksdb if empty
+	Engine string
+	// if set, rocksdb gets, sets and deletes are executed by this many
+	// threads behind a submission queue instead of blocking cgo calls
+	AsyncWorkers int
+	// the rocksdb compression of each column family, DefaultCompression if
+	// the type is empty
+	QueueCompression   CompressionConfig
+	PersistCompression CompressionConfig
+	ProofCompression   CompressionConfig
+	// if set, large queued and persisted values are stored in blob files
+	// in this directory rather than in the engine, see blob.go
+	BlobDataStore string
+	// the minimum size of a value stored in a blob file, DefaultBlobMinSize
+	// if zero
+	BlobMinSize int
+}
+
+//The compression names accepted in CompressionConfig
+const (
+	CompressionNone   = "none"
+	CompressionSnappy = "snappy"
+	CompressionLZ4    = "lz4"
+	CompressionZSTD   = "zstd"
+)
+
+type CompressionConfig struct {
+	// the compression of all but the bottommost level
+	Type string
+	// the compression of the bottommost level, where most data ends up
+	BottommostType string
+	// the compression level of the bottommost level, 0 for the default
+	Level int
+	// the size of the dictionary built for each bottommost SST file, 0
+	// disables dictionaries
+	MaxDictBytes int
+	// if nonzero, zstd trains the dictionary on up to this many bytes of
+	// samples, otherwise the samples are used as the dictionary
+	ZstdMaxTrainBytes int
+}
+
+//Stored messages are small protobufs with a lot in common (schemas, URIs,
+//namespaces), which compress well against a trained dictionary
+var DefaultCompression = CompressionConfig{
+	Type:              CompressionLZ4,
+	BottommostType:    CompressionZSTD,
+	MaxDictBytes:      16 * 1024,
+	ZstdMaxTrainBytes: 100 * 16 * 1024,
+}
+
+func (c CompressionConfig) orDefault() CompressionConfig {
+	if c.Type == "" {
+		return DefaultCompression
+	}
+	if c.BottommostType == "" {
+		c.BottommostType = c.Type
+	}
+	return c
+}
+
+//An engine that can report how well a column is compressed
+type CompressionReporter interface {
+	//The uncompressed and stored size of the column's data
+	CompressionStats(col Column) (raw uint64, stored uint64)
+}
+
+var initOnce sync.Once
+var engine Engine
+
+//The engine without the blob files, if any
+var baseEngine Engine
+
+func Initialize(conf StorageConfig) {
+	initOnce.Do(func() {
+		switch conf.Engine {
+		case "", EngineRocksDB:
+			engine = newRocksEngine(conf)
+		case EngineMemory:
+			engine = NewMemoryEngine()
+		default:
+			panic(fmt.Sprintf("unknown storage engine %q", conf.Engine))
+		}
+		baseEngine = engine
+		if conf.BlobDataStore != "" {
+			engine = newBlobEngine(engine, conf)
+		}
+	})
+}
+
+func Close() {
+	engine.Close()
+}
+
+func QueueGet(key []byte) ([]byte, error) {
+	return engine.Get(QUEUE, key)
+}
+
+func PersistGet(key []byte) ([]byte, error) {
+	return engine.Get(PERSIST, key)
+}
+
+func QueueSet(key, value []byte) error {
+	return engine.Set(QUEUE, key, value)
+}
+
+func PersistSet(key, value []byte) error {
+	return engine.Set(PERSIST, key, value)
+}
+
+func ProofGet(key []byte) ([]byte, error) {
+	return engine.Get(PROOF, key)
+}
+
+func ProofSet(key, value []byte) error {
+	return engine.Set(PROOF, key, value)
+}
+
+func ProofDelete(key []byte) error {
+	return engine.Delete(PROOF, key)
+}
+
+func QueueDelete(key []byte) error {
+	return engine.Delete(QUEUE, key)
+}
+
+func PersistDelete(key []byte) error {
+	return engine.Delete(PERSIST, key)
+}
+
+func QueueDeletePrefix(key []byte) int {
+	return engine.DeletePrefix(QUEUE, key)
+}
+
+func PersistDeletePrefix(key []byte) int {
+	return engine.DeletePrefix(PERSIST, key)
+}
+
+//Call handle with each persisted message matching the URI pattern, which
+//may contain + and * wildcards. If limit is nonzero, at most that many are
+//returned and next is set if there are more, in which case passing it
+//as the cursor of the same query returns the next page. Returns
+//ErrQueryUnsupported if the engine does not implement Querier, the caller
+//then walks the index itself
+func PersistQuery(uri string, limit int, cursor []byte, handle func(uri string, value []byte) bool) (next []byte, err error) {
+	qr, ok := engine.(Querier)
+	if !ok {
+		return nil, ErrQueryUnsupported
+	}
+	return qr.Query(uri, limit, cursor, handle)
+}
+
+//Return the uncompressed and stored size of a column, ok is false if the
+//engine does not compress
+func CompressionStats(col Column) (raw uint64, stored uint64, ok bool) {
+	cr, ok := baseEngine.(CompressionReporter)
+	if !ok {
+		return 0, 0, false
+	}
+	raw, stored = cr.CompressionStats(col)
+	return raw, stored, true
+}
+
+func NewIterator(col Column, prefix []byte) Iterator {
+	return engine.NewIterator(col, prefix)
+}
+
+func NewWriteBatch(col Column) WriteBatch {
+	return engine.NewWriteBatch(col)
+}
@@ -136,6 +136,30 @@ func (s *srv) Query(p *pb.QueryParams, r pb.WAVEMQ_QueryServer) error {
 		return nil
 	}
 
+	//Results from the cache have already been checked. Only whole queries
+	//are cached, not pages. The designated router checks the proof of a
+	//forwarded query, but a custom proof is not checked when the request is
+	//formed, so a cached result is only returned once it has been checked
+	//here as well
+	paged := p.Limit > 0 || p.Cursor != nil
+	if !paged {
+		if msgs, ok := s.tm.CachedQuery(p.Namespace, p.Uri); ok {
+			if err := s.am.CheckQuery(qm); err != nil {
+				pmFailedFormQuery.Add(1)
+				r.Send(&pb.QueryMessage{
+					Error: ToError(err),
+				})
+				return nil
+			}
+			for _, m := range msgs {
+				if err := s.sendQueryMessage(p, m, r); err != nil {
+					return err
+				}
+			}
+			return nil
+		}
+	}
+
 	nsString := base64.URLEncoding.EncodeToString(p.Namespace)
 	drconn := s.tm.GetDesignatedRouterConnection(nsString)
 	if drconn == nil {
@@ -154,9 +178,18 @@ func (s *srv) Query(p *pb.QueryParams, r pb.WAVEMQ_QueryServer) error {
 		})
 		return nil
 	}
+	var fill *core.QueryCacheFill
+	if !paged {
+		fill = s.tm.BeginCachedQuery(p.Namespace, p.Uri)
+	}
+	complete := false
+	defer func() {
+		s.tm.EndCachedQuery(fill, complete)
+	}()
 	for {
 		msg, err := client.Recv()
 		if err == io.EOF {
+			complete = true
 			return nil
 		}
 		if err != nil {
@@ -169,6 +202,15 @@ func (s *srv) Query(p *pb.QueryParams, r pb.WAVEMQ_QueryServer) error {
 			return nil
 		}
 
+		if msg.Cursor != nil {
+			//The designated router has reached the limit
+			uerr := r.Send(&pb.QueryMessage{Cursor: msg.Cursor})
+			if uerr != nil {
+				return uerr
+			}
+			continue
+		}
+
 		if msg.Message == nil {
 			panic("no message but no error?")
 		}
@@ -180,21 +222,26 @@ func (s *srv) Query(p *pb.QueryParams, r pb.WAVEMQ_QueryServer) error {
 			lg.Info("dropping query message: %v", err)
 			continue
 		}
+		fill.Add(msg.Message)
 
-		//prepare message
-		pmsg, err := s.am.PrepareMessage(p.Perspective, msg.Message)
-		if err != nil {
-			pmFailedDecryption.Add(1)
-			lg.Info("dropping query message: %v", err)
-			continue
-		}
-
-		uerr := r.Send(&pb.QueryMessage{Message: pmsg})
+		uerr := s.sendQueryMessage(p, msg.Message, r)
 		if uerr != nil {
 			return uerr
 		}
 	}
 }
+
+//Decrypt a checked query result for the client and send it
+func (s *srv) sendQueryMessage(p *pb.QueryParams, m *pb.Message, r pb.WAVEMQ_QueryServer) error {
+	pmsg, err := s.am.PrepareMessage(p.Perspective, m)
+	if err != nil {
+		pmFailedDecryption.Add(1)
+		lg.Info("dropping query message: %v", err)
+		return nil
+	}
+	return r.Send(&pb.QueryMessage{Message: pmsg})
+}
+
 func (s *srv) Subscribe(p *pb.SubscribeParams, r pb.WAVEMQ_SubscribeServer) error {
 	localsubspan := opentracing.StartSpan("localsub")
 	defer localsubspan.Finish()
@@ -228,6 +275,7 @@ func (s *srv) Subscribe(p *pb.SubscribeParams, r pb.WAVEMQ_SubscribeServer) erro
 		Ctx: r.Context(),
 	})
 	notify <- struct{}{} //Run through once
+	batchLength := subscriptionBatchLength(p.MaxBatchMessages)
 	ticker := time.NewTicker(10 * time.Second)
 	defer ticker.Stop()
 	for {
@@ -248,32 +296,27 @@ func (s *srv) Subscribe(p *pb.SubscribeParams, r pb.WAVEMQ_SubscribeServer) erro
 		}
 		for {
 			subspan := opentracing.StartSpan("localsub_iter", opentracing.ChildOf(localsubspan.Context()))
-			it := q.Dequeue()
-			if it == nil {
+			batch := q.DequeueBatch(batchLength, core.MaxSubscriptionBatchBytes)
+			if len(batch) == 0 {
 				subspan.Finish()
 				break
 			}
-			it = pb.ShallowCloneMessageForDrops(it)
-			it.Drops = append(it.Drops, q.Drops())
-			err := s.am.CheckMessage(it)
-			if err != nil {
-				pmFailedProofs.Add(1)
-				lg.Infof("dropping message in subscribe %q due to invalid proof", it.Tbs.Uri)
-				subspan.Finish()
-				continue
-			}
-
-			msg, err := s.am.PrepareMessage(p.Perspective, it)
-			if err != nil {
-				pmFailedDecryption.Add(1)
-				lg.Info("dropping message in subscribe %q: could not prepare: %v", it.Tbs.Uri, err.Reason())
-				subspan.Finish()
-				continue
+			out := make([]*pb.Message, 0, len(batch))
+			for _, it := range batch {
+				it = pb.ShallowCloneMessageForDrops(it)
+				it.Drops = append(it.Drops, q.Drops())
+				//Everything in the queue was verified when it entered the router
+				//(see Terminus.Publish) so we don't check the proof again here
+				msg, err := s.am.PrepareMessage(p.Perspective, it)
+				if err != nil {
+					pmFailedDecryption.Add(1)
+					lg.Info("dropping message in subscribe %q: could not prepare: %v", it.Tbs.Uri, err.Reason())
+					continue
+				}
+				out = append(out, msg)
 			}
 			sendspan := opentracing.StartSpan("send", opentracing.ChildOf(subspan.Context()))
-			uerr := r.Send(&pb.SubscriptionMessage{
-				Message: msg,
-			})
+			uerr := sendSubscriptionBatch(r.Send, out, batchLength > 1)
 			sendspan.Finish()
 			if uerr != nil {
 				subspan.Finish()
@@ -284,6 +327,41 @@ func (s *srv) Subscribe(p *pb.SubscribeParams, r pb.WAVEMQ_SubscribeServer) erro
 	}
 }
 
+//The number of messages to dequeue per SubscriptionMessage frame, given
+//the batch size the subscriber asked for. Subscribers that do not ask
+//get one message per frame
+func subscriptionBatchLength(requested int32) int {
+	if requested <= 1 {
+		return 1
+	}
+	if requested > core.MaxSubscriptionBatchMessages {
+		return core.MaxSubscriptionBatchMessages
+	}
+	return int(requested)
+}
+
+//Send the given messages to a subscriber, either as a single batched frame
+//or as one frame per message for subscribers that do not support batches
+func sendSubscriptionBatch(send func(*pb.SubscriptionMessage) error, msgs []*pb.Message, batched bool) error {
+	if len(msgs) == 0 {
+		return nil
+	}
+	if batched {
+		return send(&pb.SubscriptionMessage{
+			Messages: msgs,
+		})
+	}
+	for _, m := range msgs {
+		err := send(&pb.SubscriptionMessage{
+			Message: m,
+		})
+		if err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
 func (s *srv) Shutdown() {
 
 }
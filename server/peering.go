@@ -84,8 +84,9 @@ func (s *peerServer) PeerQueryRequest(p *pb.PeerQueryParams, r pb.WAVEMQPeering_
 		return nil
 	}
 
-	//Lets execute the request
-	rchan := s.tm.Query(p.Namespace, p.Uri)
+	//Lets execute the request. With a limit, the storage engine stops
+	//scanning once it is reached
+	rchan := s.tm.Query(p.Namespace, p.Uri, int(p.Limit), p.Cursor)
 	//Rchan must be completely consumed, lets ensure that happens
 	defer func() {
 		for _ = range rchan {
@@ -99,6 +100,7 @@ func (s *peerServer) PeerQueryRequest(p *pb.PeerQueryParams, r pb.WAVEMQPeering_
 		}
 		uerr := r.Send(&pb.QueryMessage{
 			Message: e.Msg,
+			Cursor:  e.Cursor,
 		})
 		if uerr != nil {
 			return uerr
@@ -171,6 +173,8 @@ func (s *peerServer) PeerSubscribe(p *pb.PeerSubscribeParams, r pb.WAVEMQPeering
 	//Keep a list of proofs that have been sent before
 	sentProofs := make(map[peerProofCacheKey]bool)
 
+	batchLength := subscriptionBatchLength(p.MaxBatchMessages)
+
 	//Dequeueing resets the un-drained queue timer. We need to call dequeue
 	//every now and then even if there is no data
 	ticker := time.NewTicker(10 * time.Second)
@@ -193,39 +197,34 @@ func (s *peerServer) PeerSubscribe(p *pb.PeerSubscribeParams, r pb.WAVEMQPeering
 		}
 		for {
 			subspan := opentracing.StartSpan("peersub_iter", opentracing.ChildOf(peersubspan.Context()))
-			it := q.Dequeue()
-			if it == nil {
+			batch := q.DequeueBatch(batchLength, core.MaxSubscriptionBatchBytes)
+			if len(batch) == 0 {
 				subspan.Finish()
 				break
 			}
-			it = pb.ShallowCloneMessageForDrops(it)
-			it.Drops = append(it.Drops, q.Drops())
-
-			cacheKey := peerProofCacheKey{}
-			cacheKey.Low, cacheKey.High = cityhash.Hash128(it.ProofDER)
-
-			if docaching {
-				if sentProofs[cacheKey] {
-					it.ProofHash = cacheKey.Serialize()
-					it.ProofDER = nil
-				} else {
-					sentProofs[cacheKey] = true
+			for i, it := range batch {
+				it = pb.ShallowCloneMessageForDrops(it)
+				it.Drops = append(it.Drops, q.Drops())
+
+				cacheKey := peerProofCacheKey{}
+				cacheKey.Low, cacheKey.High = cityhash.Hash128(it.ProofDER)
+
+				if docaching {
+					if sentProofs[cacheKey] {
+						it.ProofHash = cacheKey.Serialize()
+						it.ProofDER = nil
+					} else {
+						sentProofs[cacheKey] = true
+					}
 				}
+				//We don't check or prepare messages sent to peers
+				batch[i] = it
+			}
+			uerr := sendSubscriptionBatch(r.Send, batch, batchLength > 1)
+			if uerr != nil {
+				subspan.Finish()
+				return uerr
 			}
-			// err := s.am.CheckMessage(it)
-			// if err != nil {
-			// 	fmt.Printf("dropping message due to invalid proof\n")
-			// 	continue
-			// }
-			//We don't prepare messages sent to peers
-			// m, err := s.am.PrepareMessage(p, m)
-			// if err != nil {
-			// 	fmt.Printf("dropping message, could not prepare: %v\n", err)
-			// 	continue
-			// }
-			r.Send(&pb.SubscriptionMessage{
-				Message: it,
-			})
 			subspan.Finish()
 		}
 	}
@@ -241,6 +240,21 @@ func (s *peerServer) PeerUnsubscribe(ctx context.Context, p *pb.PeerUnsubscribeP
 	return &pb.PeerUnsubscribeResponse{}, nil
 }
 
+func (s *peerServer) PeerInterest(p *pb.PeerInterestParams, r pb.WAVEMQPeering_PeerInterestServer) error {
+	if !s.tm.IsDesignatedRouterFor(p.Namespace) {
+		return r.Send(&pb.InterestUpdate{
+			Error: ToError(wve.Err(wve.InvalidParameter, "we are not the designated router for this namespace")),
+		})
+	}
+	//The patterns reveal what is subscribed to in the namespace
+	if err := s.am.CheckInterest(p); err != nil {
+		return r.Send(&pb.InterestUpdate{
+			Error: ToError(err),
+		})
+	}
+	return s.tm.WatchInterest(r.Context(), p.Namespace, p.RouterID, r.Send)
+}
+
 func (s *peerServer) Shutdown() {
 
 }